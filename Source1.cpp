@@ -9,7 +9,33 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
 #include "camera.h"
-#include <iostream>
+#include "logger.h"
+#include "recording.h"
+#include "gltrace.h"
+#include "meshfile.h"
+#include "vertexformat.h"
+#include "meshoptimize.h"
+#include "meshlod.h"
+#include "texturestream.h"
+#include "framepipeline.h"
+#include "dynamicresolution.h"
+#include "workerpool.h"
+#include "pngwrite.h"
+#include "batchrender.h"
+#include "materials.h"
+#include "softrender.h"
+#include "stressscene.h"
+#include "scalingbench.h"
+#include "gpuresources.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstring>
+#include <memory>
 
 using namespace std; // Standard namespace
 
@@ -23,10 +49,6 @@ namespace
 {
     const char* const WINDOW_TITLE = "Eggs"; // Macro for window title
 
-    // offset to use to encompass vertex position and color; change this value if using 
-    // textures, etc.
-    const int STRIDE = 7;
-
     // Variables for window width and height
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
@@ -38,26 +60,92 @@ namespace
         GLuint vbos[2];     // Handles for the vertex buffer objects
         GLuint nIndices; 
         GLfloat nVertices;  // Number of indices of the mesh
+        GLenum indexType = GL_UNSIGNED_SHORT; // Type of the index buffer entries
+        glm::vec3 positionScale = glm::vec3(1.0f); // object position = stored position * scale + bias
+        glm::vec3 positionBias = glm::vec3(0.0f);
+        bool octNormals = false;    // normals stored as two octahedral components
+        size_t vertexBytes = 0;     // size of the vertex buffer
+        MeshFileLod lods[MESH_FILE_MAX_LODS]; // index ranges of the detail levels, finest first
+        int lodCount = 0;
+        glm::vec3 boundsCenter = glm::vec3(0.0f); // bounding sphere in object space, for LOD selection
+        float boundsRadius = 0.0f;
+        glm::vec3 boundsMin = glm::vec3(0.0f); // bounding box in object space, for the scene BVH and occlusion tests
+        glm::vec3 boundsMax = glm::vec3(0.0f);
+        std::shared_ptr<MeshData> cpu; // the vertices as the vertex shader decodes them, and the indices (software rendering only)
+        std::shared_ptr<MeshBvh> bvh;  // triangles of the finest level in object space, for picking (scene meshes only);
+                                       // a mesh file's arrives later from gMeshBvhBuilder, so read it through UMeshBvh
+    };
+
+    // Size of the light arrays of fragmentShaderSource
+    const int MAX_LIGHTS = 8;
+    static_assert(MAX_LIGHTS == SOFT_MAX_LIGHTS, "the software renderer takes as many lights as the shader");
+
+    // Per-instance vertex attributes: the model matrix columns at locations 3 to 6, the material
+    // index at 7 and the selection flag at 8, stepping once per instance
+    const GLuint INSTANCE_MODEL_LOCATION = 3;
+    const GLuint INSTANCE_MATERIAL_LOCATION = 7;
+    const GLuint INSTANCE_HIGHLIGHT_LOCATION = 8;
+    struct InstanceData
+    {
+        glm::mat4 model;
+        GLint material;     // index into gMaterials
+        GLint highlight;    // 1 for the selected object
+        GLint padding[2];   // keeps the next model matrix 16 byte aligned
     };
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
     //triangle mesh data for lamp
     GLMesh gMesh;
-    // egg mesh data
+    // egg mesh data; both parts have the same geometry, so the white shares the yolk's buffers and the
+    // two draw as instances of one mesh
     GLMesh gYolkMesh;
     GLMesh gWhiteMesh;
     // plate data
     GLMesh gPlateMesh;
-    // Texture
-    GLuint gTextureYolk;
-    GLuint gTextureWhite;
+    // optional mesh loaded from a binary mesh file, scaled to fit next to the plate
+    GLMesh gAssetMesh;
+    glm::mat4 gAssetModel(1.0f);
+    // level of detail state of each drawn object
+    LodState gYolkLod;
+    LodState gWhiteLod;
+    LodState gPlateLod;
+    LodState gAssetLod;
+    // Textures and materials: each texture is a layer of one array, each material an entry of one table
+    MaterialSystem gMaterials;
+    int gMaterialYolk = 0;
+    int gMaterialWhite = 0;
     glm::vec2 gUVScale(5.0f, 5.0f);
+    // instances of every draw of a frame, in draw list order; all mesh VAOs read from this buffer
+    GLuint gInstanceBuffer = 0;
+    std::vector<InstanceData> gInstances;
+    std::vector<int> gInstanceObjects;  // gSceneObjects index of each instance
+
+    // occlusion culling: objects whose bounding box was hidden last frame are skipped (interactive runs only)
+    OcclusionCuller gOcclusion;
+    std::vector<OcclusionState> gDrawStates;    // per packet draw
     GLint gTexWrapMode = GL_REPEAT;
     
     // Shader program
     GLuint gProgramId;
     GLuint gLampProgramId;
+    GLuint gUpscaleProgramId;
+
+    // framebuffer size in pixels (differs from the window size on high DPI displays)
+    int gFramebufferWidth = WINDOW_WIDTH;
+    int gFramebufferHeight = WINDOW_HEIGHT;
+
+    // dynamic resolution: the scene renders into gRenderTarget at a scale that holds the target GPU time,
+    // then a fullscreen pass upscales it into the window
+    bool gDynamicResolution = false;
+    RenderTarget gRenderTarget;
+    GpuTimer gSceneTimer;
+    ResolutionController gResolution;
+    GLuint gUpscaleVao = 0;     // the fullscreen triangle needs no vertex data, but core profile needs a VAO
+
+    // software rendering: the scene is rasterized on the CPU, uploaded into gRenderTarget and blitted into the window
+    SoftRenderer gSoftRenderer;
+    std::vector<SoftDraw> gSoftDraws;
 
     // camera
     Camera gCamera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -76,6 +164,172 @@ namespace
     glm::vec3 gLightColor(1.0f, 1.0f, 1.0f); // White
     glm::vec3 gLightPosition(1.0f, 1.0f, 3.0f);
     glm::vec3 gLightScale(0.3f);
+
+    // generated stress scene (--stress and the scaling benchmark); when it has objects it replaces the egg
+    StressSceneDesc gStressDesc;
+    std::vector<StressObject> gStressObjects;
+    std::vector<StressLight> gStressLights;
+    std::vector<LodState> gStressLods;  // one per object
+    int gStressFirstMaterial = 0;       // the scene's random materials follow the egg's in gMaterials
+
+    // picking: every object the last frame placed, visible or not, in a BVH over their world space boxes.
+    // Objects keep their index from frame to frame as long as the same number is placed; those whose
+    // model changed are refit into the tree, a different count rebuilds it. Update thread only.
+    struct SceneObject
+    {
+        const GLMesh* mesh = nullptr;
+        glm::mat4 model;
+        glm::mat4 inverse;          // world to object space, where the mesh's triangle BVH is
+        const char* name = nullptr;
+    };
+    std::vector<SceneObject> gSceneObjects;
+    std::vector<BvhBounds> gSceneBounds;    // world space box of each object
+    std::vector<uint32_t> gSceneChanged;    // objects whose model changed this frame
+    size_t gScenePlaced = 0;                // objects placed so far this frame
+    bool gSceneRebuild = false;             // this frame placed objects the last one did not
+    Bvh gSceneBvh;
+    int gSelectedObject = -1;               // index into gSceneObjects, -1 for none
+    const uint32_t PICK_BOX_HIT = UINT32_MAX;   // triangle of a pick that hit the box of a mesh whose BVH is not built yet
+    WorkerPool gMeshBvhBuilder;             // builds the triangle BVHs of mesh files after they load
+
+    // command line options
+    struct AppOptions
+    {
+        const char* recordPath = nullptr;   // --record <file>: save the camera path of this session
+        const char* replayPath = nullptr;   // --replay <file>: drive the camera from a recording
+        const char* timingsPath = nullptr;  // --timings <file>: write per-frame replay times as CSV
+        float replayStep = 1.0f / 60.0f;    // --step <seconds>: fixed timestep used while replaying
+        bool offscreen = false;             // --offscreen: hidden window and no vsync
+        const char* capturePath = nullptr;  // --capture-gl <file>: record the GL command stream
+        int captureFrames = 300;            // --capture-frames <n>: frames to capture after setup
+        const char* glReplayPath = nullptr; // --replay-gl <file>: re-issue a GL capture offscreen and time it
+        int loops = 100;                    // --loops <n>: passes for GL replay and benchmarks
+        const char* meshPath = nullptr;     // --mesh <file.eggm>: load and show a binary mesh
+        const char* convertInput = nullptr; // --convert-mesh <in.obj> <out.eggm>: write a binary mesh
+        const char* convertOutput = nullptr;
+        const char* benchObjPath = nullptr; // --bench-mesh-load <in.obj> <in.eggm>: compare load times
+        const char* benchMeshPath = nullptr;
+        Vertex_Format vertexFormat = VERTEX_FORMAT_AUTO; // --vertex-format auto|float|compact
+        bool benchVertexFormats = false;    // --bench-vertex-formats: compare float and compact vertex formats
+        int sides = 100000;                 // --sides <n>: prism sides used by the vertex format and optimizer benchmarks
+        bool optimizeMeshes = true;         // --no-mesh-optimize: upload meshes in generator order
+        bool overdrawSort = false;          // --overdraw-sort: also order triangle clusters outside-in
+        const char* benchOptimizePath = nullptr; // --bench-mesh-optimize <in.obj|prism>: report cache efficiency
+        float lodThreshold = 1.0f;          // --lod-threshold <pixels>: screen space error allowed per object (0 = finest only)
+        bool streamTextures = true;         // --no-texture-streaming: decode and upload textures fully at startup
+        int textureUploadKB = 1024;         // --texture-upload-budget <KB>: texture bytes uploaded per frame
+        int gpuMemoryMB = 512;              // --gpu-memory-budget <MB>: held by dropping levels of the material array (0 = no limit)
+        int frameLatency = 1;               // --frame-latency <0-2>: frames the update thread runs ahead of GL submission (0 = serial)
+        float targetFrameMs = -1.0f;        // --target-frame-ms <ms>: GPU time dynamic resolution holds (0 = always full size;
+                                            //   defaults to 15, or to 0 for replays and offscreen runs so their timings compare)
+        float minResolutionScale = 0.5f;    // --min-resolution-scale <0-1>: lowest share of the window width and height rendered
+        float sharpen = 0.25f;              // --sharpen <0-1>: sharpening of the upscale pass
+        const char* batchPath = nullptr;    // --batch <poses.txt> <outdir>: render a pose list to PNG files in an existing directory and exit
+        const char* batchOutput = nullptr;
+        int shardIndex = 0;                 // --shard <i>/<n>: render only every n-th pose starting at i
+        int shardCount = 1;
+        int encodeThreads = 0;              // --encode-threads <n>: PNG encoding threads (0 = all but one)
+        bool software = false;              // --software: rasterize the scene on the CPU (for hosts without a GPU)
+        int softwareThreads = 0;            // --software-threads <n>: software rasterizer threads (0 = all)
+        bool benchSoftware = false;         // --bench-software: compare the software rasterizer with the GL implementation
+        bool stress = false;                // --stress <tables>x<plates>x<items>: show a generated scene instead of the egg
+        int stressTables = 16;
+        int stressPlates = 8;
+        int stressItems = 3;
+        int lights = 1;                     // --lights <1-8>: lights of the generated scene
+        uint32_t seed = 1;                  // --seed <n>: layout and materials of the generated scene
+        const char* benchScalingPath = nullptr; // --bench-scaling <results.csv>: sweep object count, lights and resolution offscreen
+        bool benchPicking = false;          // --bench-picking: time BVH build, refit and cursor ray queries over generated scenes
+        bool occlusionCulling = true;       // --no-occlusion-culling: draw every object in view, hidden or not
+        const char* baselinePath = nullptr; // --baseline <results.csv>: fail the scaling benchmark on regressions against these results
+        float tolerance = 15.0f;            // --tolerance <percent>: frame time and memory growth over the baseline that still passes
+    };
+    AppOptions gOptions;
+
+    // camera recording and deterministic replay
+    CameraRecorder gRecorder;
+    CameraTrack gReplayTrack;
+    bool gReplaying = false;
+    int gReplayFrame = 0;
+    float gRecordStart = -1.0f;
+    FrameTimings gFrameTimings;
+
+    // per frame draw statistics
+    struct FrameStats
+    {
+        unsigned triangles = 0;     // triangles submitted to the GPU this frame
+        unsigned draws = 0;
+        unsigned instances = 0;     // objects drawn by those draws
+    };
+    FrameStats gFrameStats;
+    float gStatsReportTime = 0.0f;
+    float gFirstFrameTime = 0.0f;
+    bool gTexturesSettled = false;  // every streamed texture has the levels it needs
+    double gReplayTriangles = 0.0;  // sum over all replayed frames
+
+    // keys that move the camera, read on the main thread and applied by the update stage
+    struct MoveKey
+    {
+        int key;
+        Camera_Movement direction;
+    };
+    const MoveKey MOVE_KEYS[] = {
+        { GLFW_KEY_W, FORWARD }, { GLFW_KEY_S, BACKWARD }, { GLFW_KEY_A, LEFT },
+        { GLFW_KEY_D, RIGHT }, { GLFW_KEY_Q, UP }, { GLFW_KEY_E, DOWN }
+    };
+    const int MOVE_KEY_COUNT = sizeof(MOVE_KEYS) / sizeof(MOVE_KEYS[0]);
+
+    // Input of one frame as the main thread saw it (GLFW may only be polled there)
+    struct InputSnapshot
+    {
+        float time = 0.0f;          // glfwGetTime() when the input was read
+        float deltaTime = 0.0f;
+        bool moving[MOVE_KEY_COUNT] = {};  // MOVE_KEYS held
+        int uvScaleStep = 0;        // +1 while ] is held, -1 while [ is held
+        float mouseX = 0.0f;        // mouse movement and scrolling since the previous snapshot
+        float mouseY = 0.0f;
+        float scroll = 0.0f;
+        bool resetCamera = false;
+        bool pick = false;          // select the object under the cursor
+        float pickX = 0.0f;         // cursor position in normalized device coordinates
+        float pickY = 0.0f;
+        int framebufferWidth = WINDOW_WIDTH;
+        int framebufferHeight = WINDOW_HEIGHT;
+        float resolutionScale = 1.0f;   // current dynamic resolution scale
+    };
+    InputSnapshot gPendingInput;    // filled by the GLFW callbacks until the next snapshot is taken
+
+    // One object of the draw list
+    struct DrawItem
+    {
+        const GLMesh* mesh;
+        glm::mat4 model;
+        int material;               // index into gMaterials
+        int lod;                    // index range to draw
+        int object;                 // index into gSceneObjects
+    };
+
+    // Everything the GL thread needs to submit a frame, built by the update stage
+    struct FramePacket
+    {
+        float time = 0.0f;          // input time the frame was built from
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 cameraPosition;
+        glm::vec2 uvScale;
+        int lightCount = 0;
+        glm::vec3 lightPositions[MAX_LIGHTS];
+        glm::vec3 lightColors[MAX_LIGHTS];
+        int framebufferWidth = WINDOW_WIDTH;
+        int framebufferHeight = WINDOW_HEIGHT;
+        int renderWidth = WINDOW_WIDTH; // size the scene renders at
+        int renderHeight = WINDOW_HEIGHT;
+        std::vector<DrawItem> draws; // visible objects, sorted by mesh and level; capacity is kept between frames
+        int eggLods[2] = {};        // levels picked for the yolk and the white, for the statistics
+        int selectedObject = -1;    // drawn highlighted
+        bool replayEnded = false;   // the camera recording ran out, close after this frame
+    };
+    FramePipeline<InputSnapshot, FramePacket> gPipeline;
 }
 
 /* User-defined Function prototypes to:
@@ -84,44 +338,112 @@ namespace
  * and render graphics on the screen
  */
 bool UInitialize(int, char* [], GLFWwindow** window);
+bool UParseCommandLine(int argc, char* argv[]);
 void UResizeWindow(GLFWwindow* window, int width, int height);
-void UProcessInput(GLFWwindow* window);
+void UProcessInput(GLFWwindow* window, InputSnapshot& input);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void UCreatePrismMesh(GLfloat verts[], GLushort indices[], int numSides, float radius, float halfLen);
+void UCreatePrismMesh(MeshData& data, int numSides, float radius, float halfLen);
 void UCreateCylinderMesh(GLMesh& mesh);
 void UCreatePlateMesh(GLMesh& mesh);
 void UCreateMesh(GLMesh& mesh);
+void UOptimizeMesh(MeshData& data, const char* name);
+void UUploadMesh(const MeshData& data, GLMesh& mesh, Vertex_Format format);
+void UBindInstanceAttributes();
+void USetMeshUniforms(GLuint programId, const GLMesh& mesh);
+int USelectMeshLod(const GLMesh& mesh, const glm::mat4& modelView, const glm::mat4& projection, float viewportHeight, LodState& lod,
+    float& screenPixels);
+bool USphereVisible(const glm::mat4& modelViewProjection, const GLMesh& mesh);
+void UDrawMesh(const GLMesh& mesh, int level, GLuint firstInstance, GLsizei instanceCount);
+bool UCreateMeshFromFile(const char* filename, GLMesh& mesh);
+bool UConvertMesh(const char* objFilename, const char* meshFilename);
+bool UBenchmarkMeshLoad();
+bool UBenchmarkVertexFormats();
+bool UBenchmarkSoftware();
+bool UBenchmarkScaling();
+bool UBenchmarkPicking();
+bool UBenchmarkMeshOptimize();
 void UDestroyMesh(GLMesh& mesh);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
-void URender();
+bool UCreateMaterials();
+void URequestTexture(int streamHandle, float screenPixels);
+void UUpdateFrame(const InputSnapshot& input, FramePacket& packet);
+void UBuildFramePacket(FramePacket& packet, int framebufferWidth, int framebufferHeight, float resolutionScale);
+glm::mat4 UProjectionMatrix(float aspect);
+void UAddDraw(FramePacket& packet, const GLMesh& mesh, const glm::mat4& model, int material, LodState& lod, const char* name);
+int UPlaceObject(const GLMesh& mesh, const glm::mat4& model, const char* name);
+void UUpdateSceneBvh();
+int UPickObject(const BvhRay& ray, float& t, uint32_t& triangle);
+BvhBounds UMeshBounds(const GLMesh& mesh);
+void UTestOcclusion(const FramePacket& packet);
+BvhRay UCursorRay(const FramePacket& packet, float x, float y);
+void UPickAtCursor(const FramePacket& packet, float x, float y);
+void UBuildMeshBvh(const MeshData& data, GLMesh& mesh);
+void UBuildMeshBvhAsync(const char* filename, GLMesh& mesh);
+std::shared_ptr<MeshBvh> UMeshBvh(const GLMesh& mesh);
+bool UDecodeMeshFile(const char* filename, const MappedFile& file, const MeshFileHeader& header, MeshData& data);
+void UCreateStressScene(int tables, int plates, int items, int lights);
+const GLMesh& UStressMesh(StressKind kind);
+void URender(const FramePacket& packet);
+void URenderScene(const FramePacket& packet);
+void UUpscale(const FramePacket& packet);
+void USoftwareRenderScene(const FramePacket& packet);
+void USoftwarePresent(const FramePacket& packet);
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
+void URecordCameraFrame(float currentFrame);
+bool UReplayCameraFrame();
+void UApplyCameraSample(const CameraSample& sample);
+void UReportFrameTimings();
+bool UReplayGLTrace();
+void UReport(const char* format, ...);
+bool UBatchRender();
 
 
 /* Vertex Shader Source Code */
 const GLchar* vertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0
-layout(location = 1) in vec3 normal; // Normal data from Vertex Attrib Pointer 1
+    layout(location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0 (float, or normalized shorts)
+layout(location = 1) in vec3 normal; // Normal data from Vertex Attrib Pointer 1 (xyz, or octahedral xy)
 layout(location = 2) in vec2 textureCoordinate; // Texture data from Vertex Attrib Pointer 2
+layout(location = 3) in mat4 model; // Per-instance model matrix (locations 3 to 6)
+layout(location = 7) in int material; // Per-instance index into the material table
+layout(location = 8) in int highlight; // Per-instance selection flag
 
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec2 vertexTextureCoordinate; // For outgoing texture coordinate
+flat out int vertexMaterial; // For outgoing material index
+flat out int vertexHighlight; // For outgoing selection flag
 
 // Global variables for the  transform matrices
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Vertex format: object position = position * positionScale + positionBias
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+uniform bool octNormals;
+
+// Unfolds an octahedral encoded normal
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+        n.xy = (1.0f - abs(e.yx)) * vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices to clip coordinates
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // Gets normal vectors in world space only and exclude normal translation properties
+    vec3 objectPosition = position * positionScale + positionBias; // Restores the object space position
+    vec3 objectNormal = octNormals ? octDecode(normal.xy) : normal;
+
+    gl_Position = projection * view * model * vec4(objectPosition, 1.0f); // Transforms vertices to clip coordinates
+    vertexFragmentPos = vec3(model * vec4(objectPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+    vertexNormal = mat3(transpose(inverse(model))) * objectNormal; // Gets normal vectors in world space only and exclude normal translation properties
     vertexTextureCoordinate = textureCoordinate; // Gets texture coordinate
+    vertexMaterial = material;
+    vertexHighlight = highlight;
 }
 );
 
@@ -130,49 +452,77 @@ const GLchar* fragmentShaderSource = GLSL(440,
     in vec3 vertexFragmentPos; // For incoming fragment position
 in vec3 vertexNormal; // For incoming normals
 in vec2 vertexTextureCoordinate; // For incoming texture coordinate
+flat in int vertexMaterial; // For incoming material index
+flat in int vertexHighlight; // For incoming selection flag
 
 out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 lightColor;
-uniform vec3 lightPos;
+// Surface properties of an object, as in the Material struct of materials.h
+struct Material
+{
+    vec2 uvScale; // Texture repeats on top of the global uvScale
+    float specularIntensity;
+    float highlightSize;
+    int layer; // Layer of uTextures
+    float minLevel; // Finest mip level of the layer that is loaded
+};
+
+layout(std430, binding = 0) readonly buffer Materials
+{
+    Material materials[];
+};
+
+// Uniform / Global variables for the lights (the first lightCount entries; arrays sized MAX_LIGHTS) and camera/view position
+uniform int lightCount;
+uniform vec3 lightColors[8];
+uniform vec3 lightPositions[8];
 uniform vec3 viewPosition;
-uniform sampler2D uTexture; // Useful when working with multiple textures
+uniform sampler2DArray uTextures; // Every texture of the scene, one layer each
 uniform vec2 uvScale;
 
 void main()
 {
-    /* Phong lighting model calculations to generate ambient, diffuse, and specular components */
+    Material surface = materials[vertexMaterial];
 
-    // LAMP 1: Calculate ambient lighting
-    float ambientStrength = 0.1f; // Set ambient or global lighting strength 10%
-    vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
-
- 
-    // LAMP 1: Calculate diffuse lighting
+    /* Phong lighting model calculations to generate ambient, diffuse, and specular components */
     vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * lightColor; // Generate diffuse light color
+    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+    float specularIntensity = surface.specularIntensity; // Specular light strength of the material
+    float highlightSize = surface.highlightSize; // Specular highlight size of the material
+    vec3 lighting = vec3(0.0f);
 
+    for (int i = 0; i < lightCount; i++)
+    {
+        // LAMP i: Calculate ambient lighting
+        float ambientStrength = 0.1f; // Set ambient or global lighting strength 10%
+        vec3 ambient = ambientStrength * lightColors[i]; // Generate ambient light color
 
-    // LAMP 1: Calculate specular lighting
-    float specularIntensity = 0.1f; // Set specular light strength
-    float highlightSize = 16.0f; // Set specular highlight size
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+        // LAMP i: Calculate diffuse lighting
+        vec3 lightDirection = normalize(lightPositions[i] - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+        float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+        vec3 diffuse = impact * lightColors[i]; // Generate diffuse light color
 
-    
-    // LAMP 1: Calculate specular component
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * lightColor;
+        // LAMP i: Calculate specular lighting
+        vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+        vec3 specular = specularIntensity * specularComponent * lightColors[i];
+
+        lighting += ambient + diffuse + specular;
+    }
 
 
-    // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+    // Texture holds the color to be used for all three components; levels finer than minLevel are
+    // still streaming in, so the mip level the hardware would pick is clamped to it
+    vec2 textureCoordinate = vertexTextureCoordinate * uvScale * surface.uvScale;
+    float level = max(textureQueryLod(uTextures, textureCoordinate).y, surface.minLevel);
+    vec4 textureColor = textureLod(uTextures, vec3(textureCoordinate, float(surface.layer)), level);
 
     // Calculate phong result
-    vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
+    vec3 phong = lighting * textureColor.xyz;
+
+    // the selected object is tinted (SOFT_HIGHLIGHT_COLOR and SOFT_HIGHLIGHT_MIX in softrender.h)
+    if (vertexHighlight != 0)
+        phong = mix(phong, vec3(1.0f, 0.8f, 0.2f), 0.4f);
 
     // Send lighting results to GPU
     fragmentColor = vec4(phong, 1.0);
@@ -205,35 +555,119 @@ void main()
 }
 );
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
+/* Upscale Vertex Shader Source Code: one triangle covering the window */
+const GLchar* upscaleVertexShaderSource = GLSL(440,
+    out vec2 sourceCoordinate; // Position in the render target
+
+uniform vec2 sourceScale; // Share of the render target the scene covers
+
+void main()
+{
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2)); // (0,0) (2,0) (0,2)
+    sourceCoordinate = corner * sourceScale;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
+);
+
+
+/* Upscale Fragment Shader Source Code: bilinear upscale with a sharpening limited to the local contrast */
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+    in vec2 sourceCoordinate;
+
+out vec4 fragmentColor;
+
+uniform sampler2D sourceImage; // Scene color
+uniform vec2 texelSize; // One render target texel in texture coordinates
+uniform vec2 sourceMax; // Last coordinate inside the rendered corner, so filtering never reads past it
+uniform float sharpness; // 0 = plain bilinear
+
+vec3 fetch(vec2 offset)
 {
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
+    return texture(sourceImage, min(sourceCoordinate + offset * texelSize, sourceMax)).rgb;
+}
 
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
-    }
+void main()
+{
+    vec3 center = fetch(vec2(0.0f));
+    vec3 north = fetch(vec2(0.0f, 1.0f));
+    vec3 south = fetch(vec2(0.0f, -1.0f));
+    vec3 east = fetch(vec2(1.0f, 0.0f));
+    vec3 west = fetch(vec2(-1.0f, 0.0f));
+
+    // unsharp mask, clamped to the neighbourhood so edges do not ring
+    vec3 lowest = min(center, min(min(north, south), min(east, west)));
+    vec3 highest = max(center, max(max(north, south), max(east, west)));
+    vec3 sharpened = center + (4.0f * center - north - south - east - west) * (0.25f * sharpness);
+    fragmentColor = vec4(clamp(sharpened, lowest, highest), 1.0f);
 }
+);
 
 int main(int argc, char* argv[])
 {
+    // Start the background log writer so console output never stalls the render loop
+    Logger::Instance().Start();
+
+    if (!UParseCommandLine(argc, argv))
+        return EXIT_FAILURE;
+
+    // offline conversion does not need a window
+    if (gOptions.convertInput != nullptr)
+        return UConvertMesh(gOptions.convertInput, gOptions.convertOutput) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (gOptions.benchOptimizePath != nullptr)
+        return UBenchmarkMeshOptimize() ? EXIT_SUCCESS : EXIT_FAILURE;
+
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
+    if (gOptions.benchObjPath != nullptr)
+        return UBenchmarkMeshLoad() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (gOptions.benchVertexFormats)
+        return UBenchmarkVertexFormats() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // GL trace replay brings its own resources, so the scene is never built
+    if (gOptions.glReplayPath != nullptr)
+        return UReplayGLTrace() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // batch stills need every texture at full resolution from the first image, and their exact size; so do
+    // the scaling runs, whose timings and memory would otherwise depend on how far streaming has got
+    if (gOptions.batchPath != nullptr || gOptions.benchScalingPath != nullptr)
+    {
+        gOptions.streamTextures = false;
+        gOptions.targetFrameMs = 0.0f;
+    }
+
+    // replays and GL captures load every texture in full as well: streamed levels arrive as fast as the decode
+    // thread allows, so replayed frame times would vary run to run, and captured uploads would land after
+    // BeginFrames and be played again every loop
+    if (gReplaying || GLTraceWriter::Instance().IsCapturing())
+        gOptions.streamTextures = false;
+
+    // the software renderer samples the decoded textures in full and always renders at the window size
+    if (gOptions.software || gOptions.benchSoftware)
+    {
+        gOptions.streamTextures = false;
+        gOptions.targetFrameMs = 0.0f;
+        gMaterials.KeepPixels = true;
+    }
+
+    // every buffer and texture from here on is created through GpuResources, which holds this budget
+    GpuResources::Instance().Budget = (size_t)glm::max(gOptions.gpuMemoryMB, 0) * 1024 * 1024;
+
+    // every mesh VAO reads its per-instance attributes from this buffer
+    gInstanceBuffer = GpuResources::Instance().CreateBuffer(GPU_INSTANCES, "instances");
+
     // Create the mesh
     UCreateCylinderMesh(gYolkMesh);
-    UCreateCylinderMesh(gWhiteMesh);
+    gWhiteMesh = gYolkMesh;
     UCreatePlateMesh(gPlateMesh);
     UCreateMesh(gMesh);
+    if (gOptions.meshPath != nullptr && !UCreateMeshFromFile(gOptions.meshPath, gAssetMesh))
+    {
+        LOG(LOG_ERROR, "Failed to load mesh %s", gOptions.meshPath);
+        return EXIT_FAILURE;
+    }
 
     // Create the shader program
     if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
@@ -242,62 +676,206 @@ int main(int argc, char* argv[])
     if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
         return EXIT_FAILURE;
 
-    // Load textures
-    const char* texFilename = "../OpenGLSample/resources/textures/yolk.png";
-    if (!UCreateTexture(texFilename, gTextureYolk))
+    // GL captures only record the default framebuffer, so dynamic resolution stays off while capturing
+    if (gOptions.targetFrameMs < 0.0f)
+        gOptions.targetFrameMs = gReplaying || gOptions.offscreen ? 0.0f : RESOLUTION_DEFAULT_TARGET_MS;
+    gDynamicResolution = gOptions.targetFrameMs > 0.0f && !GLTraceWriter::Instance().IsCapturing();
+    if (gDynamicResolution)
     {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
+        if (!UCreateShaderProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource, gUpscaleProgramId))
+            return EXIT_FAILURE;
+        glGenVertexArrays(1, &gUpscaleVao);
+        gSceneTimer.Create();
+        gResolution.TargetMs = gOptions.targetFrameMs;
+        gResolution.MinScale = glm::clamp(gOptions.minResolutionScale, 0.1f, 1.0f);
+        LOG(LOG_INFO, "Dynamic resolution: holding %.1f ms of GPU time, down to %.0f%% of the window size",
+            gResolution.TargetMs, gResolution.MinScale * 100.0f);
     }
-    const char* texFilename2 = "../OpenGLSample/resources/textures/white.jpg";
-    if (!UCreateTexture(texFilename2, gTextureWhite))
-    {
-        cout << "Failed to load texture " << texFilename2 << endl;
+
+    // Load textures and materials
+    if (!UCreateMaterials())
         return EXIT_FAILURE;
-    }
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
     glUseProgram(gProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+    // We set the texture array as texture unit 0
+    glUniform1i(glGetUniformLocation(gProgramId, "uTextures"), 0);
 
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    if (gOptions.benchScalingPath != nullptr)
+        return UBenchmarkScaling() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (gOptions.benchPicking)
+        return UBenchmarkPicking() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // the generated scene, seen from above its edge
+    if (gOptions.stress)
+    {
+        UCreateStressScene(gOptions.stressTables, gOptions.stressPlates, gOptions.stressItems, gOptions.lights);
+        float radius = StressSceneRadius(gStressDesc);
+        if (!gReplaying)
+        {
+            CameraSample sample;
+            memset(&sample, 0, sizeof(sample));
+            sample.Position[1] = radius * 0.6f;
+            sample.Position[2] = radius * 1.2f;
+            sample.Yaw = -90.0f;
+            sample.Pitch = -glm::degrees(std::atan2(0.6f, 1.2f));
+            sample.Zoom = 45.0f;
+            UApplyCameraSample(sample);
+        }
+    }
+
+    if (gOptions.benchSoftware)
+        return UBenchmarkSoftware() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (gOptions.software)
+    {
+        gSoftRenderer.Start(gOptions.softwareThreads);
+        gSoftRenderer.SetMaterials(gMaterials);
+        LOG(LOG_INFO, "Software rendering on %d threads", gSoftRenderer.ThreadCount());
+    }
+
+    if (gOptions.batchPath != nullptr)
+        return UBatchRender() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // occlusion results trail a frame, so only consecutive frames of one view use them. GL captures do
+    // not record queries, so culling stays off while capturing.
+    if (gOptions.occlusionCulling && !gOptions.software && !GLTraceWriter::Instance().IsCapturing())
+        gOcclusion.Create(gLampProgramId);
+
+    // the capture replays everything up to here once, then loops over the frames after it
+    GLTraceWriter::Instance().BeginFrames();
+    gFirstFrameTime = glfwGetTime();
+    gLastFrame = gFirstFrameTime;
+
+    // the update thread starts frameLatency frames ahead of the GL thread
+    gPipeline.Start(gOptions.frameLatency, UUpdateFrame);
+    LOG(LOG_INFO, "Frame pipeline latency: %d frame(s)", gPipeline.Latency());
+    for (int i = 0; i < gPipeline.Latency(); i++)
+    {
+        InputSnapshot input;
+        UProcessInput(gWindow, input);
+        gPipeline.Submit(input);
+    }
 
     // render loop
     // -----------
     while (!glfwWindowShouldClose(gWindow))
     {
-        // per-frame timing
-        // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
-
         // input
         // -----
-        UProcessInput(gWindow);
+        InputSnapshot input;
+        UProcessInput(gWindow, input);
+        float currentFrame = input.time;
+
+        // the update of this input runs while an earlier frame is submitted
+        gPipeline.Submit(input);
+        const FramePacket& packet = gPipeline.Acquire();
 
         // Render this frame
-        URender();
+        URender(packet);
+        if (packet.replayEnded)
+            glfwSetWindowShouldClose(gWindow, true);
+
+        // the GPU time of an earlier frame sets the resolution of the next snapshot
+        float sceneMs;
+        if (gDynamicResolution && gSceneTimer.Latest(sceneMs))
+            gResolution.Update(sceneMs);
+
+        // upload whatever texture levels arrived, within this frame's budget
+        if (gOptions.streamTextures)
+        {
+            TextureStreamer& streamer = TextureStreamer::Instance();
+            streamer.Update();
+            gMaterials.Update();
+            if (!gTexturesSettled && streamer.Settled())
+            {
+                LOG(LOG_INFO, "Textures streamed in %.0f ms after the first frame, %.1f MB resident",
+                    (currentFrame - gFirstFrameTime) * 1000.0f, GpuResources::Instance().Total(GPU_TEXTURES) / (1024.0 * 1024.0));
+                gTexturesSettled = true;
+            }
+        }
+
+        // textures give up levels if the frame pushed GPU memory over the budget
+        GpuResources::Instance().EndFrame();
+
+        // while replaying, wait for the GPU so the frame time includes all of its work
+        if (gReplaying)
+        {
+            glFinish();
+            gFrameTimings.Add((float)(glfwGetTime() - currentFrame) * 1000.0f);
+            gReplayTriangles += gFrameStats.triangles;
+        }
+
+        // draw statistics, once per second
+        if (currentFrame - gStatsReportTime >= 1.0f)
+        {
+            LOG(LOG_INFO, "%u triangles in %u draws of %u objects per frame (egg LODs %d/%d), rendered at %dx%d, %.1f MB of GPU memory",
+                gFrameStats.triangles, gFrameStats.draws, gFrameStats.instances, packet.eggLods[0], packet.eggLods[1], packet.renderWidth,
+                packet.renderHeight, GpuResources::Instance().Total() / (1024.0 * 1024.0));
+            if (gOcclusion.Enabled())
+                LOG(LOG_INFO, "Occlusion: %u objects visible, %u culled, %u left to conditional rendering", gOcclusion.Visible,
+                    gOcclusion.Culled, gOcclusion.Pending);
+            gStatsReportTime = currentFrame;
+        }
 
+        gPipeline.Release();
         glfwPollEvents();
     }
+    gPipeline.Stop();
+
+    if (gReplaying)
+        UReportFrameTimings();
+    if (GLTraceWriter::Instance().IsCapturing())
+    {
+        LOG(LOG_INFO, "Captured %d frames to %s", GLTraceWriter::Instance().FramesCaptured(), gOptions.capturePath);
+        GLTraceWriter::Instance().Stop();
+    }
+    if (gRecorder.IsOpen())
+    {
+        LOG(LOG_INFO, "Recorded %d camera samples to %s", gRecorder.SampleCount(), gOptions.recordPath);
+        gRecorder.Close();
+    }
 
-    // Release mesh data
+    // Release mesh data (gWhiteMesh shares the yolk's buffers), once no BVH build still writes to a mesh
+    gMeshBvhBuilder.Stop();
     UDestroyMesh(gYolkMesh);
-    UDestroyMesh(gWhiteMesh);
     UDestroyMesh(gPlateMesh);
     UDestroyMesh(gMesh);
-
-    // Release texture
-    UDestroyTexture(gTextureYolk);
-    UDestroyTexture(gTextureWhite);
+    if (gAssetMesh.vao != 0)
+        UDestroyMesh(gAssetMesh);
+    GpuResources::Instance().Release(GPU_BUFFER, gInstanceBuffer);
+    gOcclusion.Destroy();
+
+    // Release textures and materials
+    gMaterials.Destroy();
+    if (gOptions.streamTextures)
+        TextureStreamer::Instance().Stop();
+
+    // Release the offscreen target
+    if (gDynamicResolution)
+    {
+        gRenderTarget.Destroy();
+        gSceneTimer.Destroy();
+        glDeleteVertexArrays(1, &gUpscaleVao);
+        UDestroyShaderProgram(gUpscaleProgramId);
+    }
+    if (gOptions.software)
+    {
+        gSoftRenderer.Stop();
+        gRenderTarget.Destroy();
+    }
 
     // Release shader program
     UDestroyShaderProgram(gProgramId);
     UDestroyShaderProgram(gLampProgramId);
 
+    // everything should be gone by now; whatever is left is reported and deleted
+    GpuResources::Instance().LogTotals();
+    GpuResources::Instance().ReleaseAll();
+
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 
@@ -305,6 +883,29 @@ int main(int argc, char* argv[])
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    if (gOptions.replayPath != nullptr)
+    {
+        if (!gReplayTrack.Load(gOptions.replayPath))
+        {
+            LOG(LOG_ERROR, "Failed to load camera recording %s", gOptions.replayPath);
+            return false;
+        }
+        gReplaying = true;
+        LOG(LOG_INFO, "Replaying %u camera samples (%.2f s) at a fixed step of %g s",
+            (unsigned)gReplayTrack.Samples.size(), gReplayTrack.Duration(), gOptions.replayStep);
+    }
+    else if (gOptions.recordPath != nullptr && !gRecorder.Open(gOptions.recordPath))
+    {
+        LOG(LOG_ERROR, "Failed to open %s for recording", gOptions.recordPath);
+        return false;
+    }
+
+#ifndef _WIN32
+    // the software benchmark compares against Mesa's CPU renderer, which this selects even where a GPU is present
+    if (gOptions.benchSoftware)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+#endif
+
     // GLFW: initialize and configure
     // ------------------------------
     glfwInit();
@@ -316,16 +917,29 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    // offscreen runs still need a context, just not a visible window
+    if (gOptions.offscreen || gOptions.glReplayPath != nullptr || gOptions.benchObjPath != nullptr || gOptions.benchVertexFormats
+        || gOptions.batchPath != nullptr || gOptions.benchSoftware || gOptions.benchScalingPath != nullptr || gOptions.benchPicking)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
     // GLFW: window creation
     // ---------------------
     * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
     if (*window == NULL)
     {
-        cout << "Failed to create GLFW window" << endl;
+        LOG(LOG_ERROR, "Failed to create GLFW window");
         glfwTerminate();
         return false;
     }
     glfwMakeContextCurrent(*window);
+    glfwGetFramebufferSize(*window, &gFramebufferWidth, &gFramebufferHeight);
+
+    // benchmark runs should not be capped by vsync
+    if (gReplaying || gOptions.offscreen || gOptions.glReplayPath != nullptr || gOptions.benchObjPath != nullptr
+        || gOptions.benchVertexFormats || gOptions.batchPath != nullptr || gOptions.benchSoftware || gOptions.benchScalingPath != nullptr
+        || gOptions.benchPicking)
+        glfwSwapInterval(0);
+
     glfwSetFramebufferSizeCallback(*window, UResizeWindow);
     glfwSetCursorPosCallback(*window, UMousePositionCallback);
     glfwSetScrollCallback(*window, UMouseScrollCallback);
@@ -340,100 +954,108 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+        LOG(LOG_ERROR, "Failed to initialize GLAD");
         return -1;
     }
 
     // Displays GPU OpenGL version
-    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+    LOG(LOG_INFO, "OpenGL Version: %s", (const char*)glGetString(GL_VERSION));
+
+    // capture has to start before any mesh, texture or shader is created
+    if (gOptions.capturePath != nullptr)
+    {
+        if (!GLTraceWriter::Instance().Start(gOptions.capturePath, gOptions.captureFrames))
+        {
+            LOG(LOG_ERROR, "Failed to open %s for GL capture", gOptions.capturePath);
+            return false;
+        }
+        LOG(LOG_INFO, "Capturing GL calls to %s", gOptions.capturePath);
+    }
 
     return true;
 }
 
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-void UProcessInput(GLFWwindow* window)
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly.
+// Runs on the main thread; what moves the camera or the scene goes into the snapshot for the update stage,
+// texture state changes right away since this is also the GL thread.
+void UProcessInput(GLFWwindow* window, InputSnapshot& input)
 {
     static const float cameraSpeed = 2.5f;
 
+    // per-frame timing
+    // --------------------
+    input = gPendingInput;
+    gPendingInput = InputSnapshot();
+    input.time = glfwGetTime();
+    input.deltaTime = input.time - gLastFrame;
+    gLastFrame = input.time;
+    input.framebufferWidth = gFramebufferWidth;
+    input.framebufferHeight = gFramebufferHeight;
+    input.resolutionScale = gDynamicResolution ? gResolution.Scale : 1.0f;
+
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(UP, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(DOWN, gDeltaTime);
+    // the recording owns the camera during replay
+    if (gReplaying)
+        return;
+
+    for (int i = 0; i < MOVE_KEY_COUNT; i++)
+        input.moving[i] = glfwGetKey(window, MOVE_KEYS[i].key) == GLFW_PRESS;
 
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && gTexWrapMode != GL_REPEAT)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureYolk);
-        glBindTexture(GL_TEXTURE_2D, gTextureWhite);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gMaterials.TextureArray);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
         gTexWrapMode = GL_REPEAT;
 
-        cout << "Current Texture Wrapping Mode: REPEAT" << endl;
+        LOG(LOG_INFO, "Current Texture Wrapping Mode: REPEAT");
     }
     else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && gTexWrapMode != GL_MIRRORED_REPEAT)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureYolk);
-        glBindTexture(GL_TEXTURE_2D, gTextureWhite);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gMaterials.TextureArray);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
         gTexWrapMode = GL_MIRRORED_REPEAT;
 
-        cout << "Current Texture Wrapping Mode: MIRRORED REPEAT" << endl;
+        LOG(LOG_INFO, "Current Texture Wrapping Mode: MIRRORED REPEAT");
     }
     else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_EDGE)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureYolk);
-        glBindTexture(GL_TEXTURE_2D, gTextureWhite);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gMaterials.TextureArray);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
         gTexWrapMode = GL_CLAMP_TO_EDGE;
 
-        cout << "Current Texture Wrapping Mode: CLAMP TO EDGE" << endl;
+        LOG(LOG_INFO, "Current Texture Wrapping Mode: CLAMP TO EDGE");
     }
     else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_BORDER)
     {
         float color[] = { 1.0f, 0.0f, 1.0f, 1.0f };
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, color);
 
-        glBindTexture(GL_TEXTURE_2D, gTextureYolk);
-        glBindTexture(GL_TEXTURE_2D, gTextureWhite);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gMaterials.TextureArray);
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, color);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
         gTexWrapMode = GL_CLAMP_TO_BORDER;
 
-        cout << "Current Texture Wrapping Mode: CLAMP TO BORDER" << endl;
+        LOG(LOG_INFO, "Current Texture Wrapping Mode: CLAMP TO BORDER");
     }
 
     if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
-    {
-        gUVScale += 0.1f;
-        cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
-    }
+        input.uvScaleStep = 1;
     else if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
-    {
-        gUVScale -= 0.1f;
-        cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
-    }
+        input.uvScaleStep = -1;
 }
 
 
@@ -442,12 +1064,17 @@ void UProcessInput(GLFWwindow* window)
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    gFramebufferWidth = width;
+    gFramebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
+    if (gReplaying)
+        return;
+
     if (gFirstMouse)
     {
         gLastX = xpos;
@@ -461,7 +1088,8 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
     gLastX = xpos;
     gLastY = ypos;
 
-    gCamera.ProcessMouseMovement(xoffset, yoffset);
+    gPendingInput.mouseX += xoffset;
+    gPendingInput.mouseY += yoffset;
 }
 
 
@@ -469,7 +1097,10 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    gCamera.ProcessMouseScroll(yoffset);
+    if (gReplaying)
+        return;
+
+    gPendingInput.scroll += yoffset;
 }
 
 // glfw: handle mouse button events
@@ -480,179 +1111,688 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
     {
     case GLFW_MOUSE_BUTTON_LEFT:
     {
-        if (action == GLFW_PRESS) {
-            cout << "Left mouse button pressed" << endl;
-            gCamera.ResetCamera();
+        // selects the object under the cursor
+        if (action == GLFW_PRESS && !gReplaying)
+        {
+            double x, y;
+            int width, height;
+            glfwGetCursorPos(window, &x, &y);
+            glfwGetWindowSize(window, &width, &height);
+            if (width > 0 && height > 0)
+            {
+                gPendingInput.pick = true;
+                gPendingInput.pickX = (float)(2.0 * x / width - 1.0);
+                gPendingInput.pickY = (float)(1.0 - 2.0 * y / height);
+            }
         }
-        else
-            cout << "Left mouse button released" << endl;
     }
     break;
 
     case GLFW_MOUSE_BUTTON_MIDDLE:
     {
-        if (action == GLFW_PRESS)
-            cout << "Middle mouse button pressed" << endl;
+        if (action == GLFW_PRESS) {
+            LOG(LOG_INFO, "Middle mouse button pressed");
+            if (!gReplaying)
+                gPendingInput.resetCamera = true;
+        }
         else
-            cout << "Middle mouse button released" << endl;
+            LOG(LOG_INFO, "Middle mouse button released");
     }
     break;
 
     case GLFW_MOUSE_BUTTON_RIGHT:
     {
         if (action == GLFW_PRESS)
-            cout << "Right mouse button pressed" << endl;
+            LOG(LOG_INFO, "Right mouse button pressed");
         else
-            cout << "Right mouse button released" << endl;
+            LOG(LOG_INFO, "Right mouse button released");
     }
     break;
 
     default:
-        cout << "Unhandled mouse button event" << endl;
+        LOG(LOG_DEBUG, "Unhandled mouse button event");
         break;
     }
 }
 
 
-// Functioned called to render a frame
-void URender()
+// Update stage of a frame: applies the input to the camera, places the objects and builds the draw list.
+// Runs on the update thread (or inline with --frame-latency 0) and owns gCamera, gUVScale, the LOD states
+// and the camera recording; it must not touch GL.
+void UUpdateFrame(const InputSnapshot& input, FramePacket& packet)
 {
-    const int nrows = 10;
-    const int ncols = 10;
-    const int nlevels = 10;
-
-    const float xsize = 10.0f;
-    const float ysize = 10.0f;
-    const float zsize = 10.0f;
+    gDeltaTime = input.deltaTime;
+    packet.time = input.time;
+    packet.replayEnded = false;
+
+    // replay overrides the camera with the recorded path; recording saves it
+    if (gReplaying)
+        packet.replayEnded = !UReplayCameraFrame();
+    else
+    {
+        for (int i = 0; i < MOVE_KEY_COUNT; i++)
+        {
+            if (input.moving[i])
+                gCamera.ProcessKeyboard(MOVE_KEYS[i].direction, gDeltaTime);
+        }
+        if (input.mouseX != 0.0f || input.mouseY != 0.0f)
+            gCamera.ProcessMouseMovement(input.mouseX, input.mouseY);
+        if (input.scroll != 0.0f)
+            gCamera.ProcessMouseScroll(input.scroll);
+        if (input.resetCamera)
+            gCamera.ResetCamera();
 
-    // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+        if (input.uvScaleStep != 0)
+        {
+            gUVScale += 0.1f * input.uvScaleStep;
+            LOG(LOG_INFO, "Current scale (%g, %g)", gUVScale[0], gUVScale[1]);
+        }
 
-    // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (gRecorder.IsOpen())
+            URecordCameraFrame(input.time);
+    }
 
-    // 1. Scales the object by 2
-    glm::mat4 scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    glm::mat4 rotation = glm::rotate(120.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    // 3. Place object at the origin
-    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = translation * rotation * scale;
+    UBuildFramePacket(packet, input.framebufferWidth, input.framebufferHeight, input.resolutionScale);
+    if (input.pick)
+        UPickAtCursor(packet, input.pickX, input.pickY);
+    packet.selectedObject = gSelectedObject;
+}
 
-    // Transforms the camera: move the camera back (z axis)
-    glm::mat4 view = glm::translate(glm::vec3(0.0f, 0.0f, -5.0f));
 
-    // Creates a perspective projection
-    glm::mat4 projection = glm::perspective(45.0f, (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+// Places the objects as seen from gCamera and builds the draw list of a frame of the given size
+void UBuildFramePacket(FramePacket& packet, int framebufferWidth, int framebufferHeight, float resolutionScale)
+{
+    // Transforms the camera: view from the (possibly replayed) camera
+    packet.view = gCamera.GetViewMatrix();
+
+    // Creates a perspective projection with the aspect ratio of the real framebuffer (a minimized window has none)
+    packet.framebufferWidth = framebufferWidth;
+    packet.framebufferHeight = framebufferHeight;
+    packet.renderWidth = glm::max((int)(framebufferWidth * resolutionScale + 0.5f), 1);
+    packet.renderHeight = glm::max((int)(framebufferHeight * resolutionScale + 0.5f), 1);
+    float aspect = framebufferHeight > 0 ? (GLfloat)framebufferWidth / (GLfloat)framebufferHeight : 1.0f;
+    packet.projection = UProjectionMatrix(aspect);
+    packet.cameraPosition = gCamera.Position;
+    packet.uvScale = gUVScale;
+    packet.draws.clear();
+
+    // lights: the lamp, or those of the generated scene
+    if (gStressLights.empty())
+    {
+        packet.lightCount = 1;
+        packet.lightPositions[0] = gLightPosition;
+        packet.lightColors[0] = gLightColor;
+    }
+    else
+    {
+        packet.lightCount = glm::min((int)gStressLights.size(), MAX_LIGHTS);
+        for (int l = 0; l < packet.lightCount; l++)
+        {
+            packet.lightPositions[l] = gStressLights[l].Position;
+            packet.lightColors[l] = gStressLights[l].Color;
+        }
+    }
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // the generated scene replaces the egg
+    if (!gStressObjects.empty())
+    {
+        for (size_t i = 0; i < gStressObjects.size(); i++)
+        {
+            const StressObject& object = gStressObjects[i];
+            UAddDraw(packet, UStressMesh(object.Kind), object.Model, object.Material, gStressLods[i], STRESS_KIND_NAMES[object.Kind]);
+        }
+    }
+    else
+    {
+        // 1. Scales the object by 2
+        glm::mat4 scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
+        // 2. Rotates shape by 15 degrees in the x axis
+        glm::mat4 rotation = glm::rotate(120.0f, glm::vec3(1.0, 1.0f, 1.0f));
+        // 3. Place object at the origin
+        glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
+        // Model matrix: transformations are applied right-to-left order
+        glm::mat4 model = translation * rotation * scale;
+
+        // the yolk mesh shows the white texture and the other way around
+        UAddDraw(packet, gYolkMesh, model, gMaterialWhite, gYolkLod, "yolk");
+
+        scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
+        translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.2f));
+        model = translation * rotation * scale;
+        UAddDraw(packet, gWhiteMesh, model, gMaterialYolk, gWhiteLod, "egg white");
+
+        scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
+        translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
+        model = translation * rotation * scale;
+        UAddDraw(packet, gPlateMesh, model, gMaterialYolk, gPlateLod, "plate");
+
+        // Loaded mesh (if any), placed beside the plate
+        if (gAssetMesh.vao != 0)
+            UAddDraw(packet, gAssetMesh, gAssetModel, gMaterialWhite, gAssetLod, gOptions.meshPath);
+    }
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
+    // runs of the same mesh and level of detail become one instanced draw, whatever their materials
+    std::sort(packet.draws.begin(), packet.draws.end(), [](const DrawItem& a, const DrawItem& b)
+        { return a.mesh->vao != b.mesh->vao ? a.mesh->vao < b.mesh->vao : a.lod < b.lod; });
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    packet.eggLods[0] = gYolkLod.Current;
+    packet.eggLods[1] = gWhiteLod.Current;
 
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-    
+    // the objects just placed become what the next pick sees
+    UUpdateSceneBvh();
+}
 
-    // Pass color, light, and camera data to the Shader program's corresponding uniforms
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
 
+// Perspective projection of the scene; large generated scenes push the far plane out so the whole orbit stays in view
+glm::mat4 UProjectionMatrix(float aspect)
+{
+    float farPlane = gStressObjects.empty() ? 100.0f : glm::max(100.0f, StressSceneRadius(gStressDesc) * 4.0f);
+    return glm::perspective(45.0f, aspect, 0.1f, farPlane);
+}
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gYolkMesh.vao);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureWhite);
+// Generates the stress scene (replacing any earlier one) with the current seed and the random materials
+void UCreateStressScene(int tables, int plates, int items, int lights)
+{
+    gStressDesc.Tables = tables;
+    gStressDesc.Plates = plates;
+    gStressDesc.Items = items;
+    gStressDesc.Lights = lights;
+    gStressDesc.Seed = gOptions.seed;
+    gStressDesc.FirstMaterial = gStressFirstMaterial;
+    gStressDesc.MaterialCount = gMaterials.Count() - gStressFirstMaterial;
+    StressGenerate(gStressDesc, gStressObjects, gStressLights);
+    gStressLods.assign(gStressObjects.size(), LodState());
+    LOG(LOG_INFO, "Stress scene: %d tables x %d plates x %d items, %u objects, %d lights (seed %u)", tables, plates, items,
+        (unsigned)gStressObjects.size(), lights, gStressDesc.Seed);
+}
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, gYolkMesh.nIndices, GL_UNSIGNED_SHORT, NULL); // Draws the triangle
-   
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gWhiteMesh.vao);
+// The mesh each kind of generated object is drawn with
+const GLMesh& UStressMesh(StressKind kind)
+{
+    switch (kind)
+    {
+    case STRESS_TABLE:
+        return gPlateMesh;
+    case STRESS_TOAST:
+        return gMesh;
+    case STRESS_EGG_WHITE:
+        return gWhiteMesh;
+    default:
+        return gYolkMesh;
+    }
+}
 
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.2f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// Places an object in the scene (where picking finds it under name) and adds it to the draw list unless
+// it is outside the view, picking its level of detail and telling the texture streamer how large it is on screen
+void UAddDraw(FramePacket& packet, const GLMesh& mesh, const glm::mat4& model, int material, LodState& lod, const char* name)
+{
+    int object = UPlaceObject(mesh, model, name);
+    glm::mat4 modelView = packet.view * model;
+    if (!USphereVisible(packet.projection * modelView, mesh))
+        return;
+
+    DrawItem item;
+    item.mesh = &mesh;
+    item.model = model;
+    item.material = material;
+    item.object = object;
+    float pixels;
+    item.lod = USelectMeshLod(mesh, modelView, packet.projection, (float)packet.renderHeight, lod, pixels);
+
+    // the material's own repeats divide the texels each repeat needs further
+    const Material& surface = gMaterials.Get(material);
+    URequestTexture(gMaterials.LayerStream(surface.Layer), pixels / glm::max(surface.UVScale.x, surface.UVScale.y));
+    packet.draws.push_back(item);
+}
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureYolk);
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, gWhiteMesh.nIndices, GL_UNSIGNED_SHORT, NULL);
+// Records the next object of this frame in gSceneObjects and returns its index; an object that moved
+// since the last frame is queued for the refit
+int UPlaceObject(const GLMesh& mesh, const glm::mat4& model, const char* name)
+{
+    size_t index = gScenePlaced++;
+    if (index >= gSceneObjects.size())
+    {
+        gSceneObjects.push_back(SceneObject());
+        gSceneRebuild = true;
+    }
+    SceneObject& object = gSceneObjects[index];
+    object.name = name;
+    if (gSceneRebuild || object.mesh != &mesh || memcmp(&object.model, &model, sizeof(model)) != 0)
+    {
+        object.mesh = &mesh;
+        object.model = model;
+        object.inverse = glm::inverse(model);
+        if (!gSceneRebuild)
+            gSceneChanged.push_back((uint32_t)index);
+    }
+    return (int)index;
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gPlateMesh.vao);
+// Brings gSceneBvh up to date with the objects placed this frame: a refit of the boxes that moved, or a
+// new build when objects came or went (which also drops the selection) or refits wore the tree down
+void UUpdateSceneBvh()
+{
+    if (gScenePlaced != gSceneObjects.size())
+    {
+        gSceneObjects.resize(gScenePlaced);
+        gSceneRebuild = true;
+    }
 
-    scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    auto worldBounds = [](const SceneObject& object) { return BvhTransformBounds(object.model, UMeshBounds(*object.mesh)); };
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    if (gSceneRebuild)
+    {
+        gSceneBounds.resize(gSceneObjects.size());
+        for (size_t i = 0; i < gSceneObjects.size(); i++)
+            gSceneBounds[i] = worldBounds(gSceneObjects[i]);
+        gSceneBvh.Build(gSceneBounds);
+        gSelectedObject = -1;
+    }
+    else if (!gSceneChanged.empty())
+    {
+        for (size_t i = 0; i < gSceneChanged.size(); i++)
+            gSceneBounds[gSceneChanged[i]] = worldBounds(gSceneObjects[gSceneChanged[i]]);
+        gSceneBvh.Refit(gSceneBounds, gSceneChanged);
+        if (gSceneBvh.NeedsRebuild())
+            gSceneBvh.Build(gSceneBounds);
+    }
+    gSceneChanged.clear();
+    gScenePlaced = 0;
+    gSceneRebuild = false;
+}
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES,0, gPlateMesh.nIndices);
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+// Object space box of a mesh
+BvhBounds UMeshBounds(const GLMesh& mesh)
+{
+    BvhBounds bounds;
+    bounds.Grow(mesh.boundsMin);
+    bounds.Grow(mesh.boundsMax);
+    return bounds;
+}
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
 
-    // LAMP: draw lamp
-    //----------------
+// Nearest object the world space ray hits before t: its index (or -1), with t and triangle receiving the
+// distance and the triangle's index in the mesh's finest level. The ray goes into each candidate's object
+// space, where the direction is transformed along with it so t means the same in both.
+int UPickObject(const BvhRay& ray, float& t, uint32_t& triangle)
+{
+    int found = -1;
+    gSceneBvh.Intersect(ray, t, [&](uint32_t index, float& tMax)
+    {
+        const SceneObject& object = gSceneObjects[index];
+        BvhRay local(glm::vec3(object.inverse * glm::vec4(ray.Origin, 1.0f)), glm::vec3(object.inverse * glm::vec4(ray.Direction, 0.0f)));
+        std::shared_ptr<MeshBvh> bvh = UMeshBvh(*object.mesh);
+        if (bvh)
+        {
+            if (!bvh->Intersect(local, tMax, triangle))
+                return false;
+        }
+        else
+        {
+            // the mesh file's BVH is still being built: its box stands in
+            float hit = BvhRayBox(local, object.mesh->boundsMin, object.mesh->boundsMax, tMax);
+            if (hit >= tMax)
+                return false;
+            tMax = hit;
+            triangle = PICK_BOX_HIT;
+        }
+        found = (int)index;
+        return true;
+    });
+    return found;
+}
+
+
+// World space ray through a point of the window, given in normalized device coordinates, as the packet
+// sees the scene: from the near plane at t = 0 to the far plane at t = 1
+BvhRay UCursorRay(const FramePacket& packet, float x, float y)
+{
+    glm::mat4 inverse = glm::inverse(packet.projection * packet.view);
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    return BvhRay(origin, glm::vec3(farPoint) / farPoint.w - origin);
+}
+
+
+// Selects the object under a point of the window (normalized device coordinates); a click on nothing
+// clears the selection
+void UPickAtCursor(const FramePacket& packet, float x, float y)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BvhRay ray = UCursorRay(packet, x, y);
+    float t = 1.0f;
+    uint32_t triangle = 0;
+    gSelectedObject = UPickObject(ray, t, triangle);
+
+    float microseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (gSelectedObject >= 0 && triangle == PICK_BOX_HIT)
+        LOG(LOG_INFO, "Picked %s (object %d of %u, bounding box) at %.2f units in %.1f us", gSceneObjects[gSelectedObject].name,
+            gSelectedObject, (unsigned)gSceneObjects.size(), t * glm::length(ray.Direction), microseconds);
+    else if (gSelectedObject >= 0)
+        LOG(LOG_INFO, "Picked %s (object %d of %u, triangle %u) at %.2f units in %.1f us", gSceneObjects[gSelectedObject].name,
+            gSelectedObject, (unsigned)gSceneObjects.size(), triangle, t * glm::length(ray.Direction), microseconds);
+    else
+        LOG(LOG_INFO, "Picked nothing (%.1f us)", microseconds);
+}
+
+
+// Functioned called to render a frame: submits a packet built by the update stage
+void URender(const FramePacket& packet)
+{
+    const int nrows = 10;
+    const int ncols = 10;
+    const int nlevels = 10;
+
+    const float xsize = 10.0f;
+    const float ysize = 10.0f;
+    const float zsize = 10.0f;
+
+    // with dynamic resolution the scene goes into the lower left corner of the offscreen target
+    bool offscreen = gDynamicResolution && packet.framebufferWidth > 0 && packet.framebufferHeight > 0
+        && gRenderTarget.Resize(packet.framebufferWidth, packet.framebufferHeight);
+    if (offscreen)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, gRenderTarget.Framebuffer);
+        glViewport(0, 0, packet.renderWidth, packet.renderHeight);
+        gSceneTimer.Begin();
+    }
+
+    // software rendering draws on the CPU, GL only shows the image
+    if (gOptions.software)
+    {
+        USoftwareRenderScene(packet);
+        USoftwarePresent(packet);
+    }
+    else
+        URenderScene(packet);
+
+    if (offscreen)
+    {
+        gSceneTimer.End();
+        UUpscale(packet);
+    }
+
+    // end of the frame for the GL capture (if one is running)
+    GLTraceWriter::Instance().EndFrame();
+
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+}
+
+
+// Draws the scene of a packet into the bound framebuffer and viewport
+void URenderScene(const FramePacket& packet)
+{
+    // Enable z-depth
+    glEnable(GL_DEPTH_TEST);
+
+    // Clear the frame and z buffers
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // start counting what this frame submits
+    gFrameStats = FrameStats();
+
+    // Set the shader to be used
+    glUseProgram(gProgramId);
+
+    // Retrieves and passes transform matrices to the Shader program
+    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
+    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
+
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(packet.view));
+    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(packet.projection));
+
+    // Reference matrix uniforms from the Cube Shader program for the light colors, light positions, and camera position
+    GLint lightCountLoc = glGetUniformLocation(gProgramId, "lightCount");
+    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColors");
+    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPositions");
+    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
+    
+
+    // Pass light and camera data to the Shader program's corresponding uniforms
+    glUniform1i(lightCountLoc, packet.lightCount);
+    glUniform3fv(lightColorLoc, packet.lightCount, glm::value_ptr(packet.lightColors[0]));
+    glUniform3fv(lightPositionLoc, packet.lightCount, glm::value_ptr(packet.lightPositions[0]));
+    const glm::vec3 cameraPosition = packet.cameraPosition;
+    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    
+    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
+    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(packet.uvScale));
+
+    // bind every texture and material once for the whole frame
+    gMaterials.Bind(0);
+
+    // what last frame's occlusion tests say about each draw; without culling everything is visible
+    gDrawStates.assign(packet.draws.size(), OCCLUSION_VISIBLE);
+    if (gOcclusion.Enabled())
+    {
+        gOcclusion.BeginFrame();
+        for (size_t i = 0; i < packet.draws.size(); i++)
+            gDrawStates[i] = gOcclusion.State((uint32_t)packet.draws[i].object);
+    }
+
+    // per-instance data of the draw list, which the update stage sorted by mesh and level. Within each run
+    // of the same mesh and level the visible objects come first and the pending ones after them; hidden
+    // objects are left out.
+    gInstances.clear();
+    gInstanceObjects.clear();
+    for (size_t first = 0; first < packet.draws.size();)
+    {
+        size_t end = first + 1;
+        while (end < packet.draws.size() && packet.draws[end].mesh->vao == packet.draws[first].mesh->vao
+            && packet.draws[end].lod == packet.draws[first].lod)
+            end++;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (size_t d = first; d < end; d++)
+            {
+                if (gDrawStates[d] != (pass == 0 ? OCCLUSION_VISIBLE : OCCLUSION_PENDING))
+                    continue;
+                InstanceData instance;
+                instance.model = packet.draws[d].model;
+                instance.material = packet.draws[d].material;
+                instance.highlight = packet.draws[d].object == packet.selectedObject ? 1 : 0;
+                gInstances.push_back(instance);
+                gInstanceObjects.push_back(packet.draws[d].object);
+            }
+        }
+        first = end;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+    GpuResources::Instance().BufferData(GL_ARRAY_BUFFER, gInstanceBuffer, gInstances.size() * sizeof(InstanceData), gInstances.data(),
+        GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // one instanced draw per run of the same mesh and level of detail, then one draw per pending object
+    // that the GPU skips if last frame's query found its box hidden
+    size_t instance = 0;
+    for (size_t first = 0; first < packet.draws.size();)
+    {
+        const DrawItem& item = packet.draws[first];
+        size_t end = first + 1;
+        GLsizei visible = gDrawStates[first] == OCCLUSION_VISIBLE, pending = gDrawStates[first] == OCCLUSION_PENDING;
+        while (end < packet.draws.size() && packet.draws[end].mesh->vao == item.mesh->vao && packet.draws[end].lod == item.lod)
+        {
+            visible += gDrawStates[end] == OCCLUSION_VISIBLE;
+            pending += gDrawStates[end] == OCCLUSION_PENDING;
+            end++;
+        }
+        first = end;
+        if (visible + pending == 0)
+            continue;
+
+        // Activate the VBOs contained within the mesh's VAO
+        glBindVertexArray(item.mesh->vao);
+        USetMeshUniforms(gProgramId, *item.mesh);
+
+        // Draws the triangles
+        if (visible > 0)
+            UDrawMesh(*item.mesh, item.lod, (GLuint)instance, visible);
+        instance += visible;
+        for (GLsizei p = 0; p < pending; p++, instance++)
+        {
+            gOcclusion.BeginConditional((uint32_t)gInstanceObjects[instance]);
+            UDrawMesh(*item.mesh, item.lod, (GLuint)instance, 1);
+            gOcclusion.EndConditional();
+        }
+
+        // Deactivate the Vertex Array Object
+        glBindVertexArray(0);
+    }
+
+    // Draws the triangles
+    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
+
+    // LAMP: draw lamp
+    //----------------
     glUseProgram(gLampProgramId);
 
     //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
+    glm::mat4 model = glm::translate(gLightPosition) * glm::scale(gLightScale);
 
     // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
+    GLint modelLoc = glGetUniformLocation(gLampProgramId, "model");
     viewLoc = glGetUniformLocation(gLampProgramId, "view");
     projLoc = glGetUniformLocation(gLampProgramId, "projection");
 
     // Pass matrix data to the Lamp Shader program's matrix uniforms
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(packet.view));
+    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(packet.projection));
 
     // Deactivate the Vertex Array Object
     glBindVertexArray(0);
 
+    // with the depth of this frame complete, find out what the next one can skip
+    if (gOcclusion.Enabled())
+        UTestOcclusion(packet);
+}
 
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+// Queries the bounding box of every object in view against the depth buffer, for the next frame's draws.
+// Objects whose box reaches the near plane are not tested (and so are drawn next frame), since the
+// clipped box could be hidden behind something the object itself is in front of.
+void UTestOcclusion(const FramePacket& packet)
+{
+    const float nearMargin = 0.2f;      // twice the near plane distance of the projection
+    gOcclusion.BeginTests(packet.view, packet.projection);
+    for (size_t i = 0; i < packet.draws.size(); i++)
+    {
+        const DrawItem& item = packet.draws[i];
+        BvhBounds local = UMeshBounds(*item.mesh);
+        BvhBounds world = BvhTransformBounds(item.model, local);
+        bool reachesCamera = true;
+        for (int axis = 0; axis < 3; axis++)
+            reachesCamera &= packet.cameraPosition[axis] > world.Min[axis] - nearMargin
+                && packet.cameraPosition[axis] < world.Max[axis] + nearMargin;
+        if (reachesCamera)
+            continue;
+
+        // grown a little, so faces lying on the object's own surface are not lost to depth precision
+        glm::vec3 extent = local.Max - local.Min;
+        extent += glm::max(extent.x, glm::max(extent.y, extent.z)) * 0.01f;
+        gOcclusion.Test((uint32_t)item.object, item.model * glm::translate(local.Center()) * glm::scale(extent));
+    }
+    gOcclusion.EndTests();
+}
+
+// Draws the scene rendered at packet.renderWidth x renderHeight into the window at full size
+void UUpscale(const FramePacket& packet)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, packet.framebufferWidth, packet.framebufferHeight);
+    glDisable(GL_DEPTH_TEST);
+
+    glm::vec2 texelSize(1.0f / gRenderTarget.Width, 1.0f / gRenderTarget.Height);
+    glm::vec2 sourceScale(packet.renderWidth * texelSize.x, packet.renderHeight * texelSize.y);
+    glm::vec2 sourceMax = sourceScale - texelSize * 0.5f;
+    // at full size there is nothing to reconstruct
+    float sharpness = packet.renderWidth < packet.framebufferWidth ? gOptions.sharpen : 0.0f;
+
+    glUseProgram(gUpscaleProgramId);
+    glUniform1i(glGetUniformLocation(gUpscaleProgramId, "sourceImage"), 0);
+    glUniform2fv(glGetUniformLocation(gUpscaleProgramId, "sourceScale"), 1, glm::value_ptr(sourceScale));
+    glUniform2fv(glGetUniformLocation(gUpscaleProgramId, "texelSize"), 1, glm::value_ptr(texelSize));
+    glUniform2fv(glGetUniformLocation(gUpscaleProgramId, "sourceMax"), 1, glm::value_ptr(sourceMax));
+    glUniform1f(glGetUniformLocation(gUpscaleProgramId, "sharpness"), sharpness);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gRenderTarget.Color);
+    glBindVertexArray(gUpscaleVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+// Rasterizes the scene of a packet on the CPU at packet.renderWidth x renderHeight, with the same
+// lighting uniforms URenderScene passes, and counts what was drawn like the GL path does
+void USoftwareRenderScene(const FramePacket& packet)
+{
+    SoftFrame frame;
+    frame.View = packet.view;
+    frame.Projection = packet.projection;
+    frame.CameraPosition = packet.cameraPosition;
+    frame.LightCount = packet.lightCount;
+    for (int l = 0; l < packet.lightCount; l++)
+    {
+        frame.LightPositions[l] = packet.lightPositions[l];
+        frame.LightColors[l] = packet.lightColors[l];
+    }
+    frame.UVScale = packet.uvScale;
+
+    gFrameStats = FrameStats();
+    gSoftDraws.clear();
+    for (size_t i = 0; i < packet.draws.size(); i++)
+    {
+        const DrawItem& item = packet.draws[i];
+        SoftDraw draw;
+        draw.Mesh = item.mesh->cpu.get();
+        draw.Model = item.model;
+        draw.Material = item.material;
+        draw.FirstIndex = item.mesh->lods[item.lod].FirstIndex;
+        draw.IndexCount = item.mesh->lods[item.lod].IndexCount;
+        draw.Highlight = item.object == packet.selectedObject;
+        gSoftDraws.push_back(draw);
+
+        gFrameStats.triangles += draw.IndexCount / 3;
+        gFrameStats.draws++;
+        gFrameStats.instances++;
+    }
+
+    gSoftRenderer.Resize(packet.renderWidth, packet.renderHeight);
+    gSoftRenderer.Render(frame, gSoftDraws);
+}
+
+
+// Shows the software image: uploads it into the color texture of gRenderTarget and blits that into the window
+void USoftwarePresent(const FramePacket& packet)
+{
+    int width = gSoftRenderer.Width(), height = gSoftRenderer.Height();
+    if (!gRenderTarget.Resize(width, height))
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, gRenderTarget.Color);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, gSoftRenderer.Pitch());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, gSoftRenderer.Pixels());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gRenderTarget.Framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, packet.framebufferWidth, packet.framebufferHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+
 // Implements the UCreateMesh function
 void UCreateMesh(GLMesh& mesh)
 {
@@ -675,73 +1815,52 @@ void UCreateMesh(GLMesh& mesh)
         4, 2, 3   // Bottom Back Left 
     };
 
-    // total float values per each type
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    // store vertex and index count
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nIndices = sizeof(indices) / (sizeof(indices[0]));
-
-    // Create VAO
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);  //activates the VAO
-
-    // Create VBOs
-    glGenBuffers(2, mesh.vbos);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the vertex buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // total float values per vertex (position, normal, uv)
+    const int floatsPerVertex = 8;
+    const int numVertices = sizeof(verts) / (sizeof(verts[0]) * floatsPerVertex);
 
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-    glEnableVertexAttribArray(0);
+    MeshData data;
+    for (int i = 0; i < numVertices; i++)
+    {
+        const GLfloat* vertex = verts + i * floatsPerVertex;
+        data.Positions.push_back(glm::vec3(vertex[0], vertex[1], vertex[2]));
+        data.Normals.push_back(glm::vec3(vertex[3], vertex[4], vertex[5]));
+        data.UVs.push_back(glm::vec2(vertex[6], vertex[7]));
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(floatsPerVertex));
-    glEnableVertexAttribArray(1);
+        // the table above has no normals; pointing them away from the middle lets the pyramid be lit
+        data.Normals.back() = glm::normalize(data.Positions.back() - glm::vec3(0.0f, -0.25f, 0.0f));
+    }
+    data.Indices.assign(indices, indices + sizeof(indices) / sizeof(indices[0]));
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(floatsPerVertex + floatsPerNormal));
-    glEnableVertexAttribArray(2);
+    UOptimizeMesh(data, "pyramid");
+    UUploadMesh(data, mesh, gOptions.vertexFormat);
+    UBuildMeshBvh(data, mesh);
 }
 
-// creates a prism based on the number of side turned in; assumes a stride of seven
-void UCreatePrismMesh(GLfloat verts[], GLushort indices[], int numSides, float radius, float halfLen)
+// creates a prism based on the number of side turned in; the normals carry the colors of the old
+// position + color layout (red centers, green top edge, blue bottom edge) so shading is unchanged
+void UCreatePrismMesh(MeshData& data, int numSides, float radius, float halfLen)
 {
     // create constant for 2PI used in calculations
     const float TWO_PI = 2.0f * 3.1415926f;
     const float radiansPerSide = TWO_PI / numSides;
 
-    // value to increment after each vertex is created
-    int currentVertex = 0;
+    data.Positions.clear();
+    data.Normals.clear();
+    data.UVs.clear();
+    data.Indices.clear();
+    data.Positions.reserve(2 + 2 * numSides);
+    data.Normals.reserve(2 + 2 * numSides);
+    data.Indices.reserve(12 * numSides);
 
     // in this  algorithm, vertex zero is the top center vertex, and vertex one is the bottom center
-    // each is offset by the step size
-    verts[0] = 0.0f;    // 0 x
-    verts[1] = halfLen; // 0 y
-    verts[2] = 0.0f;    // 0 z
-    verts[3] = 1.0f;    // 0 r
-    verts[4] = 0.0f;    // 0 g
-    verts[5] = 0.0f;    // 0 b
-    verts[6] = 1.0f;    // 0 a
-    currentVertex++;
-
-    verts[7] = 0.0f;    // 1 x
-    verts[8] = -halfLen;// 1 y
-    verts[9] = 0.0f;    // 1 z
-    verts[10] = 1.0f;   // 1 r
-    verts[11] = 0.0f;   // 1 g
-    verts[12] = 0.0f;   // 1 b
-    verts[13] = 1.0f;   // 1 a
-    currentVertex++;
-
-    // variable to keep track of every triangle added to indices
-    int currentTriangle = 0;
+    data.Positions.push_back(glm::vec3(0.0f, halfLen, 0.0f));
+    data.Normals.push_back(glm::vec3(1.0f, 0.0f, 0.0f));
+    data.Positions.push_back(glm::vec3(0.0f, -halfLen, 0.0f));
+    data.Normals.push_back(glm::vec3(1.0f, 0.0f, 0.0f));
+
+    // value to increment after each vertex is created
+    GLuint currentVertex = 2;
 
     // note: the number of flat sides is equal to the number of edge on the sides
     for (int edge = 0; edge < numSides; edge++)
@@ -750,52 +1869,37 @@ void UCreatePrismMesh(GLfloat verts[], GLushort indices[], int numSides, float r
         float theta = ((float)edge) * radiansPerSide;
 
         // top triangle first perimeter vertex
-        verts[currentVertex * STRIDE + 0] = radius * cos(theta);    // x
-        verts[currentVertex * STRIDE + 1] = halfLen;                // y
-        verts[currentVertex * STRIDE + 2] = radius * sin(theta);    // z
-        verts[currentVertex * STRIDE + 3] = 0.0f;                   // r
-        verts[currentVertex * STRIDE + 4] = 1.0f;                   // g
-        verts[currentVertex * STRIDE + 5] = 0.0f;                   // b
-        verts[currentVertex * STRIDE + 6] = 1.0f;                   // a
+        data.Positions.push_back(glm::vec3(radius * cos(theta), halfLen, radius * sin(theta)));
+        data.Normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
         currentVertex++;
 
         // bottom triangle first perimeter vertex
-        verts[currentVertex * STRIDE + 0] = radius * cos(theta);    // x
-        verts[currentVertex * STRIDE + 1] = -halfLen;               // y
-        verts[currentVertex * STRIDE + 2] = radius * sin(theta);    // z
-        verts[currentVertex * STRIDE + 3] = 0.0f;                   // r
-        verts[currentVertex * STRIDE + 4] = 0.0f;                   // g
-        verts[currentVertex * STRIDE + 5] = 1.0f;                   // b
-        verts[currentVertex * STRIDE + 6] = 1.0f;                   // a
+        data.Positions.push_back(glm::vec3(radius * cos(theta), -halfLen, radius * sin(theta)));
+        data.Normals.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
         currentVertex++;
 
         if (edge > 0)
         {
             // now to create the indices for the triangles
             // top triangle
-            indices[(3 * currentTriangle) + 0] = 0;                 // center of top of prism
-            indices[(3 * currentTriangle) + 1] = currentVertex - 4; // upper left vertex of side
-            indices[(3 * currentTriangle) + 2] = currentVertex - 2; // upper right vertex of side
-            currentTriangle++;
+            data.Indices.push_back(0);                  // center of top of prism
+            data.Indices.push_back(currentVertex - 4);  // upper left vertex of side
+            data.Indices.push_back(currentVertex - 2);  // upper right vertex of side
 
             // bottom triangle
-            indices[(3 * currentTriangle) + 0] = 1;                 // center of bottom of prism
-            indices[(3 * currentTriangle) + 1] = currentVertex - 3; // bottom left vertex of side
-            indices[(3 * currentTriangle) + 2] = currentVertex - 1; // bottom right vertex of side
-            currentTriangle++;
+            data.Indices.push_back(1);                  // center of bottom of prism
+            data.Indices.push_back(currentVertex - 3);  // bottom left vertex of side
+            data.Indices.push_back(currentVertex - 1);  // bottom right vertex of side
 
             // triangle for 1/2 retangular side
-            indices[(3 * currentTriangle) + 0] = currentVertex - 4; // upper left vertex of side
-            indices[(3 * currentTriangle) + 1] = currentVertex - 3; // bottom left vertex of side
-            indices[(3 * currentTriangle) + 2] = currentVertex - 1; // bottom right vertex of side
-            currentTriangle++;
+            data.Indices.push_back(currentVertex - 4);  // upper left vertex of side
+            data.Indices.push_back(currentVertex - 3);  // bottom left vertex of side
+            data.Indices.push_back(currentVertex - 1);  // bottom right vertex of side
 
             // triangle for second 1/2 retangular side
-            indices[(3 * currentTriangle) + 0] = currentVertex - 1; // bottom right vertex of side
-            indices[(3 * currentTriangle) + 1] = currentVertex - 2; // upper right vertex of side
-            indices[(3 * currentTriangle) + 2] = currentVertex - 4; // upper left vertex of side
-            currentTriangle++;
-
+            data.Indices.push_back(currentVertex - 1);  // bottom right vertex of side
+            data.Indices.push_back(currentVertex - 2);  // upper right vertex of side
+            data.Indices.push_back(currentVertex - 4);  // upper left vertex of side
         }
 
     }
@@ -803,28 +1907,24 @@ void UCreatePrismMesh(GLfloat verts[], GLushort indices[], int numSides, float r
     // now, just need to wire up the last side
     // now to create the indices for the triangles
     // top triangle
-    indices[(3 * currentTriangle) + 0] = 0;                 // center of top of prism
-    indices[(3 * currentTriangle) + 1] = currentVertex - 2; // upper left vertex of side
-    indices[(3 * currentTriangle) + 2] = 2;                 // first upper left vertex created, now right
-    currentTriangle++;
+    data.Indices.push_back(0);                  // center of top of prism
+    data.Indices.push_back(currentVertex - 2);  // upper left vertex of side
+    data.Indices.push_back(2);                  // first upper left vertex created, now right
 
     // bottom triangle
-    indices[(3 * currentTriangle) + 0] = 1;                 // center of bottom of prism
-    indices[(3 * currentTriangle) + 1] = currentVertex - 1; // bottom left vertex of side
-    indices[(3 * currentTriangle) + 2] = 3;                 // first bottom left vertex created, now right
-    currentTriangle++;
+    data.Indices.push_back(1);                  // center of bottom of prism
+    data.Indices.push_back(currentVertex - 1);  // bottom left vertex of side
+    data.Indices.push_back(3);                  // first bottom left vertex created, now right
 
     // triangle for 1/2 retangular side
-    indices[(3 * currentTriangle) + 0] = currentVertex - 2; // upper left vertex of side
-    indices[(3 * currentTriangle) + 1] = currentVertex - 1; // bottom left vertex of side
-    indices[(3 * currentTriangle) + 2] = 3;                 // bottom right vertex of side
-    currentTriangle++;
+    data.Indices.push_back(currentVertex - 2);  // upper left vertex of side
+    data.Indices.push_back(currentVertex - 1);  // bottom left vertex of side
+    data.Indices.push_back(3);                  // bottom right vertex of side
 
     // triangle for second 1/2 retangular side
-    indices[(3 * currentTriangle) + 0] = 3;                 // bottom right vertex of side
-    indices[(3 * currentTriangle) + 1] = 2;                 // upper right vertex of side
-    indices[(3 * currentTriangle) + 2] = currentVertex - 2; // upper left vertex of side
-    currentTriangle++;
+    data.Indices.push_back(3);                  // bottom right vertex of side
+    data.Indices.push_back(2);                  // upper right vertex of side
+    data.Indices.push_back(currentVertex - 2);  // upper left vertex of side
 
 }
 
@@ -834,55 +1934,31 @@ void UCreateCylinderMesh(GLMesh& mesh)
     // number of sides for the prism we will create
     const int NUM_SIDES = 100;
 
-    // the number of vertices is the number of sides * 2 (think, two vertices per edge line), plus 
-    // 2 for the center points at the top and bottom; since each vertex has a stride of 7 (x,y,z,r,g,b,a) would
-    // also need to multiply by seven
-    const int NUM_VERTICES = STRIDE * (2 + (2 * NUM_SIDES));
-
-    // the number of indices of a prism is 3 * the number of triangle that will be drawn; therefore, for a cube prism
-    // with a center point on each end (i.e. the smaller ends will be made up of four triangles instead of two) there 
-    // would be (4 triangles * 2 ends) + (2 triangles * 4 sides) = 16 triangles. Therefore, a total of 3 * 16, or 48 vertices
-    // for a cube prism. Or, more generally, 4 triangles needed for every side (top slice of pie, bottom, and two for the rectangle 
-    // on the side). Or, 12 * num sides is the amount of indices needed.
-    const int NUM_INDICES = 12 * NUM_SIDES;
-
-    // Position and Color data
-    GLfloat verts[NUM_VERTICES];
-
-    // Index data to share position data
-    GLushort indices[NUM_INDICES];
+    const float RADIUS = 0.25f;
 
-    // fill the verts and indices arrays with data
-    UCreatePrismMesh(verts, indices, NUM_SIDES, 0.25f, 0.02f);
+    // coarser levels of detail are the same prism regenerated with fewer sides
+    const int LOD_SIDES[] = { NUM_SIDES, 48, 24, 12, 6 };
+    const int NUM_LODS = sizeof(LOD_SIDES) / sizeof(LOD_SIDES[0]);
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerColor = 4;
-    if (STRIDE != floatsPerVertex + floatsPerColor)
+    // the number of vertices is the number of sides * 2 (think, two vertices per edge line), plus 
+    // 2 for the center points at the top and bottom. The number of indices is 12 * num sides: 4 triangles
+    // for every side (top slice of pie, bottom, and two for the rectangle on the side).
+    std::vector<MeshData> levels(NUM_LODS);
+    std::vector<float> errors(NUM_LODS);
+    for (int l = 0; l < NUM_LODS; l++)
     {
-        exit(EXIT_FAILURE);
-    }
-
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(2, mesh.vbos);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        // fill the vertex and index data
+        UCreatePrismMesh(levels[l], LOD_SIDES[l], RADIUS, 0.02f);
+        UOptimizeMesh(levels[l], "cylinder");
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerColor);// The number of floats before each
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+        // distance between the true circle and the middle of each flat side
+        errors[l] = l == 0 ? 0.0f : RADIUS * (1.0f - cos(3.1415926f / LOD_SIDES[l]));
+    }
 
-    glVertexAttribPointer(1, floatsPerColor, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+    MeshData data;
+    CombineLods(levels, errors, data);
+    UUploadMesh(data, mesh, gOptions.vertexFormat);
+    UBuildMeshBvh(data, mesh);
 }
 
 
@@ -902,160 +1978,1520 @@ void UCreatePlateMesh(GLMesh& mesh)
     2, 3, 0   // second triangle
     };
 
-    // total float values per each type
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 4;
-    const GLuint floatsPerUV = 2;
-
-    // store vertex and index count
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-
-    // Generate the VAO for the mesh
-    glGenVertexArrays(1, &mesh.vao);
-    glBindVertexArray(mesh.vao);	// activate the VAO
-
-    // Create VBOs for the mesh
-    glGenBuffers(2, mesh.vbos);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends data to the GPU
+    // total float values per each type; the shader only reads the first three "normal" values
+    const int floatsPerVertex = 3;
+    const int floatsPerNormal = 4;
+    const int floatsPerUV = 2;
+    const int stride = floatsPerVertex + floatsPerNormal + floatsPerUV;
+    const int numVertices = sizeof(verts) / (sizeof(verts[0]) * stride);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+    MeshData data;
+    for (int i = 0; i < numVertices; i++)
+    {
+        const GLfloat* vertex = verts + i * stride;
+        data.Positions.push_back(glm::vec3(vertex[0], vertex[1], vertex[2]));
+        data.Normals.push_back(glm::vec3(vertex[3], vertex[4], vertex[5]));
+        data.UVs.push_back(glm::vec2(vertex[7], vertex[8]));
+    }
+    data.Indices.assign(indices, indices + sizeof(indices) / sizeof(indices[0]));
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    UOptimizeMesh(data, "plate");
+    UUploadMesh(data, mesh, gOptions.vertexFormat);
+    UBuildMeshBvh(data, mesh);
 }
 
 
-void UDestroyMesh(GLMesh& mesh)
+// Reorders a generated or imported mesh for the post-transform vertex cache and for vertex fetch
+// (and optionally for overdraw) before it is uploaded or written
+void UOptimizeMesh(MeshData& data, const char* name)
 {
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(2, mesh.vbos);
+    if (!gOptions.optimizeMeshes)
+        return;
+
+    MeshOptimizeStats stats = OptimizeMesh(data, gOptions.overdrawSort);
+    LOG(LOG_INFO, "Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", name,
+        stats.Before.ACMR, stats.After.ACMR, stats.Before.ATVR, stats.After.ATVR);
 }
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+
+// Packs mesh data into a vertex format (compact unless that would lose precision, or as forced
+// with --vertex-format) and uploads it into a new VAO with its vertex and index buffers
+void UUploadMesh(const MeshData& data, GLMesh& mesh, Vertex_Format format)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    PackedVertices packed;
+    PackVertices(data, format, packed);
+
+    // store vertex and index count, and how the shader gets object space values back
+    mesh.nVertices = (GLfloat)data.Positions.size();
+    mesh.nIndices = (GLuint)data.Indices.size();
+    mesh.positionScale = packed.PositionScale;
+    mesh.positionBias = packed.PositionBias;
+    mesh.octNormals = packed.OctNormals;
+    mesh.vertexBytes = packed.Bytes.size();
+
+    // levels of detail; a mesh without a chain is its own single level
+    mesh.lodCount = data.Lods.empty() ? 1 : (int)data.Lods.size();
+    for (int l = 0; l < mesh.lodCount; l++)
     {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
+        if (data.Lods.empty())
         {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
+            mesh.lods[l].FirstIndex = 0;
+            mesh.lods[l].IndexCount = mesh.nIndices;
+            mesh.lods[l].Error = 0.0f;
         }
+        else
+            mesh.lods[l] = data.Lods[l];
+    }
+    mesh.nIndices = mesh.lods[0].IndexCount;
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    if (!data.Positions.empty())
+        boundsMin = boundsMax = data.Positions[0];
+    for (size_t i = 1; i < data.Positions.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, data.Positions[i]);
+        boundsMax = glm::max(boundsMax, data.Positions[i]);
+    }
+    mesh.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    mesh.boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+    mesh.boundsMin = boundsMin;
+    mesh.boundsMax = boundsMax;
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    // the software renderer reads back the packed vertices, so it sees the same quantized values as the shader
+    if (gOptions.software || gOptions.benchSoftware)
+    {
+        mesh.cpu = std::make_shared<MeshData>();
+        UnpackVertices(packed.Bytes.data(), (uint32_t)data.Positions.size(), packed.Stride, packed.Attributes, packed.AttributeCount,
+            packed.PositionScale, packed.PositionBias, packed.OctNormals, *mesh.cpu);
+        mesh.cpu->Indices = data.Indices;
+    }
 
-        return true;
+    // Create VAO
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    // Create VBOs
+    GpuResources& resources = GpuResources::Instance();
+    mesh.vbos[0] = resources.CreateBuffer(GPU_MESHES, "mesh vertices");
+    mesh.vbos[1] = resources.CreateBuffer(GPU_MESHES, "mesh indices");
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the vertex buffer
+    resources.BufferData(GL_ARRAY_BUFFER, mesh.vbos[0], packed.Bytes.size(), packed.Bytes.data(), GL_STATIC_DRAW);
+
+    // 16 bit indices whenever every vertex can be addressed with them
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
+    if (data.Positions.size() <= 65536)
+    {
+        std::vector<GLushort> shortIndices(data.Indices.begin(), data.Indices.end());
+        mesh.indexType = GL_UNSIGNED_SHORT;
+        resources.BufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1], shortIndices.size() * sizeof(GLushort), shortIndices.data(),
+            GL_STATIC_DRAW);
+    }
+    else
+    {
+        mesh.indexType = GL_UNSIGNED_INT;
+        resources.BufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1], data.Indices.size() * sizeof(GLuint), data.Indices.data(),
+            GL_STATIC_DRAW);
     }
 
-    // Error loading the image
-    return false;
+    // Create Vertex Attribute Pointers
+    for (uint32_t i = 0; i < packed.AttributeCount; i++)
+    {
+        const MeshFileAttribute& attribute = packed.Attributes[i];
+        glVertexAttribPointer(attribute.Location, attribute.Components, attribute.Type, attribute.Normalized ? GL_TRUE : GL_FALSE,
+            packed.Stride, (void*)(uintptr_t)attribute.Offset);
+        glEnableVertexAttribArray(attribute.Location);
+    }
+    UBindInstanceAttributes();
+    glBindVertexArray(0);
 }
 
-void UDestroyTexture(GLuint textureId)
+
+// Builds the triangle BVH picking tests the mesh with, over its finest level of detail
+void UBuildMeshBvh(const MeshData& data, GLMesh& mesh)
 {
-    glGenTextures(1, &textureId);
+    mesh.bvh = std::make_shared<MeshBvh>();
+    mesh.bvh->Build(data.Positions, data.Indices, mesh.lods[0].FirstIndex, mesh.lods[0].IndexCount);
 }
 
 
-
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+// Builds the picking BVH of a mesh file on gMeshBvhBuilder, so that loading stays a plain upload from the
+// mapping and no pick waits on a large mesh. The worker maps and decodes the file again (or reuses the
+// software renderer's copy) and publishes the BVH with std::atomic_store; until then picks hit the mesh's
+// box. A file that cannot be read again gets an empty BVH, which nothing hits. The mesh must outlive the
+// builder, which main stops before destroying meshes.
+void UBuildMeshBvhAsync(const char* filename, GLMesh& mesh)
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
+    if (gMeshBvhBuilder.ThreadCount() == 0)
+        gMeshBvhBuilder.Start(1, 4);
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
+    GLMesh* target = &mesh;
+    std::shared_ptr<MeshData> cpu = mesh.cpu;
+    MeshFileLod finest = mesh.lods[0];
+    gMeshBvhBuilder.Submit([filename, target, cpu, finest]()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::shared_ptr<MeshData> data = cpu;
+        if (!data)
+        {
+            data = std::make_shared<MeshData>();
+            MappedFile file;
+            MeshFileHeader header;
+            if (!file.Open(filename) || !MeshFileValidate(file, header) || !UDecodeMeshFile(filename, file, header, *data))
+            {
+                LOG(LOG_ERROR, "Could not read %s again, its objects cannot be picked", filename);
+                data.reset();
+            }
+        }
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+        std::shared_ptr<MeshBvh> bvh = std::make_shared<MeshBvh>();
+        if (data)
+            bvh->Build(data->Positions, data->Indices, finest.FirstIndex, finest.IndexCount);
+        std::atomic_store(&target->bvh, bvh);
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+        float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        LOG(LOG_INFO, "Built the picking BVH of %s: %u triangles in %.1f ms", filename, bvh->TriangleCount(), milliseconds);
+    });
+}
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 
-        return false;
-    }
+// The mesh's picking BVH, or null while a mesh file's is still being built
+std::shared_ptr<MeshBvh> UMeshBvh(const GLMesh& mesh)
+{
+    return std::atomic_load(&mesh.bvh);
+}
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 
-        return false;
+// Points the per-instance attributes of the bound VAO into gInstanceBuffer. Before that buffer exists
+// (the benchmarks) nothing is set up, and the shader reads whatever constant attribute values are current.
+void UBindInstanceAttributes()
+{
+    if (gInstanceBuffer == 0)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+    for (GLuint column = 0; column < 4; column++)
+    {
+        glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+            (void*)(uintptr_t)(column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+        glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
     }
+    glVertexAttribIPointer(INSTANCE_MATERIAL_LOCATION, 1, GL_INT, sizeof(InstanceData), (void*)(uintptr_t)offsetof(InstanceData, material));
+    glEnableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+    glVertexAttribDivisor(INSTANCE_MATERIAL_LOCATION, 1);
+    glVertexAttribIPointer(INSTANCE_HIGHLIGHT_LOCATION, 1, GL_INT, sizeof(InstanceData), (void*)(uintptr_t)offsetof(InstanceData, highlight));
+    glEnableVertexAttribArray(INSTANCE_HIGHLIGHT_LOCATION);
+    glVertexAttribDivisor(INSTANCE_HIGHLIGHT_LOCATION, 1);
+}
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+// Picks the level of detail the object needs at its current screen size; screenPixels receives the
+// object's size in rendered pixels
+int USelectMeshLod(const GLMesh& mesh, const glm::mat4& modelView, const glm::mat4& projection, float viewportHeight, LodState& lod,
+    float& screenPixels)
+{
+    // pixels covered by one object space unit at the front of the bounding sphere
+    float scale = glm::max(glm::length(glm::vec3(modelView[0])), glm::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+    glm::vec4 center = modelView * glm::vec4(mesh.boundsCenter, 1.0f);
+    float distance = glm::max(glm::length(glm::vec3(center)) - mesh.boundsRadius * scale, 0.1f);
+    float pixelsPerUnit = scale * projection[1][1] * 0.5f * viewportHeight / distance;
+
+    screenPixels = 2.0f * mesh.boundsRadius * pixelsPerUnit;
+    return SelectLod(mesh.lods, mesh.lodCount, pixelsPerUnit, gOptions.lodThreshold, lod);
+}
 
-        return false;
-    }
 
-    glUseProgram(programId);    // Uses the shader program
+// Tests the bounding sphere against the six clip planes of the model-view-projection matrix
+bool USphereVisible(const glm::mat4& modelViewProjection, const GLMesh& mesh)
+{
+    if (mesh.boundsRadius <= 0.0f)
+        return true;
 
+    const glm::mat4& m = modelViewProjection;
+    glm::vec4 rows[4] = {
+        glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]), glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]),
+        glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]), glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3])
+    };
+    glm::vec4 center(mesh.boundsCenter, 1.0f);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int side = -1; side <= 1; side += 2)
+        {
+            // plane w + side * axis >= 0; its normal length scales the radius into plane units
+            glm::vec4 plane = rows[3] + (float)side * rows[axis];
+            float length = glm::length(glm::vec3(plane));
+            if (glm::dot(plane, center) < -mesh.boundsRadius * length)
+                return false;
+        }
+    }
     return true;
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+// Draws one level of detail for instanceCount instances, whose attributes start at firstInstance in
+// gInstanceBuffer, and counts what was submitted; the mesh uniforms must already be set
+void UDrawMesh(const GLMesh& mesh, int level, GLuint firstInstance, GLsizei instanceCount)
 {
-    glDeleteProgram(programId);
+    const MeshFileLod& range = mesh.lods[level];
+    size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, range.IndexCount, mesh.indexType, (void*)(uintptr_t)(range.FirstIndex * indexSize),
+        instanceCount, firstInstance);
+
+    gFrameStats.triangles += range.IndexCount / 3 * instanceCount;
+    gFrameStats.draws++;
+    gFrameStats.instances += instanceCount;
 }
 
+
+// Passes how the mesh's vertices are encoded to the shader program
+void USetMeshUniforms(GLuint programId, const GLMesh& mesh)
+{
+    glUniform3fv(glGetUniformLocation(programId, "positionScale"), 1, glm::value_ptr(mesh.positionScale));
+    glUniform3fv(glGetUniformLocation(programId, "positionBias"), 1, glm::value_ptr(mesh.positionBias));
+    glUniform1i(glGetUniformLocation(programId, "octNormals"), mesh.octNormals ? 1 : 0);
+}
+
+
+// Decodes the vertices of a validated mesh file as the vertex shader sees them, and its indices
+bool UDecodeMeshFile(const char* filename, const MappedFile& file, const MeshFileHeader& header, MeshData& data)
+{
+    UnpackVertices(file.Data + header.VertexOffset, header.VertexCount, header.VertexStride, header.Attributes, header.AttributeCount,
+        glm::vec3(header.PositionScale[0], header.PositionScale[1], header.PositionScale[2]),
+        glm::vec3(header.PositionBias[0], header.PositionBias[1], header.PositionBias[2]),
+        (header.Flags & MESH_FILE_OCT_NORMALS) != 0, data);
+    if (!MeshFileReadIndices(file, header, data.Indices))
+    {
+        LOG(LOG_ERROR, "%s has indices past its %u vertices", filename, header.VertexCount);
+        return false;
+    }
+    return true;
+}
+
+
+// Loads a binary mesh file by memory mapping it and uploading the vertex and index blobs
+// straight from the mapping, with no parsing and no intermediate copy
+bool UCreateMeshFromFile(const char* filename, GLMesh& mesh)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    MeshFileHeader header;
+    if (!MeshFileValidate(file, header))
+    {
+        LOG(LOG_ERROR, "%s is not a valid mesh file (version %u expected)", filename, MESH_FILE_VERSION);
+        return false;
+    }
+
+    // store vertex and index count
+    mesh.nVertices = (GLfloat)header.VertexCount;
+    mesh.indexType = header.IndexType;
+    mesh.positionScale = glm::vec3(header.PositionScale[0], header.PositionScale[1], header.PositionScale[2]);
+    mesh.positionBias = glm::vec3(header.PositionBias[0], header.PositionBias[1], header.PositionBias[2]);
+    mesh.octNormals = (header.Flags & MESH_FILE_OCT_NORMALS) != 0;
+    mesh.vertexBytes = (size_t)header.VertexBytes;
+    mesh.lodCount = (int)header.LodCount;
+    memcpy(mesh.lods, header.Lods, sizeof(MeshFileLod) * header.LodCount);
+    mesh.nIndices = mesh.lods[0].IndexCount;
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    GpuResources& resources = GpuResources::Instance();
+    mesh.vbos[0] = resources.CreateBuffer(GPU_MESHES, filename);
+    mesh.vbos[1] = resources.CreateBuffer(GPU_MESHES, filename);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
+    resources.BufferData(GL_ARRAY_BUFFER, mesh.vbos[0], (size_t)header.VertexBytes, file.Data + header.VertexOffset, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+    resources.BufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1], (size_t)header.IndexBytes, file.Data + header.IndexOffset, GL_STATIC_DRAW);
+
+    // Create Vertex Attribute Pointers from the layout stored in the file
+    for (uint32_t i = 0; i < header.AttributeCount; i++)
+    {
+        const MeshFileAttribute& attribute = header.Attributes[i];
+        glVertexAttribPointer(attribute.Location, attribute.Components, attribute.Type, attribute.Normalized ? GL_TRUE : GL_FALSE,
+            header.VertexStride, (void*)(uintptr_t)attribute.Offset);
+        glEnableVertexAttribArray(attribute.Location);
+    }
+    UBindInstanceAttributes();
+    glBindVertexArray(0);
+
+    // CPU copy for the software renderer, decoded from the same mapping; the picking BVH is built
+    // on a worker below
+    if (gOptions.software || gOptions.benchSoftware)
+    {
+        mesh.cpu = std::make_shared<MeshData>();
+        if (!UDecodeMeshFile(filename, file, header, *mesh.cpu))
+            return false;
+    }
+
+    // fit the mesh into a half unit box beside the plate
+    glm::vec3 boundsMin(header.BoundsMin[0], header.BoundsMin[1], header.BoundsMin[2]);
+    glm::vec3 boundsMax(header.BoundsMax[0], header.BoundsMax[1], header.BoundsMax[2]);
+    glm::vec3 extent = boundsMax - boundsMin;
+    float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+    float fit = largest > 0.0f ? 0.5f / largest : 1.0f;
+    gAssetModel = glm::translate(glm::vec3(0.75f, 0.0f, 0.0f)) * glm::scale(glm::vec3(fit)) * glm::translate(-(boundsMin + boundsMax) * 0.5f);
+    mesh.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    mesh.boundsRadius = glm::length(extent) * 0.5f;
+    mesh.boundsMin = boundsMin;
+    mesh.boundsMax = boundsMax;
+
+    UBuildMeshBvhAsync(filename, mesh);
+
+    LOG(LOG_INFO, "Loaded %s: %u vertices, %u indices, %d levels of detail", filename, header.VertexCount, header.IndexCount,
+        mesh.lodCount);
+    return true;
+}
+
+
+void UDestroyMesh(GLMesh& mesh)
+{
+    glDeleteVertexArrays(1, &mesh.vao);
+    GpuResources::Instance().Release(GPU_BUFFER, mesh.vbos[0]);
+    GpuResources::Instance().Release(GPU_BUFFER, mesh.vbos[1]);
+}
+
+// Loads the scene's textures as layers of the material array (streamed, or in full with
+// --no-texture-streaming) and fills the material table
+bool UCreateMaterials()
+{
+    if (gOptions.streamTextures)
+    {
+        TextureStreamer& streamer = TextureStreamer::Instance();
+        streamer.UploadBudget = (size_t)gOptions.textureUploadKB * 1024;
+    }
+
+    const char* texFilename = "../OpenGLSample/resources/textures/yolk.png";
+    const char* texFilename2 = "../OpenGLSample/resources/textures/white.jpg";
+    int yolkLayer = gMaterials.AddLayer(texFilename);
+    int whiteLayer = gMaterials.AddLayer(texFilename2);
+    if (yolkLayer < 0 || whiteLayer < 0)
+    {
+        LOG(LOG_ERROR, "Failed to load texture %s", yolkLayer < 0 ? texFilename : texFilename2);
+        return false;
+    }
+
+    // the lighting the shader used to hard-code for every object
+    Material material;
+    material.SpecularIntensity = 0.1f;
+    material.HighlightSize = 16.0f;
+    material.Layer = yolkLayer;
+    gMaterialYolk = gMaterials.AddMaterial(material);
+    material.Layer = whiteLayer;
+    gMaterialWhite = gMaterials.AddMaterial(material);
+
+    // random materials for the generated scene
+    gStressFirstMaterial = gMaterials.Count();
+    if (gOptions.stress || gOptions.benchScalingPath != nullptr)
+    {
+        std::vector<Material> stressMaterials;
+        StressGenerateMaterials(gOptions.seed, 2, stressMaterials);
+        for (size_t i = 0; i < stressMaterials.size(); i++)
+            gMaterials.AddMaterial(stressMaterials[i]);
+    }
+
+    if (!gMaterials.Build(gOptions.streamTextures))
+        return false;
+    LOG(LOG_INFO, "%d materials, textures in a %dx%d array", gMaterials.Count(), gMaterials.LayerWidth, gMaterials.LayerHeight);
+    return true;
+}
+
+// Tells the streamer how large an object drawn with the texture is on screen; the texture repeats
+// uvScale times across the object, so each repeat needs that many times fewer texels
+void URequestTexture(int streamHandle, float screenPixels)
+{
+    if (streamHandle >= 0)
+        TextureStreamer::Instance().Request(streamHandle, screenPixels / glm::max(gUVScale.x, gUVScale.y));
+}
+
+
+
+// Implements the UCreateShaders function
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+{
+    // Compilation and linkage error reporting
+    int success = 0;
+    char infoLog[512];
+
+    // Create a Shader program object.
+    programId = glCreateProgram();
+
+    // Create the vertex and fragment shader objects
+    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+    // Retrive the shader source
+    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
+    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+
+    // Compile the vertex shader, and print compilation errors (if any)
+    glCompileShader(vertexShaderId); // compile the vertex shader
+    // check for shader compile errors
+    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
+        LOG(LOG_ERROR, "SHADER::VERTEX::COMPILATION_FAILED\n%s", infoLog);
+
+        return false;
+    }
+
+    glCompileShader(fragmentShaderId); // compile the fragment shader
+    // check for shader compile errors
+    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
+        LOG(LOG_ERROR, "SHADER::FRAGMENT::COMPILATION_FAILED\n%s", infoLog);
+
+        return false;
+    }
+
+    // Attached compiled shaders to the shader program
+    glAttachShader(programId, vertexShaderId);
+    glAttachShader(programId, fragmentShaderId);
+
+    glLinkProgram(programId);   // links the shader program
+    // check for linking errors
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        LOG(LOG_ERROR, "SHADER::PROGRAM::LINKING_FAILED\n%s", infoLog);
+
+        return false;
+    }
+
+    glUseProgram(programId);    // Uses the shader program
+
+    return true;
+}
+
+
+void UDestroyShaderProgram(GLuint programId)
+{
+    glDeleteProgram(programId);
+}
+
+
+// Parses the command line options into gOptions
+bool UParseCommandLine(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        // true when the option is followed by a value
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--record") == 0 && hasValue)
+            gOptions.recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+            gOptions.replayPath = argv[++i];
+        else if (strcmp(argv[i], "--timings") == 0 && hasValue)
+            gOptions.timingsPath = argv[++i];
+        else if (strcmp(argv[i], "--step") == 0 && hasValue)
+            gOptions.replayStep = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--offscreen") == 0)
+            gOptions.offscreen = true;
+        else if (strcmp(argv[i], "--capture-gl") == 0 && hasValue)
+            gOptions.capturePath = argv[++i];
+        else if (strcmp(argv[i], "--capture-frames") == 0 && hasValue)
+            gOptions.captureFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--replay-gl") == 0 && hasValue)
+            gOptions.glReplayPath = argv[++i];
+        else if (strcmp(argv[i], "--loops") == 0 && hasValue)
+            gOptions.loops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--mesh") == 0 && hasValue)
+            gOptions.meshPath = argv[++i];
+        else if (strcmp(argv[i], "--convert-mesh") == 0 && i + 2 < argc)
+        {
+            gOptions.convertInput = argv[++i];
+            gOptions.convertOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench-mesh-load") == 0 && i + 2 < argc)
+        {
+            gOptions.benchObjPath = argv[++i];
+            gOptions.benchMeshPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--vertex-format") == 0 && hasValue)
+        {
+            const char* format = argv[++i];
+            if (strcmp(format, "auto") == 0)
+                gOptions.vertexFormat = VERTEX_FORMAT_AUTO;
+            else if (strcmp(format, "float") == 0)
+                gOptions.vertexFormat = VERTEX_FORMAT_FLOAT;
+            else if (strcmp(format, "compact") == 0)
+                gOptions.vertexFormat = VERTEX_FORMAT_COMPACT;
+            else
+            {
+                LOG(LOG_ERROR, "Unknown vertex format %s (auto, float or compact)", format);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-vertex-formats") == 0)
+            gOptions.benchVertexFormats = true;
+        else if (strcmp(argv[i], "--sides") == 0 && hasValue)
+            gOptions.sides = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-mesh-optimize") == 0)
+            gOptions.optimizeMeshes = false;
+        else if (strcmp(argv[i], "--overdraw-sort") == 0)
+            gOptions.overdrawSort = true;
+        else if (strcmp(argv[i], "--bench-mesh-optimize") == 0 && hasValue)
+            gOptions.benchOptimizePath = argv[++i];
+        else if (strcmp(argv[i], "--lod-threshold") == 0 && hasValue)
+            gOptions.lodThreshold = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--frame-latency") == 0 && hasValue)
+            gOptions.frameLatency = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--target-frame-ms") == 0 && hasValue)
+            gOptions.targetFrameMs = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-resolution-scale") == 0 && hasValue)
+            gOptions.minResolutionScale = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--sharpen") == 0 && hasValue)
+            gOptions.sharpen = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && i + 2 < argc)
+        {
+            gOptions.batchPath = argv[++i];
+            gOptions.batchOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "--shard") == 0 && hasValue)
+        {
+            if (sscanf(argv[++i], "%d/%d", &gOptions.shardIndex, &gOptions.shardCount) != 2 || gOptions.shardCount < 1
+                || gOptions.shardIndex < 0 || gOptions.shardIndex >= gOptions.shardCount)
+            {
+                LOG(LOG_ERROR, "--shard expects <index>/<count> with 0 <= index < count, got %s", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--encode-threads") == 0 && hasValue)
+            gOptions.encodeThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--software") == 0)
+            gOptions.software = true;
+        else if (strcmp(argv[i], "--software-threads") == 0 && hasValue)
+            gOptions.softwareThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bench-software") == 0)
+            gOptions.benchSoftware = true;
+        else if (strcmp(argv[i], "--stress") == 0 && hasValue)
+        {
+            gOptions.stress = true;
+            if (sscanf(argv[++i], "%dx%dx%d", &gOptions.stressTables, &gOptions.stressPlates, &gOptions.stressItems) != 3
+                || gOptions.stressTables < 1 || gOptions.stressPlates < 1 || gOptions.stressItems < 0)
+            {
+                LOG(LOG_ERROR, "--stress expects <tables>x<plates>x<items>, e.g. 16x8x3, got %s", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--lights") == 0 && hasValue)
+            gOptions.lights = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+            gOptions.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--bench-scaling") == 0 && hasValue)
+            gOptions.benchScalingPath = argv[++i];
+        else if (strcmp(argv[i], "--bench-picking") == 0)
+            gOptions.benchPicking = true;
+        else if (strcmp(argv[i], "--no-occlusion-culling") == 0)
+            gOptions.occlusionCulling = false;
+        else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+            gOptions.baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+            gOptions.tolerance = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--no-texture-streaming") == 0)
+            gOptions.streamTextures = false;
+        else if (strcmp(argv[i], "--texture-upload-budget") == 0 && hasValue)
+            gOptions.textureUploadKB = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--gpu-memory-budget") == 0 && hasValue)
+            gOptions.gpuMemoryMB = atoi(argv[++i]);
+        else
+        {
+            LOG(LOG_ERROR, "Unknown or incomplete option %s", argv[i]);
+            return false;
+        }
+    }
+
+    if (gOptions.replayStep <= 0.0f)
+    {
+        LOG(LOG_ERROR, "--step must be greater than zero");
+        return false;
+    }
+
+    if (gOptions.sides < 3)
+    {
+        LOG(LOG_ERROR, "--sides must be at least 3");
+        return false;
+    }
+
+    if (gOptions.lights < 1 || gOptions.lights > MAX_LIGHTS)
+    {
+        LOG(LOG_ERROR, "--lights must be between 1 and %d", MAX_LIGHTS);
+        return false;
+    }
+
+    // a capture of a software frame would only hold the texture upload and the blit
+    if (gOptions.software && gOptions.capturePath != nullptr)
+    {
+        LOG(LOG_ERROR, "--capture-gl records GL rendering and cannot be combined with --software");
+        return false;
+    }
+
+    return true;
+}
+
+
+// Saves the current camera state to the recording
+void URecordCameraFrame(float currentFrame)
+{
+    if (gRecordStart < 0.0f)
+        gRecordStart = currentFrame;
+
+    CameraSample sample;
+    sample.Time = currentFrame - gRecordStart;
+    sample.Position[0] = gCamera.Position.x;
+    sample.Position[1] = gCamera.Position.y;
+    sample.Position[2] = gCamera.Position.z;
+    sample.Yaw = gCamera.Yaw;
+    sample.Pitch = gCamera.Pitch;
+    sample.Zoom = gCamera.Zoom;
+    sample.DeltaTime = gDeltaTime;
+    gRecorder.Write(sample);
+}
+
+
+// Moves the camera to where the recording was at this frame, stepping time by a fixed amount
+// so every replay renders exactly the same frames; returns false once the recording has ended
+bool UReplayCameraFrame()
+{
+    float time = gReplayFrame * gOptions.replayStep;
+    gReplayFrame++;
+    gDeltaTime = gOptions.replayStep;
+
+    if (time > gReplayTrack.Duration())
+        return false;
+
+    UApplyCameraSample(gReplayTrack.Sample(time));
+    return true;
+}
+
+
+// Moves the camera to a recorded (or batch) camera state
+void UApplyCameraSample(const CameraSample& sample)
+{
+    gCamera.Position = glm::vec3(sample.Position[0], sample.Position[1], sample.Position[2]);
+    gCamera.Yaw = sample.Yaw;
+    gCamera.Pitch = sample.Pitch;
+    gCamera.Zoom = sample.Zoom;
+    gCamera.ProcessMouseMovement(0.0f, 0.0f); // recomputes the camera vectors from yaw and pitch
+}
+
+
+// Prints the replay frame time summary and optionally saves every frame time
+void UReportFrameTimings()
+{
+    LOG(LOG_INFO, "Replay: %u frames, avg %.3f ms, min %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms",
+        (unsigned)gFrameTimings.FrameMs.size(), gFrameTimings.Average(), gFrameTimings.Percentile(0.0f),
+        gFrameTimings.Percentile(50.0f), gFrameTimings.Percentile(95.0f), gFrameTimings.Percentile(99.0f),
+        gFrameTimings.Percentile(100.0f));
+    if (!gFrameTimings.FrameMs.empty())
+        LOG(LOG_INFO, "Replay: %.0f triangles per frame on average", gReplayTriangles / gFrameTimings.FrameMs.size());
+    LOG(LOG_INFO, "Replay: frame latency %d, update %.3f ms per frame, GL thread waited %.3f ms per frame for it",
+        gPipeline.Latency(), gPipeline.UpdateMs(), gPipeline.WaitMs());
+
+    if (gOptions.timingsPath != nullptr && !gFrameTimings.WriteCsv(gOptions.timingsPath))
+        LOG(LOG_ERROR, "Failed to write frame timings to %s", gOptions.timingsPath);
+}
+
+
+// Prints a line of a benchmark report straight to stdout. Reports are tables, so they bypass the
+// rate-limited logger; the logger is flushed first so that its lines never land inside one.
+void UReport(const char* format, ...)
+{
+    Logger::Instance().Flush();
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    fflush(stdout);
+}
+
+
+// Re-issues a GL capture as fast as possible and prints where the time went per call type
+bool UReplayGLTrace()
+{
+    GLTracePlayer player;
+    if (!player.Load(gOptions.glReplayPath))
+    {
+        LOG(LOG_ERROR, "Failed to load GL capture %s", gOptions.glReplayPath);
+        return false;
+    }
+
+    if (!player.Play(gOptions.loops))
+    {
+        LOG(LOG_ERROR, "GL capture %s is corrupt: a call's arguments do not fit its record", gOptions.glReplayPath);
+        return false;
+    }
+
+    double totalSeconds = player.FinishSeconds;
+    for (int op = 0; op < TRACE_OP_COUNT; op++)
+        totalSeconds += player.OpStats[op].Seconds;
+
+    UReport("%-28s %10s %12s %10s %7s\n", "call", "count", "total ms", "avg us", "share");
+    for (int op = 0; op < TRACE_OP_COUNT; op++)
+    {
+        const TraceOpStats& stats = player.OpStats[op];
+        if (stats.Calls == 0 || op == TRACE_FRAME_END || op == TRACE_BEGIN_FRAMES)
+            continue;
+        UReport("%-28s %10llu %12.3f %10.3f %6.1f%%\n", TRACE_OP_NAMES[op], (unsigned long long)stats.Calls,
+            stats.Seconds * 1000.0, stats.Seconds * 1e6 / stats.Calls, 100.0 * stats.Seconds / totalSeconds);
+    }
+    UReport("%-28s %10s %12.3f %10s %6.1f%%\n", "glFinish (GPU wait)", "", player.FinishSeconds * 1000.0, "",
+        100.0 * player.FinishSeconds / totalSeconds);
+
+    FrameTimings frames;
+    for (size_t i = 0; i < player.FrameMs.size(); i++)
+        frames.Add((float)player.FrameMs[i]);
+    UReport("%u frames: avg %.3f ms, p95 %.3f ms, max %.3f ms\n", (unsigned)frames.FrameMs.size(),
+        frames.Average(), frames.Percentile(95.0f), frames.Percentile(100.0f));
+
+    if (gOptions.timingsPath != nullptr && !frames.WriteCsv(gOptions.timingsPath))
+        LOG(LOG_ERROR, "Failed to write frame timings to %s", gOptions.timingsPath);
+
+    return true;
+}
+
+
+// Batch mode: renders every pose of the list (or of this process's shard) offscreen and writes one PNG
+// per pose. The GL thread only renders and starts readbacks; pixels are mapped a few images later and
+// encoded by a pool of threads, so neither the readback nor the encoding holds up rendering.
+bool UBatchRender()
+{
+    std::vector<BatchPose> poses;
+    if (!BatchLoadPoses(gOptions.batchPath, poses))
+    {
+        LOG(LOG_ERROR, "Failed to read camera poses from %s", gOptions.batchPath);
+        return false;
+    }
+
+    // shards take every shardCount-th pose so slow stretches of a sequence are shared evenly
+    std::vector<int> mine;
+    int width = 0, height = 0;
+    for (int i = gOptions.shardIndex; i < (int)poses.size(); i += gOptions.shardCount)
+    {
+        mine.push_back(i);
+        width = glm::max(width, poses[i].Width);
+        height = glm::max(height, poses[i].Height);
+    }
+    if (mine.empty())
+    {
+        LOG(LOG_INFO, "Shard %d/%d has no poses", gOptions.shardIndex, gOptions.shardCount);
+        return true;
+    }
+
+    // one target at the largest size; smaller images use its lower left corner
+    RenderTarget target;
+    if (!target.Resize(width, height))
+    {
+        LOG(LOG_ERROR, "Failed to create a %dx%d render target", width, height);
+        return false;
+    }
+
+    PixelReadback readback;
+    readback.Create(BATCH_READBACK_SLOTS);
+    WorkerPool encoders;
+    encoders.Start(gOptions.encodeThreads, BATCH_READBACK_SLOTS * 2);
+
+    std::atomic<int> failed(0);
+    std::atomic<long long> encodeMicroseconds(0);
+    const char* outputDir = gOptions.batchOutput;
+    auto encode = [&](int index, int imageWidth, int imageHeight, std::vector<unsigned char>& pixels)
+    {
+        std::shared_ptr<std::vector<unsigned char>> image = std::make_shared<std::vector<unsigned char>>();
+        image->swap(pixels);
+        encoders.Submit([=, &failed, &encodeMicroseconds]()
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/frame_%05d.png", outputDir, index);
+            if (!PngWrite(path, imageWidth, imageHeight, image->data(), true))
+            {
+                LOG(LOG_ERROR, "Failed to write %s", path);
+                failed++;
+            }
+            encodeMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        });
+    };
+
+    LOG(LOG_INFO, "Batch: rendering %u of %u poses (shard %d/%d) with %d encoding threads", (unsigned)mine.size(),
+        (unsigned)poses.size(), gOptions.shardIndex, gOptions.shardCount, encoders.ThreadCount());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double renderSeconds = 0.0;
+    size_t pixelCount = 0;
+    FramePacket packet;
+    glBindFramebuffer(GL_FRAMEBUFFER, target.Framebuffer);
+    for (size_t k = 0; k < mine.size(); k++)
+    {
+        const BatchPose& pose = poses[mine[k]];
+        std::chrono::steady_clock::time_point renderStart = std::chrono::steady_clock::now();
+
+        UApplyCameraSample(pose.Camera);
+        UBuildFramePacket(packet, pose.Width, pose.Height, 1.0f);
+        if (gOptions.software)
+        {
+            // the image is already in memory, so it goes straight to the encoders
+            USoftwareRenderScene(packet);
+            std::vector<unsigned char> pixels;
+            gSoftRenderer.ReadPixels(pixels);
+            encode(mine[k], pose.Width, pose.Height, pixels);
+        }
+        else
+        {
+            glViewport(0, 0, pose.Width, pose.Height);
+            URenderScene(packet);
+            readback.Read(pose.Width, pose.Height, mine[k], encode);
+        }
+
+        renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+        pixelCount += (size_t)pose.Width * pose.Height;
+    }
+    readback.Flush(encode);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    encoders.Stop();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double images = (double)mine.size();
+    UReport("Batch: %u images in %.2f s: %.2f images/s, %.1f Mpixels/s\n", (unsigned)mine.size(), seconds, images / seconds,
+        pixelCount / seconds / 1.0e6);
+    UReport("  per image: render and readback %.2f ms (fence waits %.2f ms), encoding %.2f ms on a worker\n",
+        renderSeconds * 1000.0 / images, readback.WaitSeconds * 1000.0 / images, encodeMicroseconds / 1000.0 / images);
+
+    readback.Destroy();
+    target.Destroy();
+    return failed == 0;
+}
+
+
+// Offline converter: reads a Wavefront OBJ and writes it as a binary mesh file
+bool UConvertMesh(const char* objFilename, const char* meshFilename)
+{
+    MeshFileSource source;
+    ObjImporter importer;
+    if (!importer.Load(objFilename, source))
+    {
+        LOG(LOG_ERROR, "Failed to read %s", objFilename);
+        return false;
+    }
+
+    // coarser levels of detail are simplified from the full mesh, then every level is optimized on its own
+    MeshData data;
+    MeshDataFromSource(source, data);
+    std::vector<MeshData> levels;
+    std::vector<float> errors;
+    BuildSimplifiedLods(data, levels, errors);
+    char summary[256] = "";
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        UOptimizeMesh(levels[l], objFilename);
+        size_t length = strlen(summary);
+        snprintf(summary + length, sizeof(summary) - length, " %u (%g)", (unsigned)(levels[l].Indices.size() / 3), errors[l]);
+    }
+    CombineLods(levels, errors, data);
+    LOG(LOG_INFO, "Levels of detail, triangles (error):%s", summary);
+
+    // the converter writes the compact vertex format unless --vertex-format says otherwise
+    if (!MeshDataWrite(meshFilename, data, gOptions.vertexFormat))
+    {
+        LOG(LOG_ERROR, "Failed to write %s", meshFilename);
+        return false;
+    }
+
+    LOG(LOG_INFO, "Converted %s to %s: %u vertices, %u triangles, %u levels of detail", objFilename, meshFilename,
+        source.VertexCount(), (unsigned)(source.Indices.size() / 3), (unsigned)levels.size());
+    return true;
+}
+
+
+// Compares loading the same mesh from text OBJ and from the binary format, both up to the point
+// where the data sits in GL buffers
+bool UBenchmarkMeshLoad()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    double objParseSeconds = 0.0, objUploadSeconds = 0.0, mapSeconds = 0.0, mapUploadSeconds = 0.0;
+    int loops = gOptions.loops > 0 ? gOptions.loops : 1;
+
+    GpuResources& resources = GpuResources::Instance();
+    GLuint buffers[2] = { resources.CreateBuffer(GPU_MESHES, "benchmark vertices"), resources.CreateBuffer(GPU_MESHES, "benchmark indices") };
+
+    for (int i = 0; i < loops; i++)
+    {
+        // text OBJ: parse into memory, then upload
+        Clock::time_point start = Clock::now();
+        MeshFileSource source;
+        ObjImporter importer;
+        if (!importer.Load(gOptions.benchObjPath, source))
+        {
+            LOG(LOG_ERROR, "Failed to read %s", gOptions.benchObjPath);
+            return false;
+        }
+        Clock::time_point parsed = Clock::now();
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        resources.BufferData(GL_ARRAY_BUFFER, buffers[0], source.Vertices.size() * sizeof(float), source.Vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        resources.BufferData(GL_ARRAY_BUFFER, buffers[1], source.Indices.size() * sizeof(uint32_t), source.Indices.data(), GL_STATIC_DRAW);
+        glFinish();
+        Clock::time_point uploaded = Clock::now();
+
+        objParseSeconds += std::chrono::duration<double>(parsed - start).count();
+        objUploadSeconds += std::chrono::duration<double>(uploaded - parsed).count();
+
+        // binary: map, validate, upload from the mapping
+        start = Clock::now();
+        MappedFile file;
+        MeshFileHeader header;
+        if (!file.Open(gOptions.benchMeshPath) || !MeshFileValidate(file, header))
+        {
+            LOG(LOG_ERROR, "Failed to map %s", gOptions.benchMeshPath);
+            return false;
+        }
+        Clock::time_point mapped = Clock::now();
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        resources.BufferData(GL_ARRAY_BUFFER, buffers[0], (size_t)header.VertexBytes, file.Data + header.VertexOffset, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        resources.BufferData(GL_ARRAY_BUFFER, buffers[1], (size_t)header.IndexBytes, file.Data + header.IndexOffset, GL_STATIC_DRAW);
+        glFinish();
+        uploaded = Clock::now();
+
+        mapSeconds += std::chrono::duration<double>(mapped - start).count();
+        mapUploadSeconds += std::chrono::duration<double>(uploaded - mapped).count();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    resources.Release(GPU_BUFFER, buffers[0]);
+    resources.Release(GPU_BUFFER, buffers[1]);
+
+    double objTotal = (objParseSeconds + objUploadSeconds) * 1000.0 / loops;
+    double mapTotal = (mapSeconds + mapUploadSeconds) * 1000.0 / loops;
+    UReport("%-8s %12s %12s %12s\n", "format", "load ms", "upload ms", "total ms");
+    UReport("%-8s %12.3f %12.3f %12.3f\n", "obj", objParseSeconds * 1000.0 / loops, objUploadSeconds * 1000.0 / loops, objTotal);
+    UReport("%-8s %12.3f %12.3f %12.3f\n", "eggm", mapSeconds * 1000.0 / loops, mapUploadSeconds * 1000.0 / loops, mapTotal);
+    UReport("binary mesh loads %.1fx faster (%d runs)\n", mapTotal > 0.0 ? objTotal / mapTotal : 0.0, loops);
+    return true;
+}
+
+
+// Uploads one dense prism in the float and in the compact vertex format and times drawing each
+// with GPU timer queries, to show what the smaller vertices save in memory and bandwidth
+bool UBenchmarkVertexFormats()
+{
+    GLuint programId;
+    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, programId))
+        return false;
+
+    MeshData data;
+    UCreatePrismMesh(data, gOptions.sides, 0.25f, 0.02f);
+
+    const Vertex_Format formats[2] = { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_COMPACT };
+    const char* const formatNames[2] = { "float", "compact" };
+    GLMesh meshes[2];
+    double gpuMs[2] = { 0.0, 0.0 };
+    int loops = gOptions.loops > 0 ? gOptions.loops : 1;
+
+    // looking straight down at the prism so every triangle is rasterized
+    glm::mat4 model = glm::rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::mat4 view = glm::translate(glm::vec3(0.0f, 0.0f, -1.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+
+    glUseProgram(programId);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glEnable(GL_DEPTH_TEST);
+
+    // no instance buffer here: the per-instance attributes stay disabled and these constants apply to every vertex
+    for (GLuint column = 0; column < 4; column++)
+        glVertexAttrib4fv(INSTANCE_MODEL_LOCATION + column, glm::value_ptr(model[column]));
+    glVertexAttribI4i(INSTANCE_MATERIAL_LOCATION, 0, 0, 0, 0);
+    glVertexAttribI4i(INSTANCE_HIGHLIGHT_LOCATION, 0, 0, 0, 0);
+    Material material;
+    GLuint materialBuffer = GpuResources::Instance().CreateBuffer(GPU_MATERIALS, "benchmark material");
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, materialBuffer);
+    GpuResources::Instance().BufferData(GL_SHADER_STORAGE_BUFFER, materialBuffer, sizeof(material), &material, GL_STATIC_DRAW);
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    for (int f = 0; f < 2; f++)
+    {
+        UUploadMesh(data, meshes[f], formats[f]);
+        glBindVertexArray(meshes[f].vao);
+        USetMeshUniforms(programId, meshes[f]);
+
+        // one untimed draw so buffer residency is not part of the measurement
+        glDrawElements(GL_TRIANGLES, meshes[f].nIndices, meshes[f].indexType, NULL);
+        glFinish();
+
+        for (int i = 0; i < loops; i++)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            glDrawElements(GL_TRIANGLES, meshes[f].nIndices, meshes[f].indexType, NULL);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            gpuMs[f] += elapsed / 1e6;
+        }
+        gpuMs[f] /= loops;
+        glBindVertexArray(0);
+    }
+
+    glDeleteQueries(1, &query);
+    GpuResources::Instance().Release(GPU_BUFFER, materialBuffer);
+
+    UReport("%u vertices, %u triangles, %d draws per format\n", (unsigned)data.Positions.size(),
+        (unsigned)(data.Indices.size() / 3), loops);
+    UReport("%-8s %12s %12s %12s\n", "format", "bytes/vert", "vertex MB", "GPU ms");
+    for (int f = 0; f < 2; f++)
+    {
+        UReport("%-8s %12.1f %12.2f %12.3f\n", formatNames[f], (double)meshes[f].vertexBytes / data.Positions.size(),
+            meshes[f].vertexBytes / (1024.0 * 1024.0), gpuMs[f]);
+    }
+    UReport("compact / float: %.2fx memory, %.2fx GPU time\n", (double)meshes[1].vertexBytes / meshes[0].vertexBytes,
+        gpuMs[0] > 0.0 ? gpuMs[1] / gpuMs[0] : 0.0);
+
+    UDestroyMesh(meshes[0]);
+    UDestroyMesh(meshes[1]);
+    UDestroyShaderProgram(programId);
+    return true;
+}
+
+
+// Renders one orbit around the scene with the software rasterizer, on every thread and on one, and with the
+// GL implementation, and compares their throughput and images. On Mesa without a GPU (or with
+// LIBGL_ALWAYS_SOFTWARE=1, which this mode sets unless it is already set) the GL side is llvmpipe.
+bool UBenchmarkSoftware()
+{
+    const int width = WINDOW_WIDTH;
+    const int height = WINDOW_HEIGHT;
+    int loops = gOptions.loops > 0 ? gOptions.loops : 1;
+    typedef std::chrono::steady_clock Clock;
+
+    // every frame is built up front so only rendering is timed
+    std::vector<FramePacket> packets(loops);
+    for (int i = 0; i < loops; i++)
+    {
+        float angle = 360.0f * i / loops;
+        CameraSample sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.Position[0] = 3.0f * std::cos(glm::radians(angle));
+        sample.Position[1] = 0.5f;
+        sample.Position[2] = 3.0f * std::sin(glm::radians(angle));
+        sample.Yaw = angle + 180.0f;
+        sample.Pitch = -glm::degrees(std::atan2(0.5f, 3.0f));
+        sample.Zoom = 45.0f;
+        UApplyCameraSample(sample);
+        UBuildFramePacket(packets[i], width, height, 1.0f);
+    }
+
+    // software: all threads, then one
+    const int threadCounts[2] = { gOptions.softwareThreads, 1 };
+    double softwareMs[2] = { 0.0, 0.0 };
+    int softwareThreads[2] = { 0, 0 };
+    SoftStats phases;
+    double triangles = 0.0;
+    std::vector<unsigned char> softwareImage;
+    for (int run = 0; run < 2; run++)
+    {
+        gSoftRenderer.Start(threadCounts[run]);
+        gSoftRenderer.SetMaterials(gMaterials);
+        softwareThreads[run] = gSoftRenderer.ThreadCount();
+        USoftwareRenderScene(packets[0]);   // allocates the buffers
+
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < loops; i++)
+        {
+            USoftwareRenderScene(packets[i]);
+            if (run == 0)
+            {
+                triangles += gFrameStats.triangles;
+                phases.VertexMs += gSoftRenderer.Stats.VertexMs;
+                phases.BinMs += gSoftRenderer.Stats.BinMs;
+                phases.RasterMs += gSoftRenderer.Stats.RasterMs;
+                phases.ShadedPixels += gSoftRenderer.Stats.ShadedPixels;
+                phases.RejectedBlocks += gSoftRenderer.Stats.RejectedBlocks;
+            }
+        }
+        softwareMs[run] = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / loops;
+        if (run == 0)
+            gSoftRenderer.ReadPixels(softwareImage);
+        gSoftRenderer.Stop();
+    }
+
+    // GL, waiting for every frame as the software renderer does
+    RenderTarget target;
+    if (!target.Resize(width, height))
+    {
+        LOG(LOG_ERROR, "Failed to create a %dx%d render target", width, height);
+        return false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, target.Framebuffer);
+    glViewport(0, 0, width, height);
+    URenderScene(packets[0]);
+    glFinish();
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < loops; i++)
+    {
+        URenderScene(packets[i]);
+        glFinish();
+    }
+    double glMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / loops;
+
+    std::vector<unsigned char> glImage((size_t)width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, glImage.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.Destroy();
+
+    // both last frames should agree up to filtering and rounding differences
+    double difference = 0.0;
+    int largest = 0;
+    for (size_t i = 0; i < glImage.size(); i++)
+    {
+        if (i % 4 == 3)
+            continue;
+        int d = abs((int)glImage[i] - (int)softwareImage[i]);
+        difference += d;
+        largest = glm::max(largest, d);
+    }
+    difference /= (double)width * height * 3;
+
+    const char* glRenderer = (const char*)glGetString(GL_RENDERER);
+    double pixels = (double)width * height;
+    triangles /= loops;
+    UReport("%d frames at %dx%d, %.0f triangles per frame; GL renderer: %s\n", loops, width, height, triangles,
+        glRenderer != nullptr ? glRenderer : "unknown");
+    UReport("%-24s %12s %12s %12s\n", "renderer", "ms/frame", "Mpixels/s", "Mtriangles/s");
+    for (int run = 0; run < 2; run++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "software, %d thread%s", softwareThreads[run], softwareThreads[run] == 1 ? "" : "s");
+        UReport("%-24s %12.3f %12.1f %12.2f\n", name, softwareMs[run], pixels / softwareMs[run] / 1000.0, triangles / softwareMs[run] / 1000.0);
+    }
+    UReport("%-24s %12.3f %12.1f %12.2f\n", "GL", glMs, pixels / glMs / 1000.0, triangles / glMs / 1000.0);
+    UReport("software per frame: vertices %.3f ms, setup and binning %.3f ms, tiles %.3f ms; %.0f pixels shaded, %.0f blocks skipped by depth\n",
+        phases.VertexMs / loops, phases.BinMs / loops, phases.RasterMs / loops, (double)phases.ShadedPixels / loops,
+        (double)phases.RejectedBlocks / loops);
+    UReport("software / GL: %.2fx the frame time; last frame differs by %.2f on average, %d at most (of 255)\n",
+        glMs > 0.0 ? softwareMs[0] / glMs : 0.0, difference, largest);
+    if (glRenderer == nullptr || strstr(glRenderer, "llvmpipe") == nullptr)
+        UReport("note: GL is not llvmpipe here, so this compares against the GPU driver instead\n");
+    return true;
+}
+
+
+// Sweeps the generated scene over object count, light count and resolution, one at a time around a
+// middle configuration, rendering an orbit offscreen for each. Prints frame time (update, submission
+// and GPU work), draw calls and memory, and writes them to the --bench-scaling file. With --baseline,
+// a configuration that got slower or larger than its baseline by more than --tolerance, or that
+// issues more draws, fails the run.
+bool UBenchmarkScaling()
+{
+    struct ScalingCase
+    {
+        int tables;
+        int lights;
+        int width;
+        int height;
+    };
+    const ScalingCase cases[] = {
+        { 1, 1, 1280, 720 }, { 4, 1, 1280, 720 }, { 16, 1, 1280, 720 }, { 64, 1, 1280, 720 }, { 256, 1, 1280, 720 },
+        { 16, 2, 1280, 720 }, { 16, 4, 1280, 720 }, { 16, 8, 1280, 720 },
+        { 16, 1, 640, 360 }, { 16, 1, 1920, 1080 }, { 16, 1, 2560, 1440 }
+    };
+    const int caseCount = sizeof(cases) / sizeof(cases[0]);
+
+    std::vector<ScalingResult> baseline;
+    if (gOptions.baselinePath != nullptr && !ScalingLoadCsv(gOptions.baselinePath, baseline))
+    {
+        LOG(LOG_ERROR, "Failed to read the scaling baseline %s", gOptions.baselinePath);
+        return false;
+    }
+
+    int loops = gOptions.loops > 0 ? gOptions.loops : 1;
+    double tolerance = gOptions.tolerance / 100.0;
+    typedef std::chrono::steady_clock Clock;
+
+    UReport("%d frames per configuration, %d plates per table, %d items per plate, seed %u\n", loops, gOptions.stressPlates,
+        gOptions.stressItems, gOptions.seed);
+    UReport("%-22s %8s %6s %10s %9s %9s %7s %9s %10s %8s %8s  %s\n", "configuration", "objects", "lights", "size", "avg ms",
+        "p95 ms", "draws", "instances", "triangles", "GPU MB", "RSS MB", "vs baseline");
+
+    std::vector<ScalingResult> results;
+    int regressions = 0;
+    RenderTarget target;
+    FramePacket packet;
+    for (int c = 0; c < caseCount; c++)
+    {
+        const ScalingCase& config = cases[c];
+        UCreateStressScene(config.tables, gOptions.stressPlates, gOptions.stressItems, config.lights);
+        if (!target.Resize(config.width, config.height))
+        {
+            LOG(LOG_ERROR, "Failed to create a %dx%d render target", config.width, config.height);
+            return false;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, target.Framebuffer);
+        glViewport(0, 0, config.width, config.height);
+
+        // one orbit around the tables; the first frame is not timed
+        float radius = StressSceneRadius(gStressDesc);
+        FrameTimings timings;
+        ScalingResult result;
+        for (int i = -1; i < loops; i++)
+        {
+            float angle = 360.0f * glm::max(i, 0) / loops;
+            CameraSample sample;
+            memset(&sample, 0, sizeof(sample));
+            sample.Position[0] = radius * 1.2f * std::cos(glm::radians(angle));
+            sample.Position[1] = radius * 0.6f;
+            sample.Position[2] = radius * 1.2f * std::sin(glm::radians(angle));
+            sample.Yaw = angle + 180.0f;
+            sample.Pitch = -glm::degrees(std::atan2(0.6f, 1.2f));
+            sample.Zoom = 45.0f;
+            UApplyCameraSample(sample);
+
+            Clock::time_point start = Clock::now();
+            UBuildFramePacket(packet, config.width, config.height, 1.0f);
+            URenderScene(packet);
+            glFinish();
+            if (i < 0)
+                continue;
+            timings.Add(std::chrono::duration<float, std::milli>(Clock::now() - start).count());
+            result.Draws += gFrameStats.draws;
+            result.Instances += gFrameStats.instances;
+            result.Triangles += gFrameStats.triangles;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "t%d_l%d_%dx%d", config.tables, config.lights, config.width, config.height);
+        result.Name = name;
+        result.Objects = (int)gStressObjects.size();
+        result.Lights = config.lights;
+        result.Width = config.width;
+        result.Height = config.height;
+        result.FrameMs = timings.Average();
+        result.P95Ms = timings.Percentile(95.0f);
+        result.Draws /= loops;
+        result.Instances /= loops;
+        result.Triangles /= loops;
+        result.GpuMB = GpuResources::Instance().Total() / (1024.0 * 1024.0);
+        result.ProcessMB = ScalingProcessMB();
+        results.push_back(result);
+
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", config.width, config.height);
+        std::string verdict = "new";
+        for (size_t b = 0; b < baseline.size(); b++)
+        {
+            if (baseline[b].Name != result.Name)
+                continue;
+            std::string reason;
+            if (ScalingCompare(result, baseline[b], tolerance, reason))
+            {
+                char change[32];
+                snprintf(change, sizeof(change), "%+.1f%%", 100.0 * (result.FrameMs / glm::max(baseline[b].FrameMs, 1e-6) - 1.0));
+                verdict = change;
+            }
+            else
+            {
+                verdict = "REGRESSION: " + reason;
+                regressions++;
+            }
+        }
+        UReport("%-22s %8d %6d %10s %9.3f %9.3f %7.0f %9.0f %10.0f %8.2f %8.1f  %s\n", result.Name.c_str(), result.Objects,
+            result.Lights, size, result.FrameMs, result.P95Ms, result.Draws, result.Instances, result.Triangles, result.GpuMB,
+            result.ProcessMB, gOptions.baselinePath != nullptr ? verdict.c_str() : "");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.Destroy();
+    gStressObjects.clear();
+    gStressLights.clear();
+
+    bool written = ScalingWriteCsv(gOptions.benchScalingPath, results);
+    if (!written)
+        LOG(LOG_ERROR, "Failed to write scaling results to %s", gOptions.benchScalingPath);
+    if (gOptions.baselinePath != nullptr)
+    {
+        UReport("%d of %d configurations regressed against %s (tolerance %.0f%%)\n", regressions, caseCount, gOptions.baselinePath,
+            gOptions.tolerance);
+    }
+    return written && regressions == 0;
+}
+
+
+// Times picking on generated scenes of about a thousand, ten thousand and a hundred thousand objects:
+// building the object BVH, refitting all of it and refitting after 1% of the objects moved, and rays
+// from random points of the window, which are checked against testing every object. Then the triangle
+// BVH of a prism of --sides sides.
+bool UBenchmarkPicking()
+{
+    const int tableCounts[3] = { 25, 250, 2500 };
+    int queries = (gOptions.loops > 0 ? gOptions.loops : 1) * 100;
+    typedef std::chrono::steady_clock Clock;
+    auto elapsedMs = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+    std::mt19937 rng(gOptions.seed);
+
+    // a mesh file's BVH would otherwise still be building in the background while queries are timed
+    gMeshBvhBuilder.Wait();
+
+    UReport("%d queries per scene, %d plates per table, %d items per plate, seed %u\n", queries, gOptions.stressPlates,
+        gOptions.stressItems, gOptions.seed);
+    UReport("%-8s %8s %8s %9s %9s %9s %9s %9s %6s %10s\n", "tables", "objects", "nodes", "build ms", "refit ms", "1% refit",
+        "us/query", "us/brute", "hit %", "mismatches");
+
+    int mismatches = 0;
+    FramePacket packet;
+    for (int s = 0; s < 3; s++)
+    {
+        // placing the scene once fills gSceneObjects and gSceneBounds; each step below is then timed on its own
+        UCreateStressScene(tableCounts[s], gOptions.stressPlates, gOptions.stressItems, 1);
+        float radius = StressSceneRadius(gStressDesc);
+        CameraSample sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.Position[1] = radius * 0.6f;
+        sample.Position[2] = radius * 1.2f;
+        sample.Yaw = -90.0f;
+        sample.Pitch = -glm::degrees(std::atan2(0.6f, 1.2f));
+        sample.Zoom = 45.0f;
+        UApplyCameraSample(sample);
+        UBuildFramePacket(packet, WINDOW_WIDTH, WINDOW_HEIGHT, 1.0f);
+
+        Clock::time_point start = Clock::now();
+        gSceneBvh.Build(gSceneBounds);
+        double buildMs = elapsedMs(start);
+        start = Clock::now();
+        gSceneBvh.Refit(gSceneBounds);
+        double refitMs = elapsedMs(start);
+
+        double queryMs = 0.0, bruteMs = 0.0;
+        int hits = 0;
+        for (int q = 0; q < queries; q++)
+        {
+            BvhRay ray = UCursorRay(packet, StressRange(rng, -1.0f, 1.0f), StressRange(rng, -1.0f, 1.0f));
+            float t = 1.0f;
+            uint32_t triangle = 0;
+            start = Clock::now();
+            int object = UPickObject(ray, t, triangle);
+            queryMs += elapsedMs(start);
+
+            float bruteT = 1.0f;
+            int bruteObject = -1;
+            start = Clock::now();
+            for (size_t o = 0; o < gSceneObjects.size(); o++)
+            {
+                const SceneObject& candidate = gSceneObjects[o];
+                if (BvhRayBox(ray, gSceneBounds[o].Min, gSceneBounds[o].Max, bruteT) == FLT_MAX)
+                    continue;
+                BvhRay local(glm::vec3(candidate.inverse * glm::vec4(ray.Origin, 1.0f)),
+                    glm::vec3(candidate.inverse * glm::vec4(ray.Direction, 0.0f)));
+                uint32_t bruteTriangle;
+                if (UMeshBvh(*candidate.mesh)->Intersect(local, bruteT, bruteTriangle))
+                    bruteObject = (int)o;
+            }
+            bruteMs += elapsedMs(start);
+
+            // objects touching at the hit point may both be right
+            hits += object >= 0;
+            if ((object >= 0) != (bruteObject >= 0) || (object != bruteObject && t != bruteT))
+                mismatches++;
+        }
+
+        // every hundredth object lifted a little, as if it had been moved
+        std::vector<uint32_t> moved;
+        start = Clock::now();
+        for (size_t o = 0; o < gSceneBounds.size(); o += 100)
+        {
+            gSceneBounds[o].Min.y += 0.01f;
+            gSceneBounds[o].Max.y += 0.01f;
+            moved.push_back((uint32_t)o);
+        }
+        gSceneBvh.Refit(gSceneBounds, moved);
+        double movedMs = elapsedMs(start);
+
+        UReport("%-8d %8u %8u %9.3f %9.3f %9.3f %9.2f %9.2f %6.1f %10d\n", tableCounts[s], (unsigned)gSceneObjects.size(),
+            (unsigned)gSceneBvh.Nodes.size(), buildMs, refitMs, movedMs, queryMs * 1000.0 / queries, bruteMs * 1000.0 / queries,
+            100.0 * hits / queries, mismatches);
+    }
+    gStressObjects.clear();
+    gStressLights.clear();
+
+    // a dense mesh, hit by rays from random points around it aimed at random points inside its box
+    MeshData data;
+    UCreatePrismMesh(data, gOptions.sides, 0.25f, 0.02f);
+    MeshBvh mesh;
+    Clock::time_point start = Clock::now();
+    mesh.Build(data.Positions, data.Indices, 0, (uint32_t)data.Indices.size());
+    double buildMs = elapsedMs(start);
+
+    BvhBounds box = mesh.Bounds();
+    glm::vec3 center = box.Center();
+    float reach = glm::length(box.Max - box.Min);
+    double queryMs = 0.0;
+    int hits = 0;
+    for (int q = 0; q < queries; q++)
+    {
+        glm::vec3 from = center + glm::normalize(glm::vec3(StressRange(rng, -1.0f, 1.0f), StressRange(rng, -1.0f, 1.0f),
+            StressRange(rng, -1.0f, 1.0f))) * reach;
+        glm::vec3 to(StressRange(rng, box.Min.x, box.Max.x), StressRange(rng, box.Min.y, box.Max.y), StressRange(rng, box.Min.z, box.Max.z));
+        float t = FLT_MAX;
+        uint32_t triangle;
+        start = Clock::now();
+        hits += mesh.Intersect(BvhRay(from, to - from), t, triangle);
+        queryMs += elapsedMs(start);
+    }
+    UReport("\n%-8s %10s %8s %9s %9s %6s\n", "mesh", "triangles", "nodes", "build ms", "us/query", "hit %");
+    UReport("%-8s %10u %8u %9.3f %9.2f %6.1f\n", "prism", mesh.TriangleCount(), (unsigned)mesh.Tree().Nodes.size(), buildMs,
+        queryMs * 1000.0 / queries, 100.0 * hits / queries);
+
+    if (mismatches > 0)
+        LOG(LOG_ERROR, "%d picks disagreed with testing every object", mismatches);
+    return mismatches == 0;
+}
+
+
+// Reports post-transform cache efficiency of a mesh before and after the optimizer, for a few cache
+// sizes, so the gain can be checked on dense meshes without a GPU
+bool UBenchmarkMeshOptimize()
+{
+    MeshData data;
+    if (strcmp(gOptions.benchOptimizePath, "prism") == 0)
+        UCreatePrismMesh(data, gOptions.sides, 0.25f, 0.02f);
+    else
+    {
+        MeshFileSource source;
+        ObjImporter importer;
+        if (!importer.Load(gOptions.benchOptimizePath, source))
+        {
+            LOG(LOG_ERROR, "Failed to read %s", gOptions.benchOptimizePath);
+            return false;
+        }
+        MeshDataFromSource(source, data);
+    }
+
+    const int cacheSizes[3] = { 8, MESH_OPT_CACHE_SIZE, 32 };
+    VertexCacheStats before[3];
+    for (int c = 0; c < 3; c++)
+        before[c] = AnalyzeVertexCache(data.Indices, data.Positions.size(), cacheSizes[c]);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    MeshOptimizeStats stats = OptimizeMesh(data, gOptions.overdrawSort);
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    UReport("%u vertices, %u triangles, optimized in %.1f ms (%d overdraw clusters)\n", (unsigned)data.Positions.size(),
+        (unsigned)(data.Indices.size() / 3), seconds * 1000.0, stats.Clusters);
+    UReport("%-6s %12s %12s %12s %12s\n", "cache", "ACMR before", "ACMR after", "ATVR before", "ATVR after");
+    for (int c = 0; c < 3; c++)
+    {
+        VertexCacheStats after = AnalyzeVertexCache(data.Indices, data.Positions.size(), cacheSizes[c]);
+        UReport("%-6d %12.3f %12.3f %12.3f %12.3f\n", cacheSizes[c], before[c].ACMR, after.ACMR, before[c].ATVR, after.ATVR);
+    }
+    return true;
+}
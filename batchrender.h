@@ -0,0 +1,194 @@
+#ifndef BATCHRENDER_H
+#define BATCHRENDER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "gpuresources.h"
+#include "recording.h"
+
+// Batch rendering settings
+const int BATCH_READBACK_SLOTS = 3;             // pixel pack buffers in flight
+const GLuint64 BATCH_FENCE_TIMEOUT = 100000000; // nanoseconds per fence wait call (waits repeat until the read is done)
+
+// One image to render: a camera (as in recordings) and an output size
+struct BatchPose
+{
+    CameraSample Camera;
+    int Width;
+    int Height;
+};
+
+// Reads a pose list. Blank lines and lines starting with # are skipped, every other line is either
+//   <width> <height> <x> <y> <z> <yaw> <pitch> [zoom]
+// for a single camera, or
+//   turntable <frames> <width> <height> <radius> <height above the origin>
+// for frames cameras evenly spaced on a circle around the y axis, all looking at the origin.
+inline bool BatchLoadPoses(const char* path, std::vector<BatchPose>& poses)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+        return false;
+
+    bool valid = true;
+    char line[512];
+    while (valid && fgets(line, sizeof(line), file) != nullptr)
+    {
+        const char* text = line;
+        while (*text == ' ' || *text == '\t')
+            text++;
+        if (*text == '#' || *text == '\n' || *text == '\r' || *text == '\0')
+            continue;
+
+        BatchPose pose;
+        memset(&pose, 0, sizeof(pose));
+        pose.Camera.Zoom = 45.0f;
+
+        int frames;
+        float radius, elevation;
+        if (strncmp(text, "turntable", 9) == 0)
+        {
+            valid = sscanf(text + 9, "%d %d %d %f %f", &frames, &pose.Width, &pose.Height, &radius, &elevation) == 5 && frames > 0;
+            for (int i = 0; valid && i < frames; i++)
+            {
+                // yaw 0 looks down +x, so a camera at angle a looks back along a + 180 degrees
+                float angle = 360.0f * i / frames;
+                float radians = angle * 3.14159265f / 180.0f;
+                pose.Camera.Time = (float)poses.size();
+                pose.Camera.Position[0] = radius * std::cos(radians);
+                pose.Camera.Position[1] = elevation;
+                pose.Camera.Position[2] = radius * std::sin(radians);
+                pose.Camera.Yaw = angle + 180.0f;
+                pose.Camera.Pitch = -std::atan2(elevation, radius) * 180.0f / 3.14159265f;
+                poses.push_back(pose);
+            }
+        }
+        else
+        {
+            int fields = sscanf(text, "%d %d %f %f %f %f %f %f", &pose.Width, &pose.Height, &pose.Camera.Position[0],
+                &pose.Camera.Position[1], &pose.Camera.Position[2], &pose.Camera.Yaw, &pose.Camera.Pitch, &pose.Camera.Zoom);
+            valid = fields >= 7;
+            pose.Camera.Time = (float)poses.size();
+            if (valid)
+                poses.push_back(pose);
+        }
+        valid = valid && pose.Width > 0 && pose.Height > 0;
+    }
+
+    fclose(file);
+    return valid && !poses.empty();
+}
+
+// Asynchronous framebuffer readback through a ring of pixel pack buffers. glReadPixels into a bound
+// pack buffer returns at once; a fence marks when the copy is done, and the pixels are only mapped
+// once a later read needs the buffer again, by which time the GPU has long finished.
+class PixelReadback
+{
+public:
+    double WaitSeconds = 0.0;   // time spent waiting on fences (0 when the ring is deep enough)
+
+    void Create(int slotCount)
+    {
+        slots.assign(slotCount, Slot());
+        for (size_t i = 0; i < slots.size(); i++)
+            slots[i].Buffer = GpuResources::Instance().CreateBuffer(GPU_READBACK, "readback");
+        next = 0;
+    }
+
+    void Destroy()
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].Fence != 0)
+                glDeleteSync(slots[i].Fence);
+            GpuResources::Instance().Release(GPU_BUFFER, slots[i].Buffer);
+        }
+        slots.clear();
+    }
+
+    // Starts reading the lower left width x height RGBA pixels of the bound read framebuffer. If the
+    // slot this reuses still holds an earlier read, that read is finished first and handed to
+    // done(tag, width, height, pixels), bottom row first.
+    template <typename Done>
+    void Read(int width, int height, int tag, Done done)
+    {
+        Slot& slot = slots[next];
+        next = (next + 1) % slots.size();
+        if (slot.Fence != 0)
+            Finish(slot, done);
+
+        size_t size = (size_t)width * height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+        if (size > slot.Capacity)
+        {
+            GpuResources::Instance().BufferData(GL_PIXEL_PACK_BUFFER, slot.Buffer, size, NULL, GL_STREAM_READ);
+            slot.Capacity = size;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.Width = width;
+        slot.Height = height;
+        slot.Tag = tag;
+    }
+
+    // finishes every read still in flight, oldest first
+    template <typename Done>
+    void Flush(Done done)
+    {
+        for (size_t n = 0; n < slots.size(); n++)
+        {
+            Slot& slot = slots[(next + n) % slots.size()];
+            if (slot.Fence != 0)
+                Finish(slot, done);
+        }
+    }
+
+private:
+    struct Slot
+    {
+        GLuint Buffer = 0;
+        size_t Capacity = 0;
+        GLsync Fence = 0;
+        int Width = 0;
+        int Height = 0;
+        int Tag = 0;
+    };
+
+    std::vector<Slot> slots;
+    size_t next = 0;
+
+    template <typename Done>
+    void Finish(Slot& slot, Done done)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (glClientWaitSync(slot.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, BATCH_FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED)
+            ;
+        WaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        glDeleteSync(slot.Fence);
+        slot.Fence = 0;
+
+        size_t size = (size_t)slot.Width * slot.Height * 4;
+        std::vector<unsigned char> pixels(size);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (mapped != nullptr)
+        {
+            memcpy(pixels.data(), mapped, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (mapped != nullptr)
+            done(slot.Tag, slot.Width, slot.Height, pixels);
+    }
+};
+
+#endif
@@ -0,0 +1,493 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// BVH build settings
+const int BVH_BINS = 16;                // candidate split planes per axis: bins across the centroid bounds
+const uint32_t BVH_MAX_LEAF = 4;        // primitives a leaf may hold, unless they cannot be told apart
+const float BVH_NODE_COST = 1.0f;       // SAH cost of visiting a node, relative to testing one primitive
+const int BVH_MAX_DEPTH = 64;           // deeper nodes become leaves, which bounds the traversal stack
+const float BVH_REBUILD_RATIO = 1.5f;   // refits may raise the SAH cost this much before NeedsRebuild says so
+
+// Axis aligned box; a default constructed one is empty and grows to whatever is added
+struct BvhBounds
+{
+    glm::vec3 Min = glm::vec3(FLT_MAX);
+    glm::vec3 Max = glm::vec3(-FLT_MAX);
+
+    void Grow(const glm::vec3& point)
+    {
+        Min = glm::min(Min, point);
+        Max = glm::max(Max, point);
+    }
+
+    void Grow(const BvhBounds& bounds)
+    {
+        Min = glm::min(Min, bounds.Min);
+        Max = glm::max(Max, bounds.Max);
+    }
+
+    bool Empty() const { return Min.x > Max.x; }
+    glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+
+    // half the surface area; the SAH only compares areas
+    float Area() const
+    {
+        if (Empty())
+            return 0.0f;
+        glm::vec3 extent = Max - Min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+};
+
+// Box around bounds after an affine transform (the center moves, the extent goes through |matrix|)
+inline BvhBounds BvhTransformBounds(const glm::mat4& transform, const BvhBounds& bounds)
+{
+    glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.Center(), 1.0f));
+    glm::vec3 half = (bounds.Max - bounds.Min) * 0.5f;
+    glm::vec3 extent = glm::abs(glm::vec3(transform[0])) * half.x + glm::abs(glm::vec3(transform[1])) * half.y
+        + glm::abs(glm::vec3(transform[2])) * half.z;
+    BvhBounds result;
+    result.Min = center - extent;
+    result.Max = center + extent;
+    return result;
+}
+
+// Origin + t * Direction; Direction need not be unit length, distances are in multiples of it
+struct BvhRay
+{
+    glm::vec3 Origin;
+    glm::vec3 Direction;
+    glm::vec3 InvDirection;     // zero components are nudged off zero so the slab test never computes 0 * inf
+
+    BvhRay() {}
+    BvhRay(const glm::vec3& origin, const glm::vec3& direction) : Origin(origin), Direction(direction)
+    {
+        for (int c = 0; c < 3; c++)
+            InvDirection[c] = 1.0f / (direction[c] != 0.0f ? direction[c] : 1e-30f);
+    }
+};
+
+// Distance at which the ray enters the box, or FLT_MAX if it misses it before tMax
+inline float BvhRayBox(const BvhRay& ray, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax)
+{
+    glm::vec3 t0 = (boxMin - ray.Origin) * ray.InvDirection;
+    glm::vec3 t1 = (boxMax - ray.Origin) * ray.InvDirection;
+    glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+// 32 bytes, two to a cache line
+struct BvhNode
+{
+    glm::vec3 Min;
+    uint32_t First;     // leaf: first entry of Bvh::Indices; inner node: left child, the right one follows it
+    glm::vec3 Max;
+    uint32_t Count;     // primitives of a leaf, 0 for an inner node
+};
+
+// Bounding volume hierarchy over boxes, built top down with the surface area heuristic evaluated at
+// BVH_BINS planes per axis. When boxes move, Refit updates the node bounds in place (all of them, or
+// only the paths above the boxes that changed); the tree keeps its shape, so it slowly loses quality
+// and NeedsRebuild tells when a fresh Build pays off.
+class Bvh
+{
+public:
+    std::vector<BvhNode> Nodes;     // root first; children always come after their parent
+    std::vector<uint32_t> Indices;  // primitive indices, grouped by leaf
+
+    void Build(const std::vector<BvhBounds>& bounds)
+    {
+        uint32_t count = (uint32_t)bounds.size();
+        Indices.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            Indices[i] = i;
+        centers.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            centers[i] = bounds[i].Center();
+
+        Nodes.clear();
+        parents.clear();
+        Nodes.reserve(count > 0 ? 2 * count - 1 : 1);
+        parents.reserve(Nodes.capacity());
+        BvhNode root;
+        root.First = 0;
+        root.Count = count;
+        Nodes.push_back(root);
+        parents.push_back(UINT32_MAX);
+
+        struct Pending
+        {
+            uint32_t Node;
+            int Depth;
+        };
+        std::vector<Pending> pending(1, Pending{ 0, 0 });
+        while (!pending.empty())
+        {
+            Pending next = pending.back();
+            pending.pop_back();
+            uint32_t left;
+            if (Split(next.Node, next.Depth, bounds, left))
+            {
+                pending.push_back(Pending{ left, next.Depth + 1 });
+                pending.push_back(Pending{ left + 1, next.Depth + 1 });
+            }
+        }
+
+        leafOf.assign(count, 0);
+        for (uint32_t n = 0; n < Nodes.size(); n++)
+        {
+            for (uint32_t i = 0; i < Nodes[n].Count; i++)
+                leafOf[Indices[Nodes[n].First + i]] = n;
+        }
+        buildCost = Cost();
+    }
+
+    // bounds of every primitive changed
+    void Refit(const std::vector<BvhBounds>& bounds)
+    {
+        for (size_t n = Nodes.size(); n-- > 0;)
+            RefitNode((uint32_t)n, bounds);
+    }
+
+    // only the listed primitives changed: walks up from their leaves, stopping where a node's bounds
+    // come out the same as before
+    void Refit(const std::vector<BvhBounds>& bounds, const std::vector<uint32_t>& changed)
+    {
+        for (size_t i = 0; i < changed.size(); i++)
+        {
+            for (uint32_t n = leafOf[changed[i]]; n != UINT32_MAX; n = parents[n])
+            {
+                if (!RefitNode(n, bounds))
+                    break;
+            }
+        }
+    }
+
+    // SAH cost of the tree: expected node visits and primitive tests of a random ray through the root
+    float Cost() const
+    {
+        if (Nodes.empty() || Area(Nodes[0]) <= 0.0f)
+            return 0.0f;
+        float cost = 0.0f;
+        for (size_t n = 0; n < Nodes.size(); n++)
+            cost += Area(Nodes[n]) * (Nodes[n].Count > 0 ? (float)Nodes[n].Count : BVH_NODE_COST);
+        return cost / Area(Nodes[0]);
+    }
+
+    bool NeedsRebuild() const { return Cost() > buildCost * BVH_REBUILD_RATIO; }
+
+    int Depth() const
+    {
+        std::vector<int> depths(Nodes.size(), 0);
+        int deepest = 0;
+        for (size_t n = 1; n < Nodes.size(); n++)
+        {
+            depths[n] = depths[parents[n]] + 1;
+            deepest = std::max(deepest, depths[n]);
+        }
+        return deepest;
+    }
+
+    // Visits the leaves the ray passes through, nearest first. hit(primitive, tMax) tests one primitive
+    // and, when the ray meets it before tMax, lowers tMax to the distance and returns true; farther
+    // subtrees are then skipped. Returns whether anything was hit.
+    template <typename Hit>
+    bool Intersect(const BvhRay& ray, float& tMax, Hit hit) const
+    {
+        if (Indices.empty() || BvhRayBox(ray, Nodes[0].Min, Nodes[0].Max, tMax) == FLT_MAX)
+            return false;
+
+        struct Entry
+        {
+            uint32_t Node;
+            float Distance;
+        };
+        Entry stack[BVH_MAX_DEPTH + 1];
+        int size = 0;
+        uint32_t node = 0;
+        bool found = false;
+        for (;;)
+        {
+            const BvhNode& current = Nodes[node];
+            if (current.Count > 0)
+            {
+                for (uint32_t i = 0; i < current.Count; i++)
+                    found |= hit(Indices[current.First + i], tMax);
+            }
+            else
+            {
+                // the nearer child next, the farther one waits
+                uint32_t a = current.First, b = current.First + 1;
+                float ta = BvhRayBox(ray, Nodes[a].Min, Nodes[a].Max, tMax);
+                float tb = BvhRayBox(ray, Nodes[b].Min, Nodes[b].Max, tMax);
+                if (tb < ta)
+                {
+                    std::swap(a, b);
+                    std::swap(ta, tb);
+                }
+                if (ta != FLT_MAX)
+                {
+                    if (tb != FLT_MAX)
+                        stack[size++] = Entry{ b, tb };
+                    node = a;
+                    continue;
+                }
+            }
+
+            // back to the nearest waiting subtree that a hit has not moved out of reach
+            for (;;)
+            {
+                if (size == 0)
+                    return found;
+                Entry entry = stack[--size];
+                if (entry.Distance <= tMax)
+                {
+                    node = entry.Node;
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> leafOf;       // leaf holding each primitive
+    std::vector<glm::vec3> centers;     // build scratch
+    float buildCost = 0.0f;
+
+    static float Area(const BvhNode& node)
+    {
+        BvhBounds bounds;
+        bounds.Min = node.Min;
+        bounds.Max = node.Max;
+        return bounds.Area();
+    }
+
+    // recomputes one node from its primitives or children; false if its bounds did not change
+    bool RefitNode(uint32_t n, const std::vector<BvhBounds>& bounds)
+    {
+        BvhNode& node = Nodes[n];
+        BvhBounds box;
+        if (node.Count > 0)
+        {
+            for (uint32_t i = 0; i < node.Count; i++)
+                box.Grow(bounds[Indices[node.First + i]]);
+        }
+        else
+        {
+            for (uint32_t c = node.First; c < node.First + 2; c++)
+            {
+                box.Min = glm::min(box.Min, Nodes[c].Min);
+                box.Max = glm::max(box.Max, Nodes[c].Max);
+            }
+        }
+        bool changed = box.Min != node.Min || box.Max != node.Max;
+        node.Min = box.Min;
+        node.Max = box.Max;
+        return changed;
+    }
+
+    // sets the node's bounds and splits it if that is cheaper than a leaf by the SAH; left receives the
+    // first of the two new children
+    bool Split(uint32_t n, int depth, const std::vector<BvhBounds>& bounds, uint32_t& left)
+    {
+        uint32_t first = Nodes[n].First, count = Nodes[n].Count;
+        BvhBounds box, centroids;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            box.Grow(bounds[Indices[i]]);
+            centroids.Grow(centers[Indices[i]]);
+        }
+        Nodes[n].Min = box.Min;
+        Nodes[n].Max = box.Max;
+        if (count <= 1 || depth >= BVH_MAX_DEPTH)
+            return false;
+
+        // every primitive goes into a bin on each axis in one pass, then the cheapest boundary wins
+        glm::vec3 extent = centroids.Max - centroids.Min;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; axis++)
+            scale[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+        BvhBounds bins[3][BVH_BINS];
+        uint32_t binCounts[3][BVH_BINS] = {};
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            const BvhBounds& primitive = bounds[Indices[i]];
+            glm::vec3 offset = (centers[Indices[i]] - centroids.Min) * scale;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int b = std::min((int)offset[axis], BVH_BINS - 1);
+                bins[axis][b].Grow(primitive);
+                binCounts[axis][b]++;
+            }
+        }
+
+        float bestCost = FLT_MAX;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (extent[axis] <= 0.0f)
+                continue;
+
+            // areas and counts left of each boundary, then sweep back from the right
+            float leftArea[BVH_BINS - 1];
+            uint32_t leftCount[BVH_BINS - 1];
+            BvhBounds sweep;
+            uint32_t sum = 0;
+            for (int b = 0; b < BVH_BINS - 1; b++)
+            {
+                sweep.Grow(bins[axis][b]);
+                sum += binCounts[axis][b];
+                leftArea[b] = sweep.Area();
+                leftCount[b] = sum;
+            }
+            sweep = BvhBounds();
+            sum = 0;
+            for (int b = BVH_BINS - 1; b > 0; b--)
+            {
+                sweep.Grow(bins[axis][b]);
+                sum += binCounts[axis][b];
+                if (leftCount[b - 1] == 0 || sum == 0)
+                    continue;
+                float cost = leftArea[b - 1] * leftCount[b - 1] + sweep.Area() * sum;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        float leafCost = (float)count;
+        float splitCost = bestAxis >= 0 ? BVH_NODE_COST + bestCost / std::max(box.Area(), FLT_MIN) : FLT_MAX;
+        if (count <= BVH_MAX_LEAF && leafCost <= splitCost)
+            return false;
+
+        uint32_t middle;
+        if (bestAxis >= 0)
+        {
+            uint32_t* split = std::partition(&Indices[first], &Indices[first] + count, [&](uint32_t index)
+                { return std::min((int)((centers[index][bestAxis] - centroids.Min[bestAxis]) * scale[bestAxis]), BVH_BINS - 1) < bestSplit; });
+            middle = (uint32_t)(split - &Indices[0]);
+        }
+        else
+        {
+            // every centroid in one spot: halve the range so leaves stay small
+            middle = first + count / 2;
+        }
+
+        left = (uint32_t)Nodes.size();
+        BvhNode child;
+        child.Min = child.Max = glm::vec3(0.0f);
+        child.First = first;
+        child.Count = middle - first;
+        Nodes.push_back(child);
+        child.First = middle;
+        child.Count = first + count - middle;
+        Nodes.push_back(child);
+        parents.push_back(n);
+        parents.push_back(n);
+        Nodes[n].First = left;
+        Nodes[n].Count = 0;
+        return true;
+    }
+};
+
+// Möller-Trumbore, both faces (the renderers do not cull either). The triangle is v0 and the edges
+// v1 - v0, v2 - v0.
+inline bool BvhRayTriangle(const BvhRay& ray, const glm::vec3& v0, const glm::vec3& e1, const glm::vec3& e2, float tMax, float& t)
+{
+    glm::vec3 p = glm::cross(ray.Direction, e2);
+    float determinant = glm::dot(e1, p);
+    if (std::fabs(determinant) < 1e-12f)
+        return false;
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = ray.Origin - v0;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(ray.Direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = glm::dot(e2, q) * inverse;
+    return t >= 0.0f && t < tMax;
+}
+
+// The triangles of one mesh in a BVH of their own, in object space
+class MeshBvh
+{
+public:
+    // triangles are indices[firstIndex, firstIndex + indexCount) in threes
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount)
+    {
+        uint32_t count = indexCount / 3;
+        std::vector<BvhBounds> bounds(count);
+        triangles.resize(count);
+        for (uint32_t t = 0; t < count; t++)
+        {
+            const uint32_t* corner = &indices[firstIndex + t * 3];
+            const glm::vec3& a = positions[corner[0]];
+            const glm::vec3& b = positions[corner[1]];
+            const glm::vec3& c = positions[corner[2]];
+            triangles[t].V0 = a;
+            triangles[t].E1 = b - a;
+            triangles[t].E2 = c - a;
+            bounds[t].Grow(a);
+            bounds[t].Grow(b);
+            bounds[t].Grow(c);
+        }
+        tree.Build(bounds);
+    }
+
+    // nearest triangle before t (which receives its distance); triangle receives its index in the range
+    bool Intersect(const BvhRay& ray, float& t, uint32_t& triangle) const
+    {
+        return tree.Intersect(ray, t, [&](uint32_t index, float& tMax)
+        {
+            const MeshTriangle& candidate = triangles[index];
+            float distance;
+            if (!BvhRayTriangle(ray, candidate.V0, candidate.E1, candidate.E2, tMax, distance))
+                return false;
+            tMax = distance;
+            triangle = index;
+            return true;
+        });
+    }
+
+    BvhBounds Bounds() const
+    {
+        BvhBounds bounds;
+        if (!tree.Indices.empty())
+        {
+            bounds.Min = tree.Nodes[0].Min;
+            bounds.Max = tree.Nodes[0].Max;
+        }
+        return bounds;
+    }
+
+    uint32_t TriangleCount() const { return (uint32_t)triangles.size(); }
+    const Bvh& Tree() const { return tree; }
+
+private:
+    struct MeshTriangle
+    {
+        glm::vec3 V0, E1, E2;
+    };
+
+    std::vector<MeshTriangle> triangles;
+    Bvh tree;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <cmath>
+
+#include "gpuresources.h"
+
+// Dynamic resolution settings
+const int GPU_TIMER_QUERIES = 4;            // timer queries in flight; results are read this many frames late at most
+const float RESOLUTION_DEFAULT_TARGET_MS = 15.0f;  // GPU time per frame to hold (leaves headroom below 60 Hz)
+const float RESOLUTION_SMOOTHING = 0.25f;   // weight of a new GPU time in the running average
+const float RESOLUTION_DEADBAND = 0.85f;    // the scale only grows once the GPU time drops below this share of the target
+const float RESOLUTION_GAIN = 0.3f;         // share of the estimated correction applied per measurement; the
+                                            // timings lag a few frames behind, a full correction overshoots
+const float RESOLUTION_MAX_STEP = 0.05f;    // largest relative scale change per measurement
+
+// GPU time of a span of GL commands. Queries go round a small ring and are only read once the driver
+// reports them available, so measuring never waits for the GPU.
+class GpuTimer
+{
+public:
+    void Create()
+    {
+        glGenQueries(GPU_TIMER_QUERIES, queries);
+        for (int i = 0; i < GPU_TIMER_QUERIES; i++)
+            pending[i] = false;
+        next = 0;
+        active = false;
+    }
+
+    void Destroy()
+    {
+        glDeleteQueries(GPU_TIMER_QUERIES, queries);
+    }
+
+    // starts timing unless every query is still waiting for its result (then this frame is not measured)
+    void Begin()
+    {
+        active = !pending[next];
+        if (active)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void End()
+    {
+        if (!active)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % GPU_TIMER_QUERIES;
+        active = false;
+    }
+
+    // newest finished measurement in milliseconds; false when nothing finished since the last call
+    bool Latest(float& ms)
+    {
+        bool found = false;
+        for (int n = 0; n < GPU_TIMER_QUERIES; n++)
+        {
+            // oldest first, so the last one read is the newest
+            int i = (next + n) % GPU_TIMER_QUERIES;
+            if (!pending[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            pending[i] = false;
+            ms = (float)(nanoseconds / 1.0e6);
+            found = true;
+        }
+        return found;
+    }
+
+private:
+    GLuint queries[GPU_TIMER_QUERIES];
+    bool pending[GPU_TIMER_QUERIES];
+    int next = 0;
+    bool active = false;
+};
+
+// Picks the render resolution scale that keeps the measured GPU time at the target. The cost of a
+// frame is taken to grow with the pixel count, so the scale moves with the square root of the time ratio.
+struct ResolutionController
+{
+    float TargetMs = RESOLUTION_DEFAULT_TARGET_MS;
+    float MinScale = 0.5f;
+    float MaxScale = 1.0f;
+    float Scale = 1.0f;         // share of the framebuffer width and height rendered
+    float AverageMs = 0.0f;     // smoothed GPU time
+
+    void Update(float gpuMs)
+    {
+        AverageMs = AverageMs > 0.0f ? AverageMs + (gpuMs - AverageMs) * RESOLUTION_SMOOTHING : gpuMs;
+        if (TargetMs <= 0.0f || AverageMs <= 0.0f)
+            return;
+
+        float ratio = AverageMs / TargetMs;
+        if (ratio <= 1.0f && ratio >= RESOLUTION_DEADBAND)
+            return;
+
+        float step = std::pow(ratio, -0.5f * RESOLUTION_GAIN);
+        step = step < 1.0f - RESOLUTION_MAX_STEP ? 1.0f - RESOLUTION_MAX_STEP : (step > 1.0f + RESOLUTION_MAX_STEP ? 1.0f + RESOLUTION_MAX_STEP : step);
+        Scale *= step;
+        Scale = Scale < MinScale ? MinScale : (Scale > MaxScale ? MaxScale : Scale);
+    }
+};
+
+// Offscreen color and depth buffers the scene renders into. They are allocated at the full framebuffer
+// size and a lower resolution only uses their lower left corner, so scale changes never reallocate.
+class RenderTarget
+{
+public:
+    GLuint Framebuffer = 0;
+    GLuint Color = 0;
+    GLuint Depth = 0;
+    int Width = 0;
+    int Height = 0;
+
+    // (re)allocates when the size changed; false if the framebuffer is incomplete
+    bool Resize(int width, int height)
+    {
+        if (Framebuffer != 0 && width == Width && height == Height)
+            return true;
+        Destroy();
+        Width = width;
+        Height = height;
+
+        GpuResources& resources = GpuResources::Instance();
+        Color = resources.CreateTexture(GPU_RENDER_TARGETS, "render target color");
+        glBindTexture(GL_TEXTURE_2D, Color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        resources.SetLevelBytes(Color, 0, (size_t)width * height * 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // 24 bit depth is stored in 32 bits
+        Depth = resources.CreateRenderbuffer(GPU_RENDER_TARGETS, "render target depth");
+        glBindRenderbuffer(GL_RENDERBUFFER, Depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        resources.SetRenderbufferBytes(Depth, (size_t)width * height * 4);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &Framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, Depth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    }
+
+    void Destroy()
+    {
+        if (Framebuffer != 0)
+            glDeleteFramebuffers(1, &Framebuffer);
+        GpuResources::Instance().Release(GPU_TEXTURE, Color);
+        GpuResources::Instance().Release(GPU_RENDERBUFFER, Depth);
+        Framebuffer = 0;
+        Width = Height = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Frames the update stage may run ahead of submission: 1 is double buffered, 2 triple buffered
+const int FRAME_PIPELINE_MAX_LATENCY = 2;
+
+// Two stage frame pipeline: the thread owning the GL context submits input snapshots and renders
+// finished frame packets, an update thread turns each snapshot into a packet (camera, transforms,
+// culling, draw list). With a latency of N the update of frame F + N overlaps the submission of frame F;
+// packets are reused round robin so nothing is allocated per frame. A latency of 0 runs the update on
+// the calling thread, exactly like a serial loop.
+template <typename Input, typename Packet>
+class FramePipeline
+{
+public:
+    typedef void (*UpdateFunction)(const Input& input, Packet& packet);
+
+    void Start(int latency, UpdateFunction function)
+    {
+        this->latency = latency < 0 ? 0 : (latency > FRAME_PIPELINE_MAX_LATENCY ? FRAME_PIPELINE_MAX_LATENCY : latency);
+        update = function;
+        packets.assign(this->latency + 1, Packet());
+        free.clear();
+        ready.clear();
+        inputs.clear();
+        for (int i = 0; i <= this->latency; i++)
+            free.push_back(i);
+        stopping = false;
+        updateSeconds = 0.0;
+        waitSeconds = 0.0;
+        frames = 0;
+
+        if (this->latency > 0)
+            worker = std::thread(&FramePipeline::WorkerLoop, this);
+    }
+
+    // stops the update thread; packets not rendered yet are dropped
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    int Latency() const { return latency; }
+
+    // queues the input of the next frame to update (never blocks)
+    void Submit(const Input& input)
+    {
+        if (latency == 0)
+        {
+            Clock::time_point start = Clock::now();
+            update(input, packets[0]);
+            updateSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+            ready.push_back(0);
+            free.clear();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inputs.push_back(input);
+        }
+        wake.notify_all();
+    }
+
+    // oldest finished packet, waits for the update thread if it is not done yet
+    Packet& Acquire()
+    {
+        if (latency == 0)
+            return packets[ready.front()];
+
+        Clock::time_point start = Clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return !ready.empty(); });
+        waitSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+        return packets[ready.front()];
+    }
+
+    // hands the packet returned by Acquire back for reuse
+    void Release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free.push_back(ready.front());
+            ready.pop_front();
+            frames++;
+        }
+        wake.notify_all();
+    }
+
+    // average milliseconds per frame spent updating, and waiting for the update on the submitting thread
+    double UpdateMs() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return frames > 0 ? updateSeconds * 1000.0 / frames : 0.0;
+    }
+    double WaitMs() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return frames > 0 ? waitSeconds * 1000.0 / frames : 0.0;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    int latency = 0;
+    UpdateFunction update = nullptr;
+    std::vector<Packet> packets;
+    std::deque<int> free;       // packets the update stage may fill
+    std::deque<int> ready;      // filled packets in frame order
+    std::deque<Input> inputs;   // snapshots not updated yet
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;   // input or a free packet arrived, or stopping
+    std::condition_variable done;   // a packet is ready
+    std::thread worker;
+    bool stopping = false;
+
+    double updateSeconds = 0.0;
+    double waitSeconds = 0.0;
+    unsigned frames = 0;
+
+    void WorkerLoop()
+    {
+        for (;;)
+        {
+            Input input;
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || (!inputs.empty() && !free.empty()); });
+                if (stopping)
+                    return;
+                input = inputs.front();
+                inputs.pop_front();
+                slot = free.front();
+                free.pop_front();
+            }
+
+            // the packet belongs to this thread until it is queued as ready
+            Clock::time_point start = Clock::now();
+            update(input, packets[slot]);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                updateSeconds += seconds;
+                ready.push_back(slot);
+            }
+            done.notify_one();
+        }
+    }
+};
+
+#endif
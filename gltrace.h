@@ -0,0 +1,1211 @@
+#ifndef GLTRACE_H
+#define GLTRACE_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Every GL call the capture layer records; the numeric values are part of the file format, only append
+enum Trace_Op {
+    TRACE_BEGIN_FRAMES,         // setup (resource creation) ends here, everything after is per-frame
+    TRACE_FRAME_END,
+    TRACE_GEN_VERTEX_ARRAYS,
+    TRACE_BIND_VERTEX_ARRAY,
+    TRACE_DELETE_VERTEX_ARRAYS,
+    TRACE_GEN_BUFFERS,
+    TRACE_BIND_BUFFER,
+    TRACE_BUFFER_DATA,
+    TRACE_DELETE_BUFFERS,
+    TRACE_VERTEX_ATTRIB_POINTER,
+    TRACE_ENABLE_VERTEX_ATTRIB_ARRAY,
+    TRACE_DRAW_ELEMENTS,
+    TRACE_DRAW_ARRAYS,
+    TRACE_USE_PROGRAM,
+    TRACE_GET_UNIFORM_LOCATION,
+    TRACE_UNIFORM_MATRIX4FV,
+    TRACE_UNIFORM3F,
+    TRACE_UNIFORM2FV,
+    TRACE_UNIFORM1I,
+    TRACE_ACTIVE_TEXTURE,
+    TRACE_GEN_TEXTURES,
+    TRACE_BIND_TEXTURE,
+    TRACE_DELETE_TEXTURES,
+    TRACE_TEX_PARAMETERI,
+    TRACE_TEX_PARAMETERFV,
+    TRACE_TEX_IMAGE_2D,
+    TRACE_GENERATE_MIPMAP,
+    TRACE_ENABLE,
+    TRACE_DISABLE,
+    TRACE_CLEAR,
+    TRACE_CLEAR_COLOR,
+    TRACE_VIEWPORT,
+    TRACE_CREATE_PROGRAM,
+    TRACE_CREATE_SHADER,
+    TRACE_SHADER_SOURCE,
+    TRACE_COMPILE_SHADER,
+    TRACE_ATTACH_SHADER,
+    TRACE_LINK_PROGRAM,
+    TRACE_DELETE_PROGRAM,
+    TRACE_UNIFORM3FV,
+    TRACE_TEX_SUB_IMAGE_3D,
+    TRACE_BIND_BUFFER_BASE,
+    TRACE_VERTEX_ATTRIB_I_POINTER,
+    TRACE_VERTEX_ATTRIB_DIVISOR,
+    TRACE_DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE,
+    TRACE_TEX_IMAGE_3D,
+    TRACE_OP_COUNT
+};
+
+// Printable names, indexed by Trace_Op
+const char* const TRACE_OP_NAMES[TRACE_OP_COUNT] = {
+    "BeginFrames", "FrameEnd", "glGenVertexArrays", "glBindVertexArray", "glDeleteVertexArrays",
+    "glGenBuffers", "glBindBuffer", "glBufferData", "glDeleteBuffers", "glVertexAttribPointer",
+    "glEnableVertexAttribArray", "glDrawElements", "glDrawArrays", "glUseProgram", "glGetUniformLocation",
+    "glUniformMatrix4fv", "glUniform3f", "glUniform2fv", "glUniform1i", "glActiveTexture",
+    "glGenTextures", "glBindTexture", "glDeleteTextures", "glTexParameteri", "glTexParameterfv",
+    "glTexImage2D", "glGenerateMipmap", "glEnable", "glDisable", "glClear",
+    "glClearColor", "glViewport", "glCreateProgram", "glCreateShader", "glShaderSource",
+    "glCompileShader", "glAttachShader", "glLinkProgram", "glDeleteProgram", "glUniform3fv",
+    "glTexSubImage3D", "glBindBufferBase", "glVertexAttribIPointer", "glVertexAttribDivisor",
+    "glDrawElementsInstancedBaseInstance", "glTexImage3D"
+};
+
+// File layout: header, then records of { uint16 op, uint32 payload size, payload }
+const char GL_TRACE_MAGIC[4] = { 'E', 'G', 'G', 'T' };
+const uint32_t GL_TRACE_VERSION = 2;    // 2 dropped glTexStorage3D, which renumbered the later ops
+
+// Bytes glTexImage2D (or one layer of glTexSubImage3D) reads from client memory at this unpack alignment
+inline size_t GLTraceImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint alignment)
+{
+    int components = 4;
+    if (format == GL_RED || format == GL_DEPTH_COMPONENT)
+        components = 1;
+    else if (format == GL_RG)
+        components = 2;
+    else if (format == GL_RGB || format == GL_BGR)
+        components = 3;
+
+    int componentSize = 1;
+    if (type == GL_FLOAT || type == GL_UNSIGNED_INT || type == GL_INT)
+        componentSize = 4;
+    else if (type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT || type == GL_SHORT)
+        componentSize = 2;
+
+    size_t rowSize = (size_t)width * components * componentSize;
+    rowSize = (rowSize + alignment - 1) / alignment * alignment;
+    return rowSize * height;
+}
+
+// Captures GL calls into a binary trace by swapping glad's function pointers for recording wrappers.
+// Capture covers the calls made by the scene setup and render code (the Trace_Op list); anything else
+// still runs but is not recorded.
+class GLTraceWriter
+{
+public:
+    static GLTraceWriter& Instance()
+    {
+        static GLTraceWriter writer;
+        return writer;
+    }
+
+    // opens the trace and installs the hooks; call after glad has loaded the GL functions
+    bool Start(const char* path, int maxFrames)
+    {
+        file = fopen(path, "wb");
+        if (file == nullptr)
+            return false;
+
+        fwrite(GL_TRACE_MAGIC, sizeof(GL_TRACE_MAGIC), 1, file);
+        fwrite(&GL_TRACE_VERSION, sizeof(GL_TRACE_VERSION), 1, file);
+
+        frameLimit = maxFrames;
+        frames = 0;
+        Hook();
+        return true;
+    }
+
+    // removes the hooks and writes out anything still buffered
+    void Stop()
+    {
+        if (file == nullptr)
+            return;
+        Unhook();
+        Flush();
+        fclose(file);
+        file = nullptr;
+    }
+
+    bool IsCapturing() const { return file != nullptr; }
+    int FramesCaptured() const { return frames; }
+
+    // marks the end of resource creation; the replayer loops over what follows
+    void BeginFrames()
+    {
+        if (file != nullptr)
+            Begin(TRACE_BEGIN_FRAMES).End();
+    }
+
+    // marks the end of a frame; stops capturing once the frame limit is reached
+    void EndFrame()
+    {
+        if (file == nullptr)
+            return;
+        Begin(TRACE_FRAME_END).End();
+        if (++frames >= frameLimit)
+            Stop();
+    }
+
+private:
+    // the real GL entry points while hooked
+    struct RealGL
+    {
+        PFNGLGENVERTEXARRAYSPROC GenVertexArrays;
+        PFNGLBINDVERTEXARRAYPROC BindVertexArray;
+        PFNGLDELETEVERTEXARRAYSPROC DeleteVertexArrays;
+        PFNGLGENBUFFERSPROC GenBuffers;
+        PFNGLBINDBUFFERPROC BindBuffer;
+        PFNGLBUFFERDATAPROC BufferData;
+        PFNGLDELETEBUFFERSPROC DeleteBuffers;
+        PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+        PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+        PFNGLDRAWELEMENTSPROC DrawElements;
+        PFNGLDRAWARRAYSPROC DrawArrays;
+        PFNGLUSEPROGRAMPROC UseProgram;
+        PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+        PFNGLUNIFORMMATRIX4FVPROC UniformMatrix4fv;
+        PFNGLUNIFORM3FPROC Uniform3f;
+        PFNGLUNIFORM3FVPROC Uniform3fv;
+        PFNGLUNIFORM2FVPROC Uniform2fv;
+        PFNGLUNIFORM1IPROC Uniform1i;
+        PFNGLACTIVETEXTUREPROC ActiveTexture;
+        PFNGLGENTEXTURESPROC GenTextures;
+        PFNGLBINDTEXTUREPROC BindTexture;
+        PFNGLDELETETEXTURESPROC DeleteTextures;
+        PFNGLTEXPARAMETERIPROC TexParameteri;
+        PFNGLTEXPARAMETERFVPROC TexParameterfv;
+        PFNGLTEXIMAGE2DPROC TexImage2D;
+        PFNGLGENERATEMIPMAPPROC GenerateMipmap;
+        PFNGLENABLEPROC Enable;
+        PFNGLDISABLEPROC Disable;
+        PFNGLCLEARPROC Clear;
+        PFNGLCLEARCOLORPROC ClearColor;
+        PFNGLVIEWPORTPROC Viewport;
+        PFNGLCREATEPROGRAMPROC CreateProgram;
+        PFNGLCREATESHADERPROC CreateShader;
+        PFNGLSHADERSOURCEPROC ShaderSource;
+        PFNGLCOMPILESHADERPROC CompileShader;
+        PFNGLATTACHSHADERPROC AttachShader;
+        PFNGLLINKPROGRAMPROC LinkProgram;
+        PFNGLDELETEPROGRAMPROC DeleteProgram;
+        PFNGLTEXSUBIMAGE3DPROC TexSubImage3D;
+        PFNGLBINDBUFFERBASEPROC BindBufferBase;
+        PFNGLVERTEXATTRIBIPOINTERPROC VertexAttribIPointer;
+        PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+        PFNGLDRAWELEMENTSINSTANCEDBASEINSTANCEPROC DrawElementsInstancedBaseInstance;
+        PFNGLTEXIMAGE3DPROC TexImage3D;
+        PFNGLGETINTEGERVPROC GetIntegerv;
+    };
+
+    RealGL real;
+    FILE* file = nullptr;
+    std::vector<char> buffer;   // records are staged here and written in large blocks
+    size_t recordStart = 0;
+    int frames = 0;
+    int frameLimit = 0;
+
+    GLTraceWriter() {}
+    ~GLTraceWriter() { Stop(); }
+
+    // record building
+    GLTraceWriter& Begin(Trace_Op op)
+    {
+        recordStart = buffer.size();
+        uint16_t code = (uint16_t)op;
+        uint32_t size = 0;
+        Bytes(&code, sizeof(code));
+        Bytes(&size, sizeof(size));
+        return *this;
+    }
+    GLTraceWriter& Bytes(const void* data, size_t size)
+    {
+        const char* bytes = (const char*)data;
+        buffer.insert(buffer.end(), bytes, bytes + size);
+        return *this;
+    }
+    GLTraceWriter& U32(uint32_t value) { return Bytes(&value, sizeof(value)); }
+    GLTraceWriter& I32(int32_t value) { return Bytes(&value, sizeof(value)); }
+    GLTraceWriter& U64(uint64_t value) { return Bytes(&value, sizeof(value)); }
+    GLTraceWriter& F32(float value) { return Bytes(&value, sizeof(value)); }
+    GLTraceWriter& Blob(const void* data, size_t size)
+    {
+        U64(data != nullptr ? size : 0);
+        return data != nullptr ? Bytes(data, size) : *this;
+    }
+    void End()
+    {
+        uint32_t size = (uint32_t)(buffer.size() - recordStart - sizeof(uint16_t) - sizeof(uint32_t));
+        memcpy(&buffer[recordStart + sizeof(uint16_t)], &size, sizeof(size));
+        if (buffer.size() >= (1 << 20))
+            Flush();
+    }
+    void Flush()
+    {
+        if (file != nullptr && !buffer.empty())
+            fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+
+    GLTraceWriter& Names(GLsizei n, const GLuint* names)
+    {
+        I32(n);
+        return Bytes(names, sizeof(GLuint) * n);
+    }
+
+    // for the unpack alignment of the captured context
+    size_t ImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type)
+    {
+        GLint alignment = 4;
+        real.GetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        return GLTraceImageSize(width, height, format, type, alignment);
+    }
+
+    void Hook()
+    {
+        real.GenVertexArrays = glad_glGenVertexArrays;          glad_glGenVertexArrays = TraceGenVertexArrays;
+        real.BindVertexArray = glad_glBindVertexArray;          glad_glBindVertexArray = TraceBindVertexArray;
+        real.DeleteVertexArrays = glad_glDeleteVertexArrays;    glad_glDeleteVertexArrays = TraceDeleteVertexArrays;
+        real.GenBuffers = glad_glGenBuffers;                    glad_glGenBuffers = TraceGenBuffers;
+        real.BindBuffer = glad_glBindBuffer;                    glad_glBindBuffer = TraceBindBuffer;
+        real.BufferData = glad_glBufferData;                    glad_glBufferData = TraceBufferData;
+        real.DeleteBuffers = glad_glDeleteBuffers;              glad_glDeleteBuffers = TraceDeleteBuffers;
+        real.VertexAttribPointer = glad_glVertexAttribPointer;  glad_glVertexAttribPointer = TraceVertexAttribPointer;
+        real.EnableVertexAttribArray = glad_glEnableVertexAttribArray; glad_glEnableVertexAttribArray = TraceEnableVertexAttribArray;
+        real.DrawElements = glad_glDrawElements;                glad_glDrawElements = TraceDrawElements;
+        real.DrawArrays = glad_glDrawArrays;                    glad_glDrawArrays = TraceDrawArrays;
+        real.UseProgram = glad_glUseProgram;                    glad_glUseProgram = TraceUseProgram;
+        real.GetUniformLocation = glad_glGetUniformLocation;    glad_glGetUniformLocation = TraceGetUniformLocation;
+        real.UniformMatrix4fv = glad_glUniformMatrix4fv;        glad_glUniformMatrix4fv = TraceUniformMatrix4fv;
+        real.Uniform3f = glad_glUniform3f;                      glad_glUniform3f = TraceUniform3f;
+        real.Uniform3fv = glad_glUniform3fv;                    glad_glUniform3fv = TraceUniform3fv;
+        real.Uniform2fv = glad_glUniform2fv;                    glad_glUniform2fv = TraceUniform2fv;
+        real.Uniform1i = glad_glUniform1i;                      glad_glUniform1i = TraceUniform1i;
+        real.ActiveTexture = glad_glActiveTexture;              glad_glActiveTexture = TraceActiveTexture;
+        real.GenTextures = glad_glGenTextures;                  glad_glGenTextures = TraceGenTextures;
+        real.BindTexture = glad_glBindTexture;                  glad_glBindTexture = TraceBindTexture;
+        real.DeleteTextures = glad_glDeleteTextures;            glad_glDeleteTextures = TraceDeleteTextures;
+        real.TexParameteri = glad_glTexParameteri;              glad_glTexParameteri = TraceTexParameteri;
+        real.TexParameterfv = glad_glTexParameterfv;            glad_glTexParameterfv = TraceTexParameterfv;
+        real.TexImage2D = glad_glTexImage2D;                    glad_glTexImage2D = TraceTexImage2D;
+        real.GenerateMipmap = glad_glGenerateMipmap;            glad_glGenerateMipmap = TraceGenerateMipmap;
+        real.Enable = glad_glEnable;                            glad_glEnable = TraceEnable;
+        real.Disable = glad_glDisable;                          glad_glDisable = TraceDisable;
+        real.Clear = glad_glClear;                              glad_glClear = TraceClear;
+        real.ClearColor = glad_glClearColor;                    glad_glClearColor = TraceClearColor;
+        real.Viewport = glad_glViewport;                        glad_glViewport = TraceViewport;
+        real.CreateProgram = glad_glCreateProgram;              glad_glCreateProgram = TraceCreateProgram;
+        real.CreateShader = glad_glCreateShader;                glad_glCreateShader = TraceCreateShader;
+        real.ShaderSource = glad_glShaderSource;                glad_glShaderSource = TraceShaderSource;
+        real.CompileShader = glad_glCompileShader;              glad_glCompileShader = TraceCompileShader;
+        real.AttachShader = glad_glAttachShader;                glad_glAttachShader = TraceAttachShader;
+        real.LinkProgram = glad_glLinkProgram;                  glad_glLinkProgram = TraceLinkProgram;
+        real.DeleteProgram = glad_glDeleteProgram;              glad_glDeleteProgram = TraceDeleteProgram;
+        real.TexSubImage3D = glad_glTexSubImage3D;              glad_glTexSubImage3D = TraceTexSubImage3D;
+        real.BindBufferBase = glad_glBindBufferBase;            glad_glBindBufferBase = TraceBindBufferBase;
+        real.VertexAttribIPointer = glad_glVertexAttribIPointer; glad_glVertexAttribIPointer = TraceVertexAttribIPointer;
+        real.VertexAttribDivisor = glad_glVertexAttribDivisor;  glad_glVertexAttribDivisor = TraceVertexAttribDivisor;
+        real.DrawElementsInstancedBaseInstance = glad_glDrawElementsInstancedBaseInstance;
+        glad_glDrawElementsInstancedBaseInstance = TraceDrawElementsInstancedBaseInstance;
+        real.TexImage3D = glad_glTexImage3D;                    glad_glTexImage3D = TraceTexImage3D;
+        real.GetIntegerv = glad_glGetIntegerv;
+    }
+
+    void Unhook()
+    {
+        glad_glGenVertexArrays = real.GenVertexArrays;
+        glad_glBindVertexArray = real.BindVertexArray;
+        glad_glDeleteVertexArrays = real.DeleteVertexArrays;
+        glad_glGenBuffers = real.GenBuffers;
+        glad_glBindBuffer = real.BindBuffer;
+        glad_glBufferData = real.BufferData;
+        glad_glDeleteBuffers = real.DeleteBuffers;
+        glad_glVertexAttribPointer = real.VertexAttribPointer;
+        glad_glEnableVertexAttribArray = real.EnableVertexAttribArray;
+        glad_glDrawElements = real.DrawElements;
+        glad_glDrawArrays = real.DrawArrays;
+        glad_glUseProgram = real.UseProgram;
+        glad_glGetUniformLocation = real.GetUniformLocation;
+        glad_glUniformMatrix4fv = real.UniformMatrix4fv;
+        glad_glUniform3f = real.Uniform3f;
+        glad_glUniform3fv = real.Uniform3fv;
+        glad_glUniform2fv = real.Uniform2fv;
+        glad_glUniform1i = real.Uniform1i;
+        glad_glActiveTexture = real.ActiveTexture;
+        glad_glGenTextures = real.GenTextures;
+        glad_glBindTexture = real.BindTexture;
+        glad_glDeleteTextures = real.DeleteTextures;
+        glad_glTexParameteri = real.TexParameteri;
+        glad_glTexParameterfv = real.TexParameterfv;
+        glad_glTexImage2D = real.TexImage2D;
+        glad_glGenerateMipmap = real.GenerateMipmap;
+        glad_glEnable = real.Enable;
+        glad_glDisable = real.Disable;
+        glad_glClear = real.Clear;
+        glad_glClearColor = real.ClearColor;
+        glad_glViewport = real.Viewport;
+        glad_glCreateProgram = real.CreateProgram;
+        glad_glCreateShader = real.CreateShader;
+        glad_glShaderSource = real.ShaderSource;
+        glad_glCompileShader = real.CompileShader;
+        glad_glAttachShader = real.AttachShader;
+        glad_glLinkProgram = real.LinkProgram;
+        glad_glDeleteProgram = real.DeleteProgram;
+        glad_glTexSubImage3D = real.TexSubImage3D;
+        glad_glBindBufferBase = real.BindBufferBase;
+        glad_glVertexAttribIPointer = real.VertexAttribIPointer;
+        glad_glVertexAttribDivisor = real.VertexAttribDivisor;
+        glad_glDrawElementsInstancedBaseInstance = real.DrawElementsInstancedBaseInstance;
+        glad_glTexImage3D = real.TexImage3D;
+    }
+
+    // Recording wrappers: call through to the driver, then record the call (and any names it returned)
+    static void APIENTRY TraceGenVertexArrays(GLsizei n, GLuint* arrays)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.GenVertexArrays(n, arrays);
+        t.Begin(TRACE_GEN_VERTEX_ARRAYS).Names(n, arrays).End();
+    }
+    static void APIENTRY TraceBindVertexArray(GLuint array)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.BindVertexArray(array);
+        t.Begin(TRACE_BIND_VERTEX_ARRAY).U32(array).End();
+    }
+    static void APIENTRY TraceDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+    {
+        GLTraceWriter& t = Instance();
+        t.Begin(TRACE_DELETE_VERTEX_ARRAYS).Names(n, arrays).End();
+        t.real.DeleteVertexArrays(n, arrays);
+    }
+    static void APIENTRY TraceGenBuffers(GLsizei n, GLuint* buffers)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.GenBuffers(n, buffers);
+        t.Begin(TRACE_GEN_BUFFERS).Names(n, buffers).End();
+    }
+    static void APIENTRY TraceBindBuffer(GLenum target, GLuint buffer)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.BindBuffer(target, buffer);
+        t.Begin(TRACE_BIND_BUFFER).U32(target).U32(buffer).End();
+    }
+    static void APIENTRY TraceBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.BufferData(target, size, data, usage);
+        t.Begin(TRACE_BUFFER_DATA).U32(target).U64(size).U32(usage).Blob(data, size).End();
+    }
+    static void APIENTRY TraceDeleteBuffers(GLsizei n, const GLuint* buffers)
+    {
+        GLTraceWriter& t = Instance();
+        t.Begin(TRACE_DELETE_BUFFERS).Names(n, buffers).End();
+        t.real.DeleteBuffers(n, buffers);
+    }
+    static void APIENTRY TraceVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.VertexAttribPointer(index, size, type, normalized, stride, pointer);
+        t.Begin(TRACE_VERTEX_ATTRIB_POINTER).U32(index).I32(size).U32(type).U32(normalized).I32(stride).U64((uint64_t)(uintptr_t)pointer).End();
+    }
+    static void APIENTRY TraceEnableVertexAttribArray(GLuint index)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.EnableVertexAttribArray(index);
+        t.Begin(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY).U32(index).End();
+    }
+    static void APIENTRY TraceDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.DrawElements(mode, count, type, indices);
+        t.Begin(TRACE_DRAW_ELEMENTS).U32(mode).I32(count).U32(type).U64((uint64_t)(uintptr_t)indices).End();
+    }
+    static void APIENTRY TraceDrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.DrawArrays(mode, first, count);
+        t.Begin(TRACE_DRAW_ARRAYS).U32(mode).I32(first).I32(count).End();
+    }
+    static void APIENTRY TraceUseProgram(GLuint program)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.UseProgram(program);
+        t.Begin(TRACE_USE_PROGRAM).U32(program).End();
+    }
+    static GLint APIENTRY TraceGetUniformLocation(GLuint program, const GLchar* name)
+    {
+        GLTraceWriter& t = Instance();
+        GLint location = t.real.GetUniformLocation(program, name);
+        t.Begin(TRACE_GET_UNIFORM_LOCATION).U32(program).I32(location).Bytes(name, strlen(name) + 1).End();
+        return location;
+    }
+    static void APIENTRY TraceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.UniformMatrix4fv(location, count, transpose, value);
+        t.Begin(TRACE_UNIFORM_MATRIX4FV).I32(location).I32(count).U32(transpose).Bytes(value, sizeof(GLfloat) * 16 * count).End();
+    }
+    static void APIENTRY TraceUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Uniform3f(location, v0, v1, v2);
+        t.Begin(TRACE_UNIFORM3F).I32(location).F32(v0).F32(v1).F32(v2).End();
+    }
+    static void APIENTRY TraceUniform3fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Uniform3fv(location, count, value);
+        t.Begin(TRACE_UNIFORM3FV).I32(location).I32(count).Bytes(value, sizeof(GLfloat) * 3 * count).End();
+    }
+    static void APIENTRY TraceUniform2fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Uniform2fv(location, count, value);
+        t.Begin(TRACE_UNIFORM2FV).I32(location).I32(count).Bytes(value, sizeof(GLfloat) * 2 * count).End();
+    }
+    static void APIENTRY TraceUniform1i(GLint location, GLint v0)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Uniform1i(location, v0);
+        t.Begin(TRACE_UNIFORM1I).I32(location).I32(v0).End();
+    }
+    static void APIENTRY TraceActiveTexture(GLenum texture)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.ActiveTexture(texture);
+        t.Begin(TRACE_ACTIVE_TEXTURE).U32(texture).End();
+    }
+    static void APIENTRY TraceGenTextures(GLsizei n, GLuint* textures)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.GenTextures(n, textures);
+        t.Begin(TRACE_GEN_TEXTURES).Names(n, textures).End();
+    }
+    static void APIENTRY TraceBindTexture(GLenum target, GLuint texture)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.BindTexture(target, texture);
+        t.Begin(TRACE_BIND_TEXTURE).U32(target).U32(texture).End();
+    }
+    static void APIENTRY TraceDeleteTextures(GLsizei n, const GLuint* textures)
+    {
+        GLTraceWriter& t = Instance();
+        t.Begin(TRACE_DELETE_TEXTURES).Names(n, textures).End();
+        t.real.DeleteTextures(n, textures);
+    }
+    static void APIENTRY TraceTexParameteri(GLenum target, GLenum pname, GLint param)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.TexParameteri(target, pname, param);
+        t.Begin(TRACE_TEX_PARAMETERI).U32(target).U32(pname).I32(param).End();
+    }
+    static void APIENTRY TraceTexParameterfv(GLenum target, GLenum pname, const GLfloat* params)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.TexParameterfv(target, pname, params);
+        int count = pname == GL_TEXTURE_BORDER_COLOR ? 4 : 1;
+        t.Begin(TRACE_TEX_PARAMETERFV).U32(target).U32(pname).I32(count).Bytes(params, sizeof(GLfloat) * count).End();
+    }
+    static void APIENTRY TraceTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.TexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+        t.Begin(TRACE_TEX_IMAGE_2D).U32(target).I32(level).I32(internalformat).I32(width).I32(height).I32(border).U32(format).U32(type)
+            .Blob(pixels, t.ImageSize(width, height, format, type)).End();
+    }
+    static void APIENTRY TraceGenerateMipmap(GLenum target)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.GenerateMipmap(target);
+        t.Begin(TRACE_GENERATE_MIPMAP).U32(target).End();
+    }
+    static void APIENTRY TraceEnable(GLenum cap)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Enable(cap);
+        t.Begin(TRACE_ENABLE).U32(cap).End();
+    }
+    static void APIENTRY TraceDisable(GLenum cap)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Disable(cap);
+        t.Begin(TRACE_DISABLE).U32(cap).End();
+    }
+    static void APIENTRY TraceClear(GLbitfield mask)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Clear(mask);
+        t.Begin(TRACE_CLEAR).U32(mask).End();
+    }
+    static void APIENTRY TraceClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.ClearColor(red, green, blue, alpha);
+        t.Begin(TRACE_CLEAR_COLOR).F32(red).F32(green).F32(blue).F32(alpha).End();
+    }
+    static void APIENTRY TraceViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.Viewport(x, y, width, height);
+        t.Begin(TRACE_VIEWPORT).I32(x).I32(y).I32(width).I32(height).End();
+    }
+    static GLuint APIENTRY TraceCreateProgram()
+    {
+        GLTraceWriter& t = Instance();
+        GLuint program = t.real.CreateProgram();
+        t.Begin(TRACE_CREATE_PROGRAM).U32(program).End();
+        return program;
+    }
+    static GLuint APIENTRY TraceCreateShader(GLenum type)
+    {
+        GLTraceWriter& t = Instance();
+        GLuint shader = t.real.CreateShader(type);
+        t.Begin(TRACE_CREATE_SHADER).U32(type).U32(shader).End();
+        return shader;
+    }
+    static void APIENTRY TraceShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.ShaderSource(shader, count, string, length);
+
+        // the sources are concatenated into one null-terminated string
+        std::string source;
+        for (GLsizei i = 0; i < count; i++)
+        {
+            if (length != nullptr && length[i] >= 0)
+                source.append(string[i], length[i]);
+            else
+                source.append(string[i]);
+        }
+        t.Begin(TRACE_SHADER_SOURCE).U32(shader).Bytes(source.c_str(), source.size() + 1).End();
+    }
+    static void APIENTRY TraceCompileShader(GLuint shader)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.CompileShader(shader);
+        t.Begin(TRACE_COMPILE_SHADER).U32(shader).End();
+    }
+    static void APIENTRY TraceAttachShader(GLuint program, GLuint shader)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.AttachShader(program, shader);
+        t.Begin(TRACE_ATTACH_SHADER).U32(program).U32(shader).End();
+    }
+    static void APIENTRY TraceLinkProgram(GLuint program)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.LinkProgram(program);
+        t.Begin(TRACE_LINK_PROGRAM).U32(program).End();
+    }
+    static void APIENTRY TraceDeleteProgram(GLuint program)
+    {
+        GLTraceWriter& t = Instance();
+        t.Begin(TRACE_DELETE_PROGRAM).U32(program).End();
+        t.real.DeleteProgram(program);
+    }
+    static void APIENTRY TraceTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.TexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+        t.Begin(TRACE_TEX_SUB_IMAGE_3D).U32(target).I32(level).I32(xoffset).I32(yoffset).I32(zoffset).I32(width).I32(height).I32(depth)
+            .U32(format).U32(type).Blob(pixels, t.ImageSize(width, height, format, type) * depth).End();
+    }
+    static void APIENTRY TraceBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.BindBufferBase(target, index, buffer);
+        t.Begin(TRACE_BIND_BUFFER_BASE).U32(target).U32(index).U32(buffer).End();
+    }
+    static void APIENTRY TraceVertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.VertexAttribIPointer(index, size, type, stride, pointer);
+        t.Begin(TRACE_VERTEX_ATTRIB_I_POINTER).U32(index).I32(size).U32(type).I32(stride).U64((uint64_t)(uintptr_t)pointer).End();
+    }
+    static void APIENTRY TraceVertexAttribDivisor(GLuint index, GLuint divisor)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.VertexAttribDivisor(index, divisor);
+        t.Begin(TRACE_VERTEX_ATTRIB_DIVISOR).U32(index).U32(divisor).End();
+    }
+    static void APIENTRY TraceDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLuint baseinstance)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.DrawElementsInstancedBaseInstance(mode, count, type, indices, instancecount, baseinstance);
+        t.Begin(TRACE_DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE).U32(mode).I32(count).U32(type).U64((uint64_t)(uintptr_t)indices)
+            .I32(instancecount).U32(baseinstance).End();
+    }
+    static void APIENTRY TraceTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+    {
+        GLTraceWriter& t = Instance();
+        t.real.TexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+        t.Begin(TRACE_TEX_IMAGE_3D).U32(target).I32(level).I32(internalformat).I32(width).I32(height).I32(depth).I32(border)
+            .U32(format).U32(type).Blob(pixels, t.ImageSize(width, height, format, type) * depth).End();
+    }
+};
+
+// Timing collected for one kind of call during replay
+struct TraceOpStats
+{
+    uint64_t Calls = 0;
+    double Seconds = 0.0;
+};
+
+// Re-issues a captured trace as fast as possible, remapping object names and uniform locations
+// to the ones the current context hands out, and times every call by type
+class GLTracePlayer
+{
+public:
+    TraceOpStats OpStats[TRACE_OP_COUNT];
+    std::vector<double> FrameMs;        // per replayed frame, including glFinish
+    double FinishSeconds = 0.0;         // time spent waiting in glFinish at frame ends
+
+    bool Load(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+
+        char magic[4];
+        uint32_t version = 0;
+        bool valid = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, GL_TRACE_MAGIC, sizeof(magic)) == 0
+            && fread(&version, sizeof(version), 1, file) == 1 && version == GL_TRACE_VERSION;
+
+        data.clear();
+        char chunk[1 << 16];
+        size_t read;
+        while (valid && (read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            data.insert(data.end(), chunk, chunk + read);
+        fclose(file);
+
+        // every record has to lie within the file, and the setup has to end somewhere, or each loop would
+        // create the resources again
+        framesStart = 0;
+        size_t offset = 0;
+        while (valid && offset < data.size())
+        {
+            uint16_t op;
+            uint32_t size;
+            if (offset + 6 > data.size())
+                return false;
+            memcpy(&op, &data[offset], sizeof(op));
+            memcpy(&size, &data[offset + 2], sizeof(size));
+            if (size > data.size() - offset - 6)
+                return false;
+            offset += 6 + size;
+            if (op == TRACE_BEGIN_FRAMES && framesStart == 0)
+                framesStart = offset;
+        }
+        return valid && framesStart != 0;
+    }
+
+    // plays the setup once, then loops over the captured frames; false, and stops, at a record whose
+    // payload does not fit it
+    bool Play(int loops)
+    {
+        if (!Execute(0, framesStart, false))
+            return false;
+        for (int i = 0; i < loops; i++)
+        {
+            if (!Execute(framesStart, data.size(), true))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    std::vector<char> data;
+    size_t framesStart = 0;
+    size_t cursor = 0;
+    size_t recordEnd = 0;       // end of the record being dispatched
+    bool corrupt = false;       // a payload did not fit its record
+
+    // trace name -> replay name, per object type
+    std::unordered_map<GLuint, GLuint> vertexArrays, buffers, textures, programs, shaders;
+    // (trace program << 32 | trace location) -> replay location
+    std::unordered_map<uint64_t, GLint> locations;
+    GLuint currentProgram = 0;  // trace name of the program in use
+
+    // payload readers; past the end of the record they return zeros (and null pointers) and flag the trace corrupt
+    bool Has(size_t size)
+    {
+        if (!corrupt && size <= recordEnd - cursor)
+            return true;
+        corrupt = true;
+        return false;
+    }
+    uint32_t U32() { uint32_t v = 0; if (Has(sizeof(v))) { memcpy(&v, &data[cursor], sizeof(v)); cursor += sizeof(v); } return v; }
+    int32_t I32() { int32_t v = 0; if (Has(sizeof(v))) { memcpy(&v, &data[cursor], sizeof(v)); cursor += sizeof(v); } return v; }
+    uint64_t U64() { uint64_t v = 0; if (Has(sizeof(v))) { memcpy(&v, &data[cursor], sizeof(v)); cursor += sizeof(v); } return v; }
+    float F32() { float v = 0.0f; if (Has(sizeof(v))) { memcpy(&v, &data[cursor], sizeof(v)); cursor += sizeof(v); } return v; }
+    const char* Ptr(size_t size) { if (!Has(size)) return nullptr; const char* p = data.data() + cursor; cursor += size; return p; }
+    const void* Blob(uint64_t& size) { size = U64(); return size > 0 ? Ptr(size <= SIZE_MAX ? (size_t)size : SIZE_MAX) : nullptr; }
+    const char* String()
+    {
+        if (!Has(1))
+            return nullptr;
+        const char* s = data.data() + cursor;
+        const char* terminator = (const char*)memchr(s, '\0', recordEnd - cursor);
+        if (terminator == nullptr)
+        {
+            corrupt = true;
+            return nullptr;
+        }
+        cursor += terminator - s + 1;
+        return s;
+    }
+
+    // texture pixels, which have to be exactly as many bytes as GL will read for the image
+    const void* Pixels(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type)
+    {
+        uint64_t size;
+        const void* pixels = Blob(size);
+        if (pixels == nullptr)
+            return nullptr;
+        GLint alignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        if (width < 0 || height < 0 || depth < 0 || size != GLTraceImageSize(width, height, format, type, alignment) * depth)
+            corrupt = true;
+        return pixels;
+    }
+
+    static GLuint Map(std::unordered_map<GLuint, GLuint>& names, GLuint name)
+    {
+        if (name == 0)
+            return 0;
+        std::unordered_map<GLuint, GLuint>::iterator found = names.find(name);
+        return found != names.end() ? found->second : 0;
+    }
+
+    GLint Location(GLint location)
+    {
+        if (location < 0)
+            return -1;
+        std::unordered_map<uint64_t, GLint>::iterator found = locations.find(((uint64_t)currentProgram << 32) | (uint32_t)location);
+        return found != locations.end() ? found->second : -1;
+    }
+
+    // generates replay names for the trace names stored in the record
+    template <typename GenFunction>
+    void GenNames(std::unordered_map<GLuint, GLuint>& names, GenFunction gen)
+    {
+        GLsizei n = I32();
+        if (n < 0 || !Has((size_t)n * sizeof(GLuint)))
+        {
+            corrupt = true;
+            return;
+        }
+        std::vector<GLuint> created(n);
+        gen(n, created.data());
+        for (GLsizei i = 0; i < n; i++)
+            names[U32()] = created[i];
+    }
+
+    // reads trace names and deletes the matching replay objects
+    template <typename DeleteFunction>
+    void DeleteNames(std::unordered_map<GLuint, GLuint>& names, DeleteFunction remove)
+    {
+        GLsizei n = I32();
+        if (n < 0 || !Has((size_t)n * sizeof(GLuint)))
+        {
+            corrupt = true;
+            return;
+        }
+        std::vector<GLuint> mapped(n);
+        for (GLsizei i = 0; i < n; i++)
+        {
+            GLuint name = U32();
+            mapped[i] = Map(names, name);
+            names.erase(name);
+        }
+        remove(n, mapped.data());
+    }
+
+    bool Execute(size_t begin, size_t end, bool timed)
+    {
+        typedef std::chrono::high_resolution_clock Clock;
+        Clock::time_point frameStart = Clock::now();
+
+        cursor = begin;
+        while (cursor + 6 <= end)
+        {
+            uint16_t op;
+            uint32_t size;
+            memcpy(&op, &data[cursor], sizeof(op));
+            memcpy(&size, &data[cursor + 2], sizeof(size));
+            cursor += 6;
+            size_t next = cursor + size;
+
+            recordEnd = next;
+            Clock::time_point start = Clock::now();
+            Dispatch((Trace_Op)op);
+            Clock::time_point stop = Clock::now();
+            if (corrupt)
+                return false;
+
+            if (timed && op < TRACE_OP_COUNT)
+            {
+                OpStats[op].Calls++;
+                OpStats[op].Seconds += std::chrono::duration<double>(stop - start).count();
+            }
+
+            // a frame is finished once the GPU has done all of its work
+            if (timed && op == TRACE_FRAME_END)
+            {
+                glFinish();
+                Clock::time_point finished = Clock::now();
+                FinishSeconds += std::chrono::duration<double>(finished - stop).count();
+                FrameMs.push_back(std::chrono::duration<double, std::milli>(finished - frameStart).count());
+                frameStart = finished;
+            }
+            cursor = next;
+        }
+        return true;
+    }
+
+    void Dispatch(Trace_Op op)
+    {
+        switch (op)
+        {
+        case TRACE_BEGIN_FRAMES:
+        case TRACE_FRAME_END:
+            break;
+        case TRACE_GEN_VERTEX_ARRAYS:
+            GenNames(vertexArrays, [](GLsizei n, GLuint* names) { glGenVertexArrays(n, names); });
+            break;
+        case TRACE_BIND_VERTEX_ARRAY:
+            glBindVertexArray(Map(vertexArrays, U32()));
+            break;
+        case TRACE_DELETE_VERTEX_ARRAYS:
+            DeleteNames(vertexArrays, [](GLsizei n, const GLuint* names) { glDeleteVertexArrays(n, names); });
+            break;
+        case TRACE_GEN_BUFFERS:
+            GenNames(buffers, [](GLsizei n, GLuint* names) { glGenBuffers(n, names); });
+            break;
+        case TRACE_BIND_BUFFER:
+        {
+            GLenum target = U32();
+            glBindBuffer(target, Map(buffers, U32()));
+            break;
+        }
+        case TRACE_BUFFER_DATA:
+        {
+            GLenum target = U32();
+            GLsizeiptr size = (GLsizeiptr)U64();
+            GLenum usage = U32();
+            uint64_t blobSize;
+            const void* contents = Blob(blobSize);
+            if (corrupt || (contents != nullptr && blobSize != (uint64_t)size))
+            {
+                corrupt = true;
+                break;
+            }
+            glBufferData(target, size, contents, usage);
+            break;
+        }
+        case TRACE_DELETE_BUFFERS:
+            DeleteNames(buffers, [](GLsizei n, const GLuint* names) { glDeleteBuffers(n, names); });
+            break;
+        case TRACE_VERTEX_ATTRIB_POINTER:
+        {
+            GLuint index = U32();
+            GLint size = I32();
+            GLenum type = U32();
+            GLboolean normalized = (GLboolean)U32();
+            GLsizei stride = I32();
+            glVertexAttribPointer(index, size, type, normalized, stride, (const void*)(uintptr_t)U64());
+            break;
+        }
+        case TRACE_ENABLE_VERTEX_ATTRIB_ARRAY:
+            glEnableVertexAttribArray(U32());
+            break;
+        case TRACE_DRAW_ELEMENTS:
+        {
+            GLenum mode = U32();
+            GLsizei count = I32();
+            GLenum type = U32();
+            glDrawElements(mode, count, type, (const void*)(uintptr_t)U64());
+            break;
+        }
+        case TRACE_DRAW_ARRAYS:
+        {
+            GLenum mode = U32();
+            GLint first = I32();
+            glDrawArrays(mode, first, I32());
+            break;
+        }
+        case TRACE_USE_PROGRAM:
+            currentProgram = U32();
+            glUseProgram(Map(programs, currentProgram));
+            break;
+        case TRACE_GET_UNIFORM_LOCATION:
+        {
+            GLuint program = U32();
+            GLint location = I32();
+            const GLchar* name = String();
+            if (corrupt)
+                break;
+            GLint replayed = glGetUniformLocation(Map(programs, program), name);
+            if (location >= 0)
+                locations[((uint64_t)program << 32) | (uint32_t)location] = replayed;
+            break;
+        }
+        case TRACE_UNIFORM_MATRIX4FV:
+        {
+            GLint location = Location(I32());
+            GLsizei count = I32();
+            GLboolean transpose = (GLboolean)U32();
+            const GLfloat* values = count >= 0 ? (const GLfloat*)Ptr(sizeof(GLfloat) * 16 * count) : nullptr;
+            if (values == nullptr)
+            {
+                corrupt = true;
+                break;
+            }
+            glUniformMatrix4fv(location, count, transpose, values);
+            break;
+        }
+        case TRACE_UNIFORM3F:
+        {
+            GLint location = Location(I32());
+            float x = F32();
+            float y = F32();
+            glUniform3f(location, x, y, F32());
+            break;
+        }
+        case TRACE_UNIFORM3FV:
+        {
+            GLint location = Location(I32());
+            GLsizei count = I32();
+            const GLfloat* values = count >= 0 ? (const GLfloat*)Ptr(sizeof(GLfloat) * 3 * count) : nullptr;
+            if (values == nullptr)
+            {
+                corrupt = true;
+                break;
+            }
+            glUniform3fv(location, count, values);
+            break;
+        }
+        case TRACE_UNIFORM2FV:
+        {
+            GLint location = Location(I32());
+            GLsizei count = I32();
+            const GLfloat* values = count >= 0 ? (const GLfloat*)Ptr(sizeof(GLfloat) * 2 * count) : nullptr;
+            if (values == nullptr)
+            {
+                corrupt = true;
+                break;
+            }
+            glUniform2fv(location, count, values);
+            break;
+        }
+        case TRACE_UNIFORM1I:
+        {
+            GLint location = Location(I32());
+            glUniform1i(location, I32());
+            break;
+        }
+        case TRACE_ACTIVE_TEXTURE:
+            glActiveTexture(U32());
+            break;
+        case TRACE_GEN_TEXTURES:
+            GenNames(textures, [](GLsizei n, GLuint* names) { glGenTextures(n, names); });
+            break;
+        case TRACE_BIND_TEXTURE:
+        {
+            GLenum target = U32();
+            glBindTexture(target, Map(textures, U32()));
+            break;
+        }
+        case TRACE_DELETE_TEXTURES:
+            DeleteNames(textures, [](GLsizei n, const GLuint* names) { glDeleteTextures(n, names); });
+            break;
+        case TRACE_TEX_PARAMETERI:
+        {
+            GLenum target = U32();
+            GLenum pname = U32();
+            glTexParameteri(target, pname, I32());
+            break;
+        }
+        case TRACE_TEX_PARAMETERFV:
+        {
+            GLenum target = U32();
+            GLenum pname = U32();
+            GLint count = I32();
+            const GLfloat* values = count >= 0 ? (const GLfloat*)Ptr(sizeof(GLfloat) * count) : nullptr;
+            if (values == nullptr)
+            {
+                corrupt = true;
+                break;
+            }
+            glTexParameterfv(target, pname, values);
+            break;
+        }
+        case TRACE_TEX_IMAGE_2D:
+        {
+            GLenum target = U32();
+            GLint level = I32();
+            GLint internalFormat = I32();
+            GLsizei width = I32();
+            GLsizei height = I32();
+            GLint border = I32();
+            GLenum format = U32();
+            GLenum type = U32();
+            const void* pixels = Pixels(width, height, 1, format, type);
+            if (corrupt)
+                break;
+            glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+            break;
+        }
+        case TRACE_GENERATE_MIPMAP:
+            glGenerateMipmap(U32());
+            break;
+        case TRACE_ENABLE:
+            glEnable(U32());
+            break;
+        case TRACE_DISABLE:
+            glDisable(U32());
+            break;
+        case TRACE_CLEAR:
+            glClear(U32());
+            break;
+        case TRACE_CLEAR_COLOR:
+        {
+            float r = F32();
+            float g = F32();
+            float b = F32();
+            glClearColor(r, g, b, F32());
+            break;
+        }
+        case TRACE_VIEWPORT:
+        {
+            GLint x = I32();
+            GLint y = I32();
+            GLsizei width = I32();
+            glViewport(x, y, width, I32());
+            break;
+        }
+        case TRACE_CREATE_PROGRAM:
+            programs[U32()] = glCreateProgram();
+            break;
+        case TRACE_CREATE_SHADER:
+        {
+            GLenum type = U32();
+            shaders[U32()] = glCreateShader(type);
+            break;
+        }
+        case TRACE_SHADER_SOURCE:
+        {
+            GLuint shader = Map(shaders, U32());
+            const GLchar* source = String();
+            if (corrupt)
+                break;
+            glShaderSource(shader, 1, &source, nullptr);
+            break;
+        }
+        case TRACE_COMPILE_SHADER:
+            glCompileShader(Map(shaders, U32()));
+            break;
+        case TRACE_ATTACH_SHADER:
+        {
+            GLuint program = Map(programs, U32());
+            glAttachShader(program, Map(shaders, U32()));
+            break;
+        }
+        case TRACE_LINK_PROGRAM:
+            glLinkProgram(Map(programs, U32()));
+            break;
+        case TRACE_DELETE_PROGRAM:
+        {
+            GLuint program = U32();
+            glDeleteProgram(Map(programs, program));
+            programs.erase(program);
+            break;
+        }
+        case TRACE_TEX_SUB_IMAGE_3D:
+        {
+            GLenum target = U32();
+            GLint level = I32();
+            GLint x = I32();
+            GLint y = I32();
+            GLint z = I32();
+            GLsizei width = I32();
+            GLsizei height = I32();
+            GLsizei depth = I32();
+            GLenum format = U32();
+            GLenum type = U32();
+            const void* pixels = Pixels(width, height, depth, format, type);
+            if (corrupt)
+                break;
+            glTexSubImage3D(target, level, x, y, z, width, height, depth, format, type, pixels);
+            break;
+        }
+        case TRACE_BIND_BUFFER_BASE:
+        {
+            GLenum target = U32();
+            GLuint index = U32();
+            glBindBufferBase(target, index, Map(buffers, U32()));
+            break;
+        }
+        case TRACE_VERTEX_ATTRIB_I_POINTER:
+        {
+            GLuint index = U32();
+            GLint size = I32();
+            GLenum type = U32();
+            GLsizei stride = I32();
+            glVertexAttribIPointer(index, size, type, stride, (const void*)(uintptr_t)U64());
+            break;
+        }
+        case TRACE_VERTEX_ATTRIB_DIVISOR:
+        {
+            GLuint index = U32();
+            glVertexAttribDivisor(index, U32());
+            break;
+        }
+        case TRACE_DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE:
+        {
+            GLenum mode = U32();
+            GLsizei count = I32();
+            GLenum type = U32();
+            const void* indices = (const void*)(uintptr_t)U64();
+            GLsizei instances = I32();
+            glDrawElementsInstancedBaseInstance(mode, count, type, indices, instances, U32());
+            break;
+        }
+        case TRACE_TEX_IMAGE_3D:
+        {
+            GLenum target = U32();
+            GLint level = I32();
+            GLint internalFormat = I32();
+            GLsizei width = I32();
+            GLsizei height = I32();
+            GLsizei depth = I32();
+            GLint border = I32();
+            GLenum format = U32();
+            GLenum type = U32();
+            const void* pixels = Pixels(width, height, depth, format, type);
+            if (corrupt)
+                break;
+            glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+            break;
+        }
+        default:
+            break;  // unknown ops are skipped using the record size
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "logger.h"
+
+// What GPU memory is spent on; totals are kept per category
+enum GpuCategory {
+    GPU_MESHES,         // vertex and index buffers
+    GPU_INSTANCES,      // per-instance attributes, rewritten every frame
+    GPU_MATERIALS,      // the material table
+    GPU_TEXTURES,       // sampled images and their mip chains
+    GPU_RENDER_TARGETS, // offscreen color and depth
+    GPU_READBACK,       // pixel pack buffers
+    GPU_CATEGORY_COUNT
+};
+
+const char* const GPU_CATEGORY_NAMES[GPU_CATEGORY_COUNT] = {
+    "meshes", "instances", "materials", "textures", "render targets", "readback"
+};
+
+enum GpuObjectType {
+    GPU_BUFFER,
+    GPU_TEXTURE,
+    GPU_RENDERBUFFER
+};
+
+// Creates and deletes every GL buffer, texture and renderbuffer the app keeps, and knows how many bytes
+// each holds: the size of a buffer's data store, and of every allocated level of a texture. Over the
+// budget, textures that registered an evictor give up their finest mip level. The material array is the
+// only one that does, so the budget is held by dropping levels of all its layers at once; nothing else is
+// ever evicted. GL thread only.
+class GpuResources
+{
+public:
+    size_t Budget = 0;      // bytes; 0 = no limit
+
+    static GpuResources& Instance()
+    {
+        static GpuResources resources;
+        return resources;
+    }
+
+    GLuint CreateBuffer(GpuCategory category, const char* label)
+    {
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+        Register(GPU_BUFFER, id, category, label);
+        return id;
+    }
+
+    GLuint CreateTexture(GpuCategory category, const char* label)
+    {
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        Register(GPU_TEXTURE, id, category, label);
+        return id;
+    }
+
+    GLuint CreateRenderbuffer(GpuCategory category, const char* label)
+    {
+        GLuint id = 0;
+        glGenRenderbuffers(1, &id);
+        Register(GPU_RENDERBUFFER, id, category, label);
+        return id;
+    }
+
+    // glBufferData on the buffer bound to target, which must be buffer
+    void BufferData(GLenum target, GLuint buffer, size_t bytes, const void* data, GLenum usage)
+    {
+        glBufferData(target, (GLsizeiptr)bytes, data, usage);
+        SetBytes(GPU_BUFFER, buffer, 0, bytes);
+    }
+
+    // records the size of a texture level after it was (re)allocated; 0 when it was freed
+    void SetLevelBytes(GLuint texture, int level, size_t bytes)
+    {
+        SetBytes(GPU_TEXTURE, texture, level, bytes);
+    }
+
+    void SetRenderbufferBytes(GLuint renderbuffer, size_t bytes)
+    {
+        SetBytes(GPU_RENDERBUFFER, renderbuffer, 0, bytes);
+    }
+
+    // lets the budget shrink a texture: evict frees its finest level (and records it with SetLevelBytes),
+    // or returns false when the texture is down to the levels it has to keep
+    void SetEvictor(GLuint texture, std::function<bool()> evict)
+    {
+        GpuObject* object = Find(GPU_TEXTURE, texture);
+        if (object != nullptr)
+            object->Evict = evict;
+    }
+
+    // once per frame, after drawing: evicts texture levels until the total fits the budget
+    void EndFrame()
+    {
+        bool fits = MakeRoom();
+        if (!fits && !overBudget)
+        {
+            LOG(LOG_WARN, "GPU memory %.1f MB stays over the %.1f MB budget after evicting every texture level it can",
+                total / (1024.0 * 1024.0), Budget / (1024.0 * 1024.0));
+            LogTotals();
+        }
+        overBudget = !fits;
+    }
+
+    // deletes the object and sets id to 0
+    void Release(GpuObjectType type, GLuint& id)
+    {
+        if (id == 0)
+            return;
+        auto it = objects.find(Key(type, id));
+        if (it != objects.end())
+        {
+            Forget(it->second);
+            objects.erase(it);
+        }
+        Delete(type, id);
+        id = 0;
+    }
+
+    // deletes whatever is still registered; anything left at shutdown was leaked, so it is reported
+    void ReleaseAll()
+    {
+        for (auto it = objects.begin(); it != objects.end(); ++it)
+        {
+            LOG(LOG_WARN, "Releasing leaked GPU %s \"%s\" (%.2f MB)", GPU_CATEGORY_NAMES[it->second.Category],
+                it->second.Label.c_str(), it->second.Bytes / (1024.0 * 1024.0));
+            GLuint id = (GLuint)(it->first & 0xffffffffu);
+            Delete((GpuObjectType)(it->first >> 32), id);
+        }
+        objects.clear();
+        total = 0;
+        for (int c = 0; c < GPU_CATEGORY_COUNT; c++)
+            totals[c] = 0;
+    }
+
+    size_t Total() const { return total; }
+    size_t Total(GpuCategory category) const { return totals[category]; }
+    size_t Peak() const { return peak; }
+    size_t Evictions() const { return evictions; }     // texture levels the budget freed so far
+
+    // bytes an object holds now (0 if it is unknown)
+    size_t Bytes(GpuObjectType type, GLuint id) const
+    {
+        auto it = objects.find(Key(type, id));
+        return it != objects.end() ? it->second.Bytes : 0;
+    }
+
+    void LogTotals() const
+    {
+        std::string line;
+        char part[64];
+        for (int c = 0; c < GPU_CATEGORY_COUNT; c++)
+        {
+            snprintf(part, sizeof(part), "%s%s %.2f MB", c > 0 ? ", " : "", GPU_CATEGORY_NAMES[c], totals[c] / (1024.0 * 1024.0));
+            line += part;
+        }
+        LOG(LOG_INFO, "GPU memory %.2f MB (peak %.2f MB, %d objects): %s", total / (1024.0 * 1024.0), peak / (1024.0 * 1024.0),
+            (int)objects.size(), line.c_str());
+    }
+
+private:
+    struct GpuObject
+    {
+        GpuCategory Category = GPU_MESHES;
+        std::string Label;
+        std::vector<size_t> Levels;     // bytes per mip level; buffers and renderbuffers only use the first
+        size_t Bytes = 0;               // sum of Levels
+        std::function<bool()> Evict;
+    };
+
+    std::unordered_map<uint64_t, GpuObject> objects;
+    size_t totals[GPU_CATEGORY_COUNT] = {};
+    size_t total = 0;
+    size_t peak = 0;
+    size_t evictions = 0;
+    bool overBudget = false;
+
+    GpuResources() {}
+
+    static uint64_t Key(GpuObjectType type, GLuint id) { return ((uint64_t)type << 32) | id; }
+
+    GpuObject* Find(GpuObjectType type, GLuint id)
+    {
+        auto it = objects.find(Key(type, id));
+        return it != objects.end() ? &it->second : nullptr;
+    }
+
+    void Register(GpuObjectType type, GLuint id, GpuCategory category, const char* label)
+    {
+        GpuObject& object = objects[Key(type, id)];
+        object.Category = category;
+        object.Label = label;
+    }
+
+    void SetBytes(GpuObjectType type, GLuint id, int level, size_t bytes)
+    {
+        GpuObject* object = Find(type, id);
+        if (object == nullptr)
+        {
+            LOG(LOG_ERROR, "GPU object %u was not created through GpuResources; its memory is not counted", id);
+            return;
+        }
+        if ((int)object->Levels.size() <= level)
+            object->Levels.resize(level + 1, 0);
+
+        size_t previous = object->Levels[level];
+        object->Levels[level] = bytes;
+        object->Bytes += bytes - previous;
+        totals[object->Category] += bytes - previous;
+        total += bytes - previous;
+        peak = std::max(peak, total);
+    }
+
+    // one level at a time, so a texture only shrinks as far as it has to; false if the total still does not fit
+    bool MakeRoom()
+    {
+        if (Budget == 0 || total <= Budget)
+            return true;
+        std::vector<std::function<bool()>> evictors;
+        for (auto it = objects.begin(); it != objects.end(); ++it)
+        {
+            if (it->second.Evict)
+                evictors.push_back(it->second.Evict);
+        }
+        for (size_t i = 0; i < evictors.size() && total > Budget; i++)
+        {
+            while (total > Budget && evictors[i]())
+                evictions++;
+        }
+        return total <= Budget;
+    }
+
+    void Forget(const GpuObject& object)
+    {
+        totals[object.Category] -= object.Bytes;
+        total -= object.Bytes;
+    }
+
+    static void Delete(GpuObjectType type, GLuint id)
+    {
+        if (type == GPU_BUFFER)
+            glDeleteBuffers(1, &id);
+        else if (type == GPU_TEXTURE)
+            glDeleteTextures(1, &id);
+        else
+            glDeleteRenderbuffers(1, &id);
+    }
+};
+
+#endif
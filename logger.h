@@ -0,0 +1,350 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// Severity levels, from the most verbose to the most important
+enum Log_Level {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+};
+
+// Messages below this level are compiled out; override with /D LOG_MIN_LEVEL=0 for debug output
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+// Logging settings
+const int LOG_MAX_THREADS = 16;         // threads that may log (each gets its own ring)
+const int LOG_RING_SIZE = 256;          // messages buffered per thread, must be a power of two
+const int LOG_MESSAGE_SIZE = 512;       // longest message, longer ones are truncated
+const int LOG_RATE_LIMIT = 5;           // repeats of the same text allowed per call site per window (INFO and DEBUG)
+const long long LOG_RATE_WINDOW_MS = 1000;
+
+// A formatted message waiting for the writer thread
+struct LogRecord
+{
+    int Level;
+    long long TimeMs;
+    char Text[LOG_MESSAGE_SIZE];
+};
+
+// Single-producer / single-consumer ring owned by one logging thread; the writer thread is the only consumer
+struct LogRing
+{
+    LogRecord Records[LOG_RING_SIZE];
+    std::atomic<unsigned> Head{ 0 };    // next slot the owning thread writes
+    std::atomic<unsigned> Tail{ 0 };    // next slot the writer thread reads
+};
+
+// Per call site state used to rate limit messages repeated every frame
+struct LogSite
+{
+    const char* File;
+    int Line;
+    int Level;
+    std::atomic<uint32_t> LastHash{ 0 };    // text of the message the current window counts
+    std::atomic<long long> WindowStart{ -LOG_RATE_WINDOW_MS };
+    std::atomic<int> Count{ 0 };
+    std::atomic<int> Suppressed{ 0 };       // repeats dropped and not reported yet
+    std::atomic<bool> Listed{ false };      // on the logger's list of sites the writer reports for
+    LogSite* Next = nullptr;
+
+    LogSite(const char* file, int line, int level) : File(file), Line(line), Level(level) {}
+};
+
+// Asynchronous logger: callers format into their own lock-free ring and never wait on the console,
+// a background thread drains all rings and does the actual (slow) writes
+class Logger
+{
+public:
+    static Logger& Instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    // starts the writer thread; messages logged before this are written synchronously
+    void Start()
+    {
+        if (running.exchange(true))
+            return;
+        writer = std::thread(&Logger::WriterLoop, this);
+        std::atexit(StopAtExit);
+    }
+
+    // stops the writer thread after everything already queued has been written
+    void Stop()
+    {
+        if (!running.exchange(false))
+            return;
+        writer.join();
+        Drain();
+        ReportSuppressed(true);
+        fflush(stdout);
+    }
+
+    // returns once everything logged before the call has been written, so console output printed
+    // afterwards (benchmark reports) does not interleave with it
+    void Flush()
+    {
+        int count = ringCount.load(std::memory_order_acquire);
+        if (count > LOG_MAX_THREADS)
+            count = LOG_MAX_THREADS;
+        for (int i = 0; i < count && running.load(std::memory_order_acquire); i++)
+        {
+            LogRing* ring = rings[i].load(std::memory_order_acquire);
+            if (ring == nullptr)
+                continue;
+            unsigned head = ring->Head.load(std::memory_order_acquire);
+            while ((int)(head - ring->Tail.load(std::memory_order_acquire)) > 0 && running.load(std::memory_order_acquire))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        fflush(stdout);
+    }
+
+    // formats and queues a message; drops it (and counts the drop) instead of blocking when the ring is full
+    void Write(Log_Level level, LogSite& site, const char* format, ...)
+    {
+        LogRecord record;
+        record.Level = level;
+        record.TimeMs = NowMs();
+        va_list args;
+        va_start(args, format);
+        vsnprintf(record.Text, sizeof(record.Text), format, args);
+        va_end(args);
+
+        int suppressed = 0;
+        if (!AllowMessage(site, level, Hash(record.Text), record.TimeMs, suppressed))
+        {
+            ListSite(site);
+            return;
+        }
+
+        // repeats of the site's previous text that were never reported go out before the new text
+        if (suppressed > 0)
+        {
+            LogRecord report;
+            FormatSuppressed(report, site, record.TimeMs, suppressed);
+            Queue(report);
+        }
+        Queue(record);
+    }
+
+private:
+    std::atomic<LogRing*> rings[LOG_MAX_THREADS];
+    std::atomic<int> ringCount{ 0 };
+    std::atomic<int> dropped{ 0 };
+    std::atomic<LogSite*> sites{ nullptr };     // sites that have suppressed something, for the writer to report
+    std::atomic<bool> running{ false };
+    std::thread writer;
+    std::chrono::steady_clock::time_point startTime;
+
+    Logger() : startTime(std::chrono::steady_clock::now())
+    {
+        for (int i = 0; i < LOG_MAX_THREADS; i++)
+            rings[i].store(nullptr);
+    }
+
+    ~Logger()
+    {
+        Stop();
+        for (int i = 0; i < LOG_MAX_THREADS; i++)
+            delete rings[i].load();
+    }
+
+    static void StopAtExit()
+    {
+        Instance().Stop();
+    }
+
+    long long NowMs() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    // returns this thread's ring, registering it on first use (lock-free, one slot per thread)
+    LogRing* ThreadRing()
+    {
+        thread_local LogRing* ring = nullptr;
+        thread_local bool registered = false;
+        if (!registered)
+        {
+            registered = true;
+            int index = ringCount.fetch_add(1);
+            if (index < LOG_MAX_THREADS)
+            {
+                ring = new LogRing();
+                rings[index].store(ring, std::memory_order_release);
+            }
+        }
+        return ring;
+    }
+
+    // FNV-1a of a message's text, to tell repeats from new messages
+    static uint32_t Hash(const char* text)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *text != '\0'; text++)
+            hash = (hash ^ (unsigned char)*text) * 16777619u;
+        return hash;
+    }
+
+    // warnings and errors always pass. Other messages pass LOG_RATE_LIMIT times per window while a site
+    // keeps repeating the same text; a different text starts a new window and hands back how many
+    // repeats of the old one were dropped and not reported yet.
+    static bool AllowMessage(LogSite& site, Log_Level level, uint32_t hash, long long now, int& suppressed)
+    {
+        if (level >= LOG_WARN)
+            return true;
+
+        uint32_t last = site.LastHash.exchange(hash, std::memory_order_relaxed);
+        long long windowStart = site.WindowStart.load(std::memory_order_relaxed);
+        if (last != hash || now - windowStart >= LOG_RATE_WINDOW_MS)
+        {
+            site.WindowStart.store(now, std::memory_order_relaxed);
+            site.Count.store(1, std::memory_order_relaxed);
+            suppressed = site.Suppressed.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+
+        if (site.Count.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_LIMIT)
+        {
+            site.Suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // puts the site on the list the writer reports suppressed repeats from, once
+    void ListSite(LogSite& site)
+    {
+        if (site.Listed.exchange(true))
+            return;
+        LogSite* head = sites.load(std::memory_order_relaxed);
+        do
+            site.Next = head;
+        while (!sites.compare_exchange_weak(head, &site, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    static void FormatSuppressed(LogRecord& record, const LogSite& site, long long now, int suppressed)
+    {
+        record.Level = site.Level;
+        record.TimeMs = now;
+        snprintf(record.Text, sizeof(record.Text), "%s:%d: previous message repeated %d more times", site.File, site.Line,
+            suppressed);
+    }
+
+    // hands a record to the writer thread, or writes it directly when there is none (startup / shutdown)
+    void Queue(const LogRecord& record)
+    {
+        LogRing* ring = ThreadRing();
+        if (!running.load(std::memory_order_acquire) || ring == nullptr)
+        {
+            Print(record);
+            fflush(stdout);
+            return;
+        }
+
+        unsigned head = ring->Head.load(std::memory_order_relaxed);
+        if (head - ring->Tail.load(std::memory_order_acquire) >= (unsigned)LOG_RING_SIZE)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring->Records[head & (LOG_RING_SIZE - 1)] = record;
+        ring->Head.store(head + 1, std::memory_order_release);
+    }
+
+    // writer thread: reports the repeats each site dropped in a window that has closed (or in any
+    // window, at shutdown), so a site that never logs again does not lose its count
+    int ReportSuppressed(bool all)
+    {
+        int written = 0;
+        long long now = NowMs();
+        for (LogSite* site = sites.load(std::memory_order_acquire); site != nullptr; site = site->Next)
+        {
+            if (site->Suppressed.load(std::memory_order_relaxed) == 0
+                || (!all && now - site->WindowStart.load(std::memory_order_relaxed) < LOG_RATE_WINDOW_MS))
+                continue;
+            int suppressed = site->Suppressed.exchange(0, std::memory_order_relaxed);
+            if (suppressed == 0)
+                continue;
+            LogRecord record;
+            FormatSuppressed(record, *site, now, suppressed);
+            Print(record);
+            written++;
+        }
+        return written;
+    }
+
+    static void Print(const LogRecord& record)
+    {
+        static const char* const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+        fprintf(stdout, "[%7.3f] %s: %s\n", record.TimeMs / 1000.0, LEVEL_NAMES[record.Level], record.Text);
+    }
+
+    // writes everything currently queued in every ring; returns the number of messages written
+    int Drain()
+    {
+        int written = 0;
+        int count = ringCount.load(std::memory_order_acquire);
+        if (count > LOG_MAX_THREADS)
+            count = LOG_MAX_THREADS;
+
+        for (int i = 0; i < count; i++)
+        {
+            LogRing* ring = rings[i].load(std::memory_order_acquire);
+            if (ring == nullptr)
+                continue;
+
+            unsigned tail = ring->Tail.load(std::memory_order_relaxed);
+            unsigned head = ring->Head.load(std::memory_order_acquire);
+            for (; tail != head; tail++, written++)
+                Print(ring->Records[tail & (LOG_RING_SIZE - 1)]);
+            ring->Tail.store(tail, std::memory_order_release);
+        }
+
+        int lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost > 0)
+        {
+            fprintf(stdout, "[%7.3f] WARN: %d log messages dropped (ring full)\n", NowMs() / 1000.0, lost);
+            written++;
+        }
+        return written;
+    }
+
+    void WriterLoop()
+    {
+        while (running.load(std::memory_order_acquire))
+        {
+            if (Drain() + ReportSuppressed(false) > 0)
+                fflush(stdout);
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+};
+
+// Logs a printf-style message if the level is enabled at compile time; repeats of the same text from one call site
+// are rate limited
+#define LOG(level, ...)                                             \
+    do                                                              \
+    {                                                               \
+        if ((level) >= LOG_MIN_LEVEL)                               \
+        {                                                           \
+            static LogSite logSite_(__FILE__, __LINE__, (level));   \
+            Logger::Instance().Write((level), logSite_, __VA_ARGS__); \
+        }                                                           \
+    } while (0)
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gpuresources.h"
+#include "logger.h"
+#include "texturestream.h"
+#include "workerpool.h"
+
+// Shader storage binding of the material table; must match "binding = 0" of the Materials block in the shader
+const GLuint MATERIAL_BUFFER_BINDING = 0;
+
+// One entry of the material table, laid out like the std430 Material struct of the shader
+struct Material
+{
+    glm::vec2 UVScale = glm::vec2(1.0f);    // texture repeats, on top of the global uvScale
+    float SpecularIntensity = 0.1f;
+    float HighlightSize = 16.0f;            // specular exponent
+    int32_t Layer = 0;                      // texture array layer
+    float MinLevel = 0.0f;                  // finest mip level of the layer holding data (set by MaterialSystem)
+};
+static_assert(sizeof(Material) == 24, "Material must match the std430 layout of the shader struct");
+
+// All textures of the scene as layers of one GL_TEXTURE_2D_ARRAY and all materials in one shader storage
+// buffer, so objects differ only in a per-instance material index and any mix of them can be drawn in one
+// instanced call. Layers share one size: smaller or differently shaped images are resampled to the largest
+// width and height among them. Over the GpuResources budget the array gives up its finest levels, for
+// all layers at once, down to the thumbnail size.
+class MaterialSystem
+{
+public:
+    GLuint TextureArray = 0;
+    GLuint Buffer = 0;          // material table
+    int LayerWidth = 0;
+    int LayerHeight = 0;
+    bool KeepPixels = false;    // keep the decoded mip chains of layers loaded up front (for CPU rendering)
+
+    // before Build: queues an image as the next layer and returns the layer index, or -1 if it cannot be read
+    int AddLayer(const char* path)
+    {
+        int width, height, channels;
+        if (!stbi_info(path, &width, &height, &channels))
+            return -1;
+        LayerWidth = std::max(LayerWidth, width);
+        LayerHeight = std::max(LayerHeight, height);
+        layers.push_back(MaterialLayer());
+        layers.back().Path = path;
+        return (int)layers.size() - 1;
+    }
+
+    // returns the material's index in the table
+    int AddMaterial(const Material& material)
+    {
+        materials.push_back(material);
+        return (int)materials.size() - 1;
+    }
+
+    int Count() const { return (int)materials.size(); }
+    const Material& Get(int index) const { return materials[index]; }
+
+    int LayerCount() const { return (int)layers.size(); }
+
+    // streaming handle of a layer, -1 when it was loaded up front
+    int LayerStream(int layer) const { return layers[layer].Stream; }
+
+    // RGBA mip chain of a layer, bottom row first; empty unless KeepPixels was set and the layer was loaded up front
+    const std::vector<std::vector<unsigned char>>& LayerLevels(int layer) const { return layers[layer].Levels; }
+
+    // allocates the array and the material table. Layers either stream in through the TextureStreamer
+    // (configure its budgets first) or are decoded in parallel and uploaded in full right here.
+    bool Build(bool stream)
+    {
+        if (layers.empty())
+            return false;
+
+        // level by level rather than immutable storage, so that levels can be freed again
+        GpuResources& resources = GpuResources::Instance();
+        int levels = TextureStreamer::MipLevelCount(LayerWidth, LayerHeight);
+        TextureArray = resources.CreateTexture(GPU_TEXTURES, "material array");
+        glBindTexture(GL_TEXTURE_2D_ARRAY, TextureArray);
+        for (int level = 0; level < levels; level++)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, LevelWidth(level), LevelHeight(level), (GLsizei)layers.size(), 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            resources.SetLevelBytes(TextureArray, level, LevelBytes(level));
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        bool loaded = stream ? StreamLayers() : LoadLayers();
+        resources.SetEvictor(TextureArray, [this]() { return DropLevel(); });
+
+        Buffer = resources.CreateBuffer(GPU_MATERIALS, "material table");
+        uploaded = materials;
+        Refresh();
+        Upload();
+        return loaded;
+    }
+
+    // copies the finest streamed level of every layer into the table; call after TextureStreamer::Update
+    void Update()
+    {
+        if (Refresh())
+            Upload();
+    }
+
+    // binds the array to the texture unit and the table to its storage binding
+    void Bind(GLuint unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, TextureArray);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, Buffer);
+    }
+
+    void Destroy()
+    {
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            if (layers[i].Stream >= 0)
+                TextureStreamer::Instance().Destroy(layers[i].Stream);
+            layers[i].Stream = -1;
+        }
+        GpuResources::Instance().Release(GPU_TEXTURE, TextureArray);
+        GpuResources::Instance().Release(GPU_BUFFER, Buffer);
+        baseLevel = 0;
+    }
+
+private:
+    struct MaterialLayer
+    {
+        std::string Path;
+        int Stream = -1;
+        std::vector<std::vector<unsigned char>> Levels;     // with KeepPixels
+    };
+
+    std::vector<MaterialLayer> layers;
+    std::vector<Material> materials;
+    std::vector<Material> uploaded;     // the table as the GPU has it
+    int baseLevel = 0;                  // finest level the array still has storage for
+
+    int LevelWidth(int level) const { return std::max(LayerWidth >> level, 1); }
+    int LevelHeight(int level) const { return std::max(LayerHeight >> level, 1); }
+    size_t LevelBytes(int level) const { return (size_t)LevelWidth(level) * LevelHeight(level) * 4 * layers.size(); }
+
+    // evictor of the array: frees the finest level of every layer, unless the next one is already below
+    // the thumbnail size (levels that small cost little and everything would turn to mush)
+    bool DropLevel()
+    {
+        int next = baseLevel + 1;
+        if (next >= TextureStreamer::MipLevelCount(LayerWidth, LayerHeight)
+            || std::max(LevelWidth(next), LevelHeight(next)) < TEXTURE_THUMB_SIZE)
+            return false;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, TextureArray);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, next);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, baseLevel, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        GpuResources::Instance().SetLevelBytes(TextureArray, baseLevel, 0);
+        baseLevel = next;
+        LOG(LOG_WARN, "GPU memory budget: material textures dropped to %dx%d", LevelWidth(baseLevel), LevelHeight(baseLevel));
+
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            if (layers[i].Stream >= 0)
+                TextureStreamer::Instance().LimitLevel(layers[i].Stream, baseLevel);
+        }
+        for (size_t i = 0; i < uploaded.size(); i++)
+            uploaded[i].MinLevel = std::max(uploaded[i].MinLevel, (float)baseLevel);
+        Upload();
+        return true;
+    }
+
+    bool StreamLayers()
+    {
+        TextureStreamer& streamer = TextureStreamer::Instance();
+        streamer.Start();
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            layers[i].Stream = streamer.CreateLayer(layers[i].Path.c_str(), TextureArray, (int)i, LayerWidth, LayerHeight);
+            if (layers[i].Stream < 0)
+            {
+                LOG(LOG_ERROR, "Failed to stream texture %s", layers[i].Path.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool LoadLayers()
+    {
+        // decoding and mip building dominate, and every layer is independent
+        std::vector<std::vector<std::vector<unsigned char>>> levels(layers.size());
+        std::vector<char> decoded(layers.size(), 0);
+        WorkerPool pool;
+        pool.Start(std::min((int)layers.size(), (int)std::thread::hardware_concurrency()), layers.size());
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            pool.Submit([this, i, &levels, &decoded]()
+            {
+                int width, height;
+                decoded[i] = TextureStreamer::Decode(layers[i].Path.c_str(), levels[i], width, height, LayerWidth, LayerHeight);
+            });
+        }
+        pool.Stop();
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, TextureArray);
+        bool loaded = true;
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            if (!decoded[i])
+            {
+                LOG(LOG_ERROR, "Failed to load texture %s", layers[i].Path.c_str());
+                loaded = false;
+                continue;
+            }
+            for (size_t level = 0; level < levels[i].size(); level++)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)i, std::max(LayerWidth >> level, 1),
+                    std::max(LayerHeight >> level, 1), 1, GL_RGBA, GL_UNSIGNED_BYTE, levels[i][level].data());
+            }
+            if (KeepPixels)
+                layers[i].Levels.swap(levels[i]);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return loaded;
+    }
+
+    // true when a layer's finest resident level changed since the last upload
+    bool Refresh()
+    {
+        bool changed = false;
+        for (size_t i = 0; i < uploaded.size(); i++)
+        {
+            int stream = layers[uploaded[i].Layer].Stream;
+            float level = (float)std::max(stream >= 0 ? TextureStreamer::Instance().ResidentLevel(stream) : 0, baseLevel);
+            changed |= uploaded[i].MinLevel != level;
+            uploaded[i].MinLevel = level;
+        }
+        return changed;
+    }
+
+    void Upload()
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, Buffer);
+        GpuResources::Instance().BufferData(GL_SHADER_STORAGE_BUFFER, Buffer, uploaded.size() * sizeof(Material), uploaded.data(),
+            GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,545 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <glad/glad.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary mesh file (.eggm): a fixed header, then the vertex blob and the index blob, each aligned so
+// they can be handed to glBufferData straight from a memory mapping
+const char MESH_FILE_MAGIC[4] = { 'E', 'G', 'G', 'M' };
+const uint32_t MESH_FILE_VERSION = 3;   // 2 added position dequantization and flags, 3 the LOD table
+const uint32_t MESH_FILE_ALIGNMENT = 64;
+const int MESH_FILE_MAX_ATTRIBUTES = 8;
+const int MESH_FILE_MAX_LODS = 8;
+const uint32_t MESH_FILE_OCT_NORMALS = 1;   // normals are octahedral encoded in two components
+
+// One level of detail: a range of the index blob, finest level first
+struct MeshFileLod
+{
+    uint32_t FirstIndex;
+    uint32_t IndexCount;
+    float Error;            // largest distance of the original surface from this level, in object units
+    uint32_t Reserved;
+};
+
+// One vertex attribute, in glVertexAttribPointer terms
+struct MeshFileAttribute
+{
+    uint32_t Location;
+    uint32_t Components;
+    uint32_t Type;          // GL_FLOAT, GL_SHORT, ...
+    uint32_t Normalized;
+    uint32_t Offset;        // bytes from the start of the vertex
+};
+
+struct MeshFileHeader
+{
+    char Magic[4];
+    uint32_t Version;
+    uint32_t HeaderSize;    // sizeof(MeshFileHeader) for this version
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+    uint32_t IndexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t VertexStride;
+    uint32_t AttributeCount;
+    MeshFileAttribute Attributes[MESH_FILE_MAX_ATTRIBUTES];
+    float BoundsMin[3];
+    float BoundsMax[3];
+    uint64_t VertexOffset;
+    uint64_t VertexBytes;
+    uint64_t IndexOffset;
+    uint64_t IndexBytes;
+    // version 2
+    float PositionScale[3]; // object position = stored position * scale + bias
+    float PositionBias[3];
+    uint32_t Flags;
+    // version 3
+    uint32_t LodCount;      // 1 or more; older files are read as a single level covering all indices
+    MeshFileLod Lods[MESH_FILE_MAX_LODS];
+};
+
+// Sizes of the older headers, which end at IndexBytes and Flags
+const uint32_t MESH_FILE_HEADER_SIZE_V1 = (uint32_t)offsetof(MeshFileHeader, PositionScale);
+const uint32_t MESH_FILE_HEADER_SIZE_V2 = (uint32_t)offsetof(MeshFileHeader, LodCount);
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    const unsigned char* Data;
+    size_t Size;
+
+    MappedFile() : Data(nullptr), Size(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+    {
+    }
+    ~MappedFile() { Close(); }
+
+    bool Open(const char* path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            Close();
+            return false;
+        }
+        Data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        Size = (size_t)size.QuadPart;
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        // the whole file is about to be read front to back by the driver
+        madvise(mapped, (size_t)info.st_size, MADV_SEQUENTIAL);
+        madvise(mapped, (size_t)info.st_size, MADV_WILLNEED);
+        Data = (const unsigned char*)mapped;
+        Size = (size_t)info.st_size;
+#endif
+        if (Data == nullptr)
+            Close();
+        return Data != nullptr;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (Data != nullptr)
+            UnmapViewOfFile(Data);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (Data != nullptr)
+            munmap((void*)Data, Size);
+#endif
+        Data = nullptr;
+        Size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// Checks a mapped mesh file and copies out its header (fields newer than the file get their defaults);
+// returns false if the file is not a valid mesh
+inline bool MeshFileValidate(const MappedFile& file, MeshFileHeader& header)
+{
+    if (file.Size < MESH_FILE_HEADER_SIZE_V1)
+        return false;
+
+    const MeshFileHeader* stored = (const MeshFileHeader*)file.Data;
+    uint32_t expectedSize = stored->Version == 1 ? MESH_FILE_HEADER_SIZE_V1
+        : (stored->Version == 2 ? MESH_FILE_HEADER_SIZE_V2 : (uint32_t)sizeof(MeshFileHeader));
+    if (memcmp(stored->Magic, MESH_FILE_MAGIC, sizeof(stored->Magic)) != 0 || stored->Version < 1 || stored->Version > MESH_FILE_VERSION
+        || stored->HeaderSize != expectedSize || file.Size < expectedSize || stored->AttributeCount > (uint32_t)MESH_FILE_MAX_ATTRIBUTES)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(&header, stored, expectedSize);
+    if (header.Version == 1)
+    {
+        for (int i = 0; i < 3; i++)
+            header.PositionScale[i] = 1.0f;
+    }
+    if (header.Version < 3)
+    {
+        header.LodCount = 1;
+        header.Lods[0].FirstIndex = 0;
+        header.Lods[0].IndexCount = header.IndexCount;
+        header.Lods[0].Error = 0.0f;
+    }
+
+    if (header.LodCount < 1 || header.LodCount > (uint32_t)MESH_FILE_MAX_LODS)
+        return false;
+    for (uint32_t i = 0; i < header.LodCount; i++)
+    {
+        if ((uint64_t)header.Lods[i].FirstIndex + header.Lods[i].IndexCount > header.IndexCount)
+            return false;
+    }
+
+    // every attribute has to be one the vertex decoder reads, and lie within the vertex
+    for (uint32_t i = 0; i < header.AttributeCount; i++)
+    {
+        const MeshFileAttribute& attribute = header.Attributes[i];
+        uint32_t componentSize = attribute.Type == GL_FLOAT ? 4 : 2;
+        if ((attribute.Type != GL_FLOAT && attribute.Type != GL_HALF_FLOAT && attribute.Type != GL_SHORT)
+            || attribute.Components < 1 || attribute.Components > 4
+            || (uint64_t)attribute.Offset + attribute.Components * componentSize > header.VertexStride)
+            return false;
+    }
+
+    if (header.IndexType != GL_UNSIGNED_SHORT && header.IndexType != GL_UNSIGNED_INT)
+        return false;
+    uint32_t indexSize = header.IndexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    return header.VertexBytes == (uint64_t)header.VertexCount * header.VertexStride
+        && header.IndexBytes == (uint64_t)header.IndexCount * indexSize
+        && header.VertexOffset + header.VertexBytes <= file.Size
+        && header.IndexOffset + header.IndexBytes <= file.Size;
+}
+
+// Copies the indices of a validated mesh file out as 32 bit values. False if one of them addresses a
+// vertex past VertexCount; the validator leaves that to this pass, which only CPU copies of a mesh need.
+inline bool MeshFileReadIndices(const MappedFile& file, const MeshFileHeader& header, std::vector<uint32_t>& indices)
+{
+    const unsigned char* bytes = file.Data + header.IndexOffset;
+    indices.resize(header.IndexCount);
+    for (uint32_t i = 0; i < header.IndexCount; i++)
+    {
+        if (header.IndexType == GL_UNSIGNED_SHORT)
+        {
+            uint16_t index;
+            memcpy(&index, bytes + i * sizeof(index), sizeof(index));
+            indices[i] = index;
+        }
+        else
+            memcpy(&indices[i], bytes + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (indices[i] >= header.VertexCount)
+            return false;
+    }
+    return true;
+}
+
+// Interleaved float mesh used by the importers and the converter: position(3) normal(3) uv(2)
+struct MeshFileSource
+{
+    std::vector<float> Vertices;
+    std::vector<uint32_t> Indices;
+    static const int FLOATS_PER_VERTEX = 8;
+
+    uint32_t VertexCount() const { return (uint32_t)(Vertices.size() / FLOATS_PER_VERTEX); }
+};
+
+// Writes a mesh in the binary format; the attribute layout describes the vertex blob as given, and
+// without a LOD table all indices form one level
+inline bool MeshFileWrite(const char* path, const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+    const MeshFileAttribute* attributes, uint32_t attributeCount, const uint32_t* indices, uint32_t indexCount,
+    const float boundsMin[3], const float boundsMax[3], const float positionScale[3], const float positionBias[3], uint32_t flags,
+    const MeshFileLod* lods = nullptr, uint32_t lodCount = 0)
+{
+    if (attributeCount > (uint32_t)MESH_FILE_MAX_ATTRIBUTES || lodCount > (uint32_t)MESH_FILE_MAX_LODS)
+        return false;
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, MESH_FILE_MAGIC, sizeof(header.Magic));
+    header.Version = MESH_FILE_VERSION;
+    header.HeaderSize = sizeof(MeshFileHeader);
+    header.VertexCount = vertexCount;
+    header.IndexCount = indexCount;
+    header.IndexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    header.VertexStride = vertexStride;
+    header.AttributeCount = attributeCount;
+    memcpy(header.Attributes, attributes, sizeof(MeshFileAttribute) * attributeCount);
+    memcpy(header.BoundsMin, boundsMin, sizeof(header.BoundsMin));
+    memcpy(header.BoundsMax, boundsMax, sizeof(header.BoundsMax));
+    memcpy(header.PositionScale, positionScale, sizeof(header.PositionScale));
+    memcpy(header.PositionBias, positionBias, sizeof(header.PositionBias));
+    header.Flags = flags;
+    if (lodCount == 0)
+    {
+        header.LodCount = 1;
+        header.Lods[0].IndexCount = indexCount;
+    }
+    else
+    {
+        header.LodCount = lodCount;
+        memcpy(header.Lods, lods, sizeof(MeshFileLod) * lodCount);
+    }
+
+    uint32_t indexSize = header.IndexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    header.VertexBytes = (uint64_t)vertexCount * vertexStride;
+    header.IndexBytes = (uint64_t)indexCount * indexSize;
+    header.VertexOffset = (sizeof(MeshFileHeader) + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+    header.IndexOffset = (header.VertexOffset + header.VertexBytes + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    static const char padding[MESH_FILE_ALIGNMENT] = { 0 };
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(padding, 1, (size_t)(header.VertexOffset - sizeof(header)), file);
+    fwrite(vertices, 1, (size_t)header.VertexBytes, file);
+    fwrite(padding, 1, (size_t)(header.IndexOffset - header.VertexOffset - header.VertexBytes), file);
+
+    if (indexSize == 2)
+    {
+        std::vector<uint16_t> shortIndices(indices, indices + indexCount);
+        fwrite(shortIndices.data(), sizeof(uint16_t), indexCount, file);
+    }
+    else
+        fwrite(indices, sizeof(uint32_t), indexCount, file);
+
+    bool written = ferror(file) == 0;
+    fclose(file);
+    return written;
+}
+
+// Writes a MeshFileSource with the standard position/normal/uv float layout
+inline bool MeshFileWrite(const char* path, const MeshFileSource& source)
+{
+    const MeshFileAttribute attributes[3] = {
+        { 0, 3, GL_FLOAT, GL_FALSE, 0 },
+        { 1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3 },
+        { 2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 6 }
+    };
+
+    float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t v = 0; v < source.Vertices.size(); v += MeshFileSource::FLOATS_PER_VERTEX)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            boundsMin[i] = std::fmin(boundsMin[i], source.Vertices[v + i]);
+            boundsMax[i] = std::fmax(boundsMax[i], source.Vertices[v + i]);
+        }
+    }
+
+    const float identityScale[3] = { 1.0f, 1.0f, 1.0f };
+    const float identityBias[3] = { 0.0f, 0.0f, 0.0f };
+    return MeshFileWrite(path, source.Vertices.data(), source.VertexCount(), sizeof(float) * MeshFileSource::FLOATS_PER_VERTEX,
+        attributes, 3, source.Indices.data(), (uint32_t)source.Indices.size(), boundsMin, boundsMax, identityScale, identityBias, 0);
+}
+
+// Minimal Wavefront OBJ importer (v/vt/vn/f, polygons are fan-triangulated); vertices are de-duplicated
+// per position/uv/normal combination and smooth normals are generated when the file has none
+class ObjImporter
+{
+public:
+    bool Load(const char* path, MeshFileSource& mesh)
+    {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+
+        std::vector<char> text;
+        char chunk[1 << 16];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            text.insert(text.end(), chunk, chunk + read);
+        fclose(file);
+        text.push_back('\0');
+
+        positions.clear();
+        uvs.clear();
+        normals.clear();
+        corners.clear();
+        mesh.Vertices.clear();
+        mesh.Indices.clear();
+
+        const char* cursor = text.data();
+        while (*cursor != '\0')
+        {
+            if (cursor[0] == 'v' && cursor[1] == ' ')
+                ReadFloats(cursor + 2, 3, positions);
+            else if (cursor[0] == 'v' && cursor[1] == 't')
+                ReadFloats(cursor + 3, 2, uvs);
+            else if (cursor[0] == 'v' && cursor[1] == 'n')
+                ReadFloats(cursor + 3, 3, normals);
+            else if (cursor[0] == 'f' && cursor[1] == ' ')
+                ReadFace(cursor + 2, mesh);
+
+            // next line
+            while (*cursor != '\0' && *cursor != '\n')
+                cursor++;
+            if (*cursor == '\n')
+                cursor++;
+        }
+
+        if (normals.empty())
+            GenerateNormals(mesh);
+        return !mesh.Indices.empty();
+    }
+
+private:
+    // one face corner: position, uv and normal index (-1 when absent)
+    struct CornerKey
+    {
+        long P, T, N;
+        bool operator==(const CornerKey& other) const { return P == other.P && T == other.T && N == other.N; }
+    };
+    struct CornerHash
+    {
+        size_t operator()(const CornerKey& key) const
+        {
+            return (size_t)(key.P * 73856093L) ^ (size_t)(key.T * 19349663L) ^ (size_t)(key.N * 83492791L);
+        }
+    };
+
+    std::vector<float> positions, uvs, normals;
+    std::unordered_map<CornerKey, uint32_t, CornerHash> corners; // corner -> vertex index
+
+    static void ReadFloats(const char* cursor, int count, std::vector<float>& values)
+    {
+        char* end;
+        for (int i = 0; i < count; i++)
+        {
+            values.push_back(strtof(cursor, &end));
+            cursor = end;
+        }
+    }
+
+    // converts a 1-based (or negative, relative) OBJ index to a 0-based one
+    static long Resolve(long index, size_t count)
+    {
+        return index < 0 ? (long)count + index : index - 1;
+    }
+
+    uint32_t Corner(long p, long t, long n, MeshFileSource& mesh)
+    {
+        CornerKey key = { p, t, n };
+        std::unordered_map<CornerKey, uint32_t, CornerHash>::iterator found = corners.find(key);
+        if (found != corners.end())
+            return found->second;
+
+        uint32_t index = mesh.VertexCount();
+        for (int i = 0; i < 3; i++)
+            mesh.Vertices.push_back(p >= 0 && (size_t)(p * 3 + i) < positions.size() ? positions[p * 3 + i] : 0.0f);
+        for (int i = 0; i < 3; i++)
+            mesh.Vertices.push_back(n >= 0 && (size_t)(n * 3 + i) < normals.size() ? normals[n * 3 + i] : 0.0f);
+        for (int i = 0; i < 2; i++)
+            mesh.Vertices.push_back(t >= 0 && (size_t)(t * 2 + i) < uvs.size() ? uvs[t * 2 + i] : 0.0f);
+        corners[key] = index;
+        return index;
+    }
+
+    void ReadFace(const char* cursor, MeshFileSource& mesh)
+    {
+        uint32_t first = 0, previous = 0;
+        int count = 0;
+        char* end;
+        while (*cursor != '\0' && *cursor != '\n')
+        {
+            while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+                cursor++;
+            if (*cursor == '\0' || *cursor == '\n')
+                break;
+
+            long p = strtol(cursor, &end, 10), t = 0, n = 0;
+            cursor = end;
+            if (*cursor == '/')
+            {
+                cursor++;
+                if (*cursor != '/')
+                {
+                    t = strtol(cursor, &end, 10);
+                    cursor = end;
+                }
+                if (*cursor == '/')
+                {
+                    n = strtol(cursor + 1, &end, 10);
+                    cursor = end;
+                }
+            }
+            while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+                cursor++;
+
+            uint32_t corner = Corner(Resolve(p, positions.size() / 3), t != 0 ? Resolve(t, uvs.size() / 2) : -1,
+                n != 0 ? Resolve(n, normals.size() / 3) : -1, mesh);
+
+            // fan triangulation
+            if (count == 0)
+                first = corner;
+            else if (count >= 2)
+            {
+                mesh.Indices.push_back(first);
+                mesh.Indices.push_back(previous);
+                mesh.Indices.push_back(corner);
+            }
+            previous = corner;
+            count++;
+        }
+    }
+
+    // area-weighted vertex normals for files without vn entries
+    static void GenerateNormals(MeshFileSource& mesh)
+    {
+        const int F = MeshFileSource::FLOATS_PER_VERTEX;
+        std::vector<float>& v = mesh.Vertices;
+        for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+        {
+            float* a = &v[mesh.Indices[i] * F];
+            float* b = &v[mesh.Indices[i + 1] * F];
+            float* c = &v[mesh.Indices[i + 2] * F];
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for (int k = 0; k < 3; k++)
+            {
+                a[3 + k] += n[k];
+                b[3 + k] += n[k];
+                c[3 + k] += n[k];
+            }
+        }
+        for (size_t i = 0; i < v.size(); i += F)
+        {
+            float length = std::sqrt(v[i + 3] * v[i + 3] + v[i + 4] * v[i + 4] + v[i + 5] * v[i + 5]);
+            if (length > 0.0f)
+            {
+                v[i + 3] /= length;
+                v[i + 4] /= length;
+                v[i + 5] /= length;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef MESHLOD_H
+#define MESHLOD_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "meshfile.h"
+#include "vertexformat.h"
+
+// Level of detail settings
+const float LOD_REDUCTION = 0.6f;       // each level keeps at most this share of the previous level's triangles
+const int LOD_MIN_TRIANGLES = 16;       // no level is built below this
+const float LOD_HYSTERESIS = 0.25f;     // a coarser level is only taken once its error is this far below the threshold
+
+// Per object LOD selection state, kept between frames for the hysteresis
+struct LodState
+{
+    int Current = 0;
+};
+
+// Error quadric (Garland & Heckbert): the sum of squared distances to a set of planes, as a symmetric 4x4
+struct Quadric
+{
+    double A[10] = { 0 };   // xx xy xz xw yy yz yw zz zw ww
+
+    void AddPlane(const glm::vec3& n, float d, float weight)
+    {
+        double p[4] = { n.x, n.y, n.z, d };
+        int k = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = i; j < 4; j++)
+                A[k++] += weight * p[i] * p[j];
+        }
+    }
+
+    // point minimizing the error; false when the planes do not pin one down
+    bool Solve(glm::vec3& point) const
+    {
+        double a = A[0], b = A[1], c = A[2], d = A[4], e = A[5], f = A[7];
+        double det = a * (d * f - e * e) - b * (b * f - e * c) + c * (b * e - d * c);
+        double trace = a + d + f;
+        if (trace <= 0.0 || std::fabs(det) < 1e-6 * trace * trace * trace)
+            return false;
+
+        double rx = -A[3], ry = -A[6], rz = -A[8];
+        point.x = (float)((rx * (d * f - e * e) - b * (ry * f - e * rz) + c * (ry * e - d * rz)) / det);
+        point.y = (float)((a * (ry * f - e * rz) - rx * (b * f - e * c) + c * (b * rz - ry * c)) / det);
+        point.z = (float)((a * (d * rz - ry * e) - b * (b * rz - ry * c) + rx * (b * e - d * c)) / det);
+        return true;
+    }
+};
+
+// Vertex clustering simplification with quadric placement (Lindstrom 2000): vertices are merged per grid
+// cell and side the normal faces (so the two sides of thin shells stay apart), each cluster moves to the
+// point that best fits its original planes, and triangles that collapse are dropped. Returns the largest
+// distance an original vertex moved.
+inline float SimplifyMesh(const MeshData& mesh, float cellSize, MeshData& out)
+{
+    out = MeshData();
+    size_t count = mesh.Positions.size();
+    if (count == 0)
+        return 0.0f;
+
+    glm::vec3 boundsMin = mesh.Positions[0];
+    for (size_t i = 1; i < count; i++)
+        boundsMin = glm::min(boundsMin, mesh.Positions[i]);
+
+    // cluster of every vertex
+    std::unordered_map<uint64_t, uint32_t> cells;
+    std::vector<uint32_t> cluster(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 cell = glm::floor((mesh.Positions[i] - boundsMin) / cellSize);
+        const glm::vec3& n = mesh.Normals[i];
+        glm::vec3 a = glm::abs(n);
+        uint64_t side = a.x >= a.y && a.x >= a.z ? (n.x >= 0.0f ? 0 : 1) : (a.y >= a.z ? (n.y >= 0.0f ? 2 : 3) : (n.z >= 0.0f ? 4 : 5));
+        uint64_t key = ((uint64_t)cell.x << 43) | ((uint64_t)cell.y << 22) | ((uint64_t)cell.z << 3) | side;
+
+        std::unordered_map<uint64_t, uint32_t>::iterator found = cells.find(key);
+        if (found == cells.end())
+            found = cells.insert(std::make_pair(key, (uint32_t)cells.size())).first;
+        cluster[i] = found->second;
+    }
+
+    size_t clusterCount = cells.size();
+    std::vector<Quadric> quadrics(clusterCount);
+    std::vector<glm::vec3> sums(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec2> uvs(clusterCount, glm::vec2(0.0f));
+    std::vector<uint32_t> members(clusterCount, 0);
+    bool hasUVs = !mesh.UVs.empty();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t c = cluster[i];
+        sums[c] += mesh.Positions[i];
+        normals[c] += mesh.Normals[i];
+        if (hasUVs)
+            uvs[c] += mesh.UVs[i];
+        members[c]++;
+    }
+
+    for (size_t t = 0; t + 2 < mesh.Indices.size(); t += 3)
+    {
+        const glm::vec3& p0 = mesh.Positions[mesh.Indices[t]];
+        glm::vec3 n = glm::cross(mesh.Positions[mesh.Indices[t + 1]] - p0, mesh.Positions[mesh.Indices[t + 2]] - p0);
+        float area = glm::length(n);
+        if (area <= 0.0f)
+            continue;
+        n /= area;
+        for (int k = 0; k < 3; k++)
+            quadrics[cluster[mesh.Indices[t + k]]].AddPlane(n, -glm::dot(n, p0), area);
+    }
+
+    // representative vertices; the quadric point is only trusted inside (or just around) the cell
+    out.Positions.resize(clusterCount);
+    out.Normals.resize(clusterCount);
+    if (hasUVs)
+        out.UVs.resize(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 average = sums[c] / (float)members[c];
+        glm::vec3 point;
+        if (!quadrics[c].Solve(point) || glm::length(point - average) > cellSize)
+            point = average;
+        out.Positions[c] = point;
+
+        float length = glm::length(normals[c]);
+        out.Normals[c] = length > 0.0f ? normals[c] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        if (hasUVs)
+            out.UVs[c] = uvs[c] / (float)members[c];
+    }
+
+    for (size_t t = 0; t + 2 < mesh.Indices.size(); t += 3)
+    {
+        uint32_t a = cluster[mesh.Indices[t]], b = cluster[mesh.Indices[t + 1]], c = cluster[mesh.Indices[t + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+        out.Indices.push_back(a);
+        out.Indices.push_back(b);
+        out.Indices.push_back(c);
+    }
+
+    float error = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        error = glm::max(error, glm::length(mesh.Positions[i] - out.Positions[cluster[i]]));
+    return error;
+}
+
+// Builds coarser levels of a mesh by clustering on ever larger cells; levels that do not drop enough
+// triangles are skipped. levels[0] is the mesh itself with error 0.
+inline void BuildSimplifiedLods(const MeshData& mesh, std::vector<MeshData>& levels, std::vector<float>& errors)
+{
+    levels.assign(1, mesh);
+    errors.assign(1, 0.0f);
+    if (mesh.Positions.empty())
+        return;
+
+    glm::vec3 boundsMin = mesh.Positions[0], boundsMax = mesh.Positions[0];
+    for (size_t i = 1; i < mesh.Positions.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, mesh.Positions[i]);
+        boundsMax = glm::max(boundsMax, mesh.Positions[i]);
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+
+    size_t previous = mesh.Indices.size() / 3;
+    for (int cellsAcross = 256; cellsAcross >= 2 && (int)levels.size() < MESH_FILE_MAX_LODS; cellsAcross /= 2)
+    {
+        MeshData level;
+        float error = SimplifyMesh(mesh, largest / cellsAcross, level);
+        size_t triangles = level.Indices.size() / 3;
+        if (triangles < (size_t)LOD_MIN_TRIANGLES)
+            break;
+        if (triangles > previous * LOD_REDUCTION)
+            continue;
+
+        levels.push_back(level);
+        errors.push_back(error);
+        previous = triangles;
+    }
+}
+
+// Combines levels (finest first) into one mesh: vertices are appended and each level becomes an index range
+inline void CombineLods(const std::vector<MeshData>& levels, const std::vector<float>& errors, MeshData& chain)
+{
+    chain = MeshData();
+    bool hasUVs = !levels.empty() && !levels[0].UVs.empty();
+    for (size_t l = 0; l < levels.size() && l < (size_t)MESH_FILE_MAX_LODS; l++)
+    {
+        const MeshData& level = levels[l];
+        uint32_t base = (uint32_t)chain.Positions.size();
+
+        MeshFileLod lod;
+        lod.FirstIndex = (uint32_t)chain.Indices.size();
+        lod.IndexCount = (uint32_t)level.Indices.size();
+        lod.Error = errors[l];
+        lod.Reserved = 0;
+        chain.Lods.push_back(lod);
+
+        chain.Positions.insert(chain.Positions.end(), level.Positions.begin(), level.Positions.end());
+        chain.Normals.insert(chain.Normals.end(), level.Normals.begin(), level.Normals.end());
+        if (hasUVs)
+            chain.UVs.insert(chain.UVs.end(), level.UVs.begin(), level.UVs.end());
+        for (size_t i = 0; i < level.Indices.size(); i++)
+            chain.Indices.push_back(level.Indices[i] + base);
+    }
+}
+
+// Picks the coarsest level whose error covers at most thresholdPixels on screen. Moving to a finer
+// level happens as soon as the current one is too coarse, moving to a coarser one needs a margin of
+// LOD_HYSTERESIS so objects near a boundary do not flip every frame.
+inline int SelectLod(const MeshFileLod* lods, int lodCount, float pixelsPerUnit, float thresholdPixels, LodState& state)
+{
+    int target = 0;
+    for (int l = lodCount - 1; l > 0; l--)
+    {
+        if (lods[l].Error * pixelsPerUnit <= thresholdPixels)
+        {
+            target = l;
+            break;
+        }
+    }
+
+    while (target > state.Current && lods[target].Error * pixelsPerUnit > thresholdPixels * (1.0f - LOD_HYSTERESIS))
+        target--;
+
+    state.Current = target;
+    return target;
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "vertexformat.h"
+
+// Post-transform cache size assumed by the optimizer and by the analysis (FIFO, in vertices)
+const int MESH_OPT_CACHE_SIZE = 16;
+
+// Post-transform cache efficiency of an index buffer
+struct VertexCacheStats
+{
+    float ACMR;     // average cache miss ratio: vertices transformed per triangle (0.5 is ideal for large grids, 3 is worst)
+    float ATVR;     // average transform to vertex ratio: vertices transformed per referenced vertex (1 is ideal)
+};
+
+// Before / after numbers of one optimization pass
+struct MeshOptimizeStats
+{
+    VertexCacheStats Before;
+    VertexCacheStats After;
+    int Clusters;   // clusters the overdraw pass could reorder
+};
+
+// Simulates a FIFO post-transform cache over the triangle list
+inline VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = MESH_OPT_CACHE_SIZE)
+{
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t misses = 0;
+    uint32_t referencedCount = 0;
+
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        uint32_t v = indices[i];
+        if (!referenced[v])
+        {
+            referenced[v] = true;
+            referencedCount++;
+        }
+        else if (misses - loadedAt[v] < (uint32_t)cacheSize)
+            continue;
+
+        misses++;
+        loadedAt[v] = misses;
+    }
+
+    VertexCacheStats stats;
+    stats.ACMR = indices.size() >= 3 ? (float)misses / (indices.size() / 3) : 0.0f;
+    stats.ATVR = referencedCount > 0 ? (float)misses / referencedCount : 0.0f;
+    return stats;
+}
+
+// Reorders triangles for the post-transform cache with Tipsify (Sander, Nehab, Barczak 2007): fans
+// around the most recently cached vertex that will not be evicted before its triangles are done.
+// clusterStarts receives the first triangle of each run that begins with a cold cache.
+inline void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& clusterStarts,
+    int cacheSize = MESH_OPT_CACHE_SIZE)
+{
+    size_t triangleCount = indices.size() / 3;
+    clusterStarts.clear();
+    if (triangleCount == 0)
+        return;
+
+    // vertex -> triangle adjacency
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        live[indices[i]]++;
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    uint32_t time = (uint32_t)cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = indices[0];
+    bool coldStart = true;
+
+    while (fanning >= 0)
+    {
+        if (coldStart)
+            clusterStarts.push_back((uint32_t)(output.size() / 3));
+
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > (uint32_t)cacheSize)
+                {
+                    cacheTime[v] = time;
+                    time++;
+                }
+            }
+        }
+
+        // next fanning vertex: the oldest candidate that stays cached while its remaining triangles are emitted
+        int64_t next = -1;
+        int bestPriority = -1;
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            uint32_t v = candidates[c];
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= (uint32_t)cacheSize)
+                priority = (int)(time - cacheTime[v]);
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        coldStart = false;
+        if (next < 0)
+        {
+            // dead end: recently used vertices first, then the next unfinished vertex in input order
+            while (!deadEnd.empty() && next < 0)
+            {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < vertexCount)
+            {
+                if (live[cursor] > 0)
+                    next = (int64_t)cursor;
+                cursor++;
+            }
+            coldStart = next >= 0 && time - cacheTime[next] > (uint32_t)cacheSize;
+        }
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+// Sorts the clusters found by OptimizeVertexCache so that triangles facing away from the mesh center
+// (the outside, likely to occlude the rest) come first; view independent, costs a few misses per cluster
+inline int OptimizeOverdraw(const MeshData& mesh, std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusterStarts)
+{
+    size_t triangleCount = indices.size() / 3;
+    size_t clusterCount = clusterStarts.size();
+    if (clusterCount < 2)
+        return (int)clusterCount;
+
+    glm::vec3 meshCenter(0.0f);
+    for (size_t i = 0; i < mesh.Positions.size(); i++)
+        meshCenter += mesh.Positions[i];
+    meshCenter /= (float)mesh.Positions.size();
+
+    struct Cluster
+    {
+        uint32_t Start;
+        uint32_t End;
+        float Sort;
+    };
+
+    std::vector<Cluster> clusters(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        Cluster& cluster = clusters[c];
+        cluster.Start = clusterStarts[c];
+        cluster.End = c + 1 < clusterCount ? clusterStarts[c + 1] : (uint32_t)triangleCount;
+
+        // area weighted center and normal of the cluster
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = cluster.Start; t < cluster.End; t++)
+        {
+            const glm::vec3& p0 = mesh.Positions[indices[t * 3 + 0]];
+            const glm::vec3& p1 = mesh.Positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = mesh.Positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            center += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        if (area > 0.0f)
+            center /= area;
+        float length = glm::length(normal);
+        cluster.Sort = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.Sort > b.Sort; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (size_t c = 0; c < clusterCount; c++)
+        sorted.insert(sorted.end(), indices.begin() + clusters[c].Start * 3, indices.begin() + clusters[c].End * 3);
+    indices.swap(sorted);
+    return (int)clusterCount;
+}
+
+// Renumbers vertices in the order the index buffer first uses them so vertex fetches walk memory
+// forward; unreferenced vertices are dropped
+inline void OptimizeVertexFetch(MeshData& mesh)
+{
+    const uint32_t UNUSED = 0xffffffffu;
+    std::vector<uint32_t> remap(mesh.Positions.size(), UNUSED);
+    uint32_t next = 0;
+    for (size_t i = 0; i < mesh.Indices.size(); i++)
+    {
+        uint32_t& target = remap[mesh.Indices[i]];
+        if (target == UNUSED)
+            target = next++;
+        mesh.Indices[i] = target;
+    }
+
+    bool hasUVs = !mesh.UVs.empty();
+    std::vector<glm::vec3> positions(next), normals(next);
+    std::vector<glm::vec2> uvs(hasUVs ? next : 0);
+    for (size_t v = 0; v < remap.size(); v++)
+    {
+        if (remap[v] == UNUSED)
+            continue;
+        positions[remap[v]] = mesh.Positions[v];
+        normals[remap[v]] = mesh.Normals[v];
+        if (hasUVs)
+            uvs[remap[v]] = mesh.UVs[v];
+    }
+    mesh.Positions.swap(positions);
+    mesh.Normals.swap(normals);
+    mesh.UVs.swap(uvs);
+}
+
+// Cache efficiency the overdraw order may give up relative to the pure cache order
+const float MESH_OPT_OVERDRAW_THRESHOLD = 1.05f;
+
+// Full pass: cache order, optional overdraw order, then fetch order. Each reordering is kept only if
+// the simulated cache agrees it helps; fans around very high valence vertices (like the centers of the
+// prism caps) can be worse than the input order. Levels of detail are optimized one by one before they
+// are combined, a combined chain is left alone.
+inline MeshOptimizeStats OptimizeMesh(MeshData& mesh, bool sortForOverdraw)
+{
+    MeshOptimizeStats stats;
+    stats.Before = AnalyzeVertexCache(mesh.Indices, mesh.Positions.size());
+    stats.After = stats.Before;
+    stats.Clusters = 0;
+    if (mesh.Lods.size() > 1)
+        return stats;
+
+    std::vector<uint32_t> indices(mesh.Indices);
+    std::vector<uint32_t> clusterStarts;
+    OptimizeVertexCache(indices, mesh.Positions.size(), clusterStarts);
+    VertexCacheStats cacheOrder = AnalyzeVertexCache(indices, mesh.Positions.size());
+    if (cacheOrder.ACMR < stats.Before.ACMR)
+    {
+        mesh.Indices.swap(indices);
+        if (sortForOverdraw)
+        {
+            indices = mesh.Indices;
+            int clusters = OptimizeOverdraw(mesh, indices, clusterStarts);
+            if (AnalyzeVertexCache(indices, mesh.Positions.size()).ACMR <= cacheOrder.ACMR * MESH_OPT_OVERDRAW_THRESHOLD)
+            {
+                mesh.Indices.swap(indices);
+                stats.Clusters = clusters;
+            }
+        }
+    }
+    OptimizeVertexFetch(mesh);
+
+    stats.After = AnalyzeVertexCache(mesh.Indices, mesh.Positions.size());
+    return stats;
+}
+
+#endif
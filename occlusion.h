@@ -0,0 +1,202 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "gpuresources.h"
+#include "logger.h"
+
+// What the last occlusion test of an object says about drawing it this frame
+enum OcclusionState {
+    OCCLUSION_VISIBLE,  // its box passed the depth test, or it was not tested last frame: draw it
+    OCCLUSION_HIDDEN,   // its box failed the depth test: skip it
+    OCCLUSION_PENDING   // the result has not reached the CPU yet: draw it under conditional rendering
+};
+
+// Hardware occlusion culling with one query per object. After the scene is drawn, Test draws an object's
+// bounding box against the depth buffer (no color or depth writes) inside its query; the next frame
+// State reads the result only if it is already available, so the CPU never waits. A hidden object is
+// skipped on the CPU, and one whose result is still in flight is drawn inside BeginConditional and
+// EndConditional, where the GPU drops it if the query found nothing. Hidden objects are tested again
+// every frame, so an object shows up again one frame after it is uncovered. Objects are identified by
+// an index that stays the same from frame to frame. GL thread only.
+class OcclusionCuller
+{
+public:
+    unsigned Visible = 0;       // objects of the current frame drawn because their box was seen (or not tested)
+    unsigned Culled = 0;        // skipped because their box was hidden
+    unsigned Pending = 0;       // left to conditional rendering
+
+    // boxProgram draws positions at location 0 through "model", "view" and "projection" uniforms.
+    // False when the context has no occlusion queries; then nothing is ever culled.
+    bool Create(GLuint boxProgram)
+    {
+        if (GLAD_GL_VERSION_4_3)
+            target = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+        else if (GLAD_GL_VERSION_3_3)
+            target = GL_ANY_SAMPLES_PASSED;
+        else
+        {
+            LOG(LOG_WARN, "Occlusion queries are not supported, every object in view is drawn");
+            return false;
+        }
+
+        // a unit cube around the origin, scaled and placed per object
+        const GLfloat corners[8][3] = {
+            { -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f },
+            { -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f }
+        };
+        const GLushort faces[36] = {
+            0, 2, 1, 0, 3, 2,   4, 5, 6, 4, 6, 7,   0, 1, 5, 0, 5, 4,
+            3, 7, 6, 3, 6, 2,   0, 4, 7, 0, 7, 3,   1, 2, 6, 1, 6, 5
+        };
+        GpuResources& resources = GpuResources::Instance();
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        buffers[0] = resources.CreateBuffer(GPU_MESHES, "occlusion box vertices");
+        buffers[1] = resources.CreateBuffer(GPU_MESHES, "occlusion box indices");
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        resources.BufferData(GL_ARRAY_BUFFER, buffers[0], sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+        resources.BufferData(GL_ELEMENT_ARRAY_BUFFER, buffers[1], sizeof(faces), faces, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+
+        program = boxProgram;
+        modelLocation = glGetUniformLocation(program, "model");
+        enabled = true;
+        LOG(LOG_INFO, "Occlusion culling with %s queries", target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE ? "conservative" : "exact");
+        return true;
+    }
+
+    void Destroy()
+    {
+        if (!enabled)
+            return;
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            if (records[i].Query != 0)
+                glDeleteQueries(1, &records[i].Query);
+        }
+        records.clear();
+        glDeleteVertexArrays(1, &vao);
+        GpuResources::Instance().Release(GPU_BUFFER, buffers[0]);
+        GpuResources::Instance().Release(GPU_BUFFER, buffers[1]);
+        enabled = false;
+    }
+
+    bool Enabled() const { return enabled; }
+
+    // before the first State of a frame
+    void BeginFrame()
+    {
+        frame++;
+        Visible = Culled = Pending = 0;
+    }
+
+    // what last frame's test of the object says, reading its result if the GPU has it
+    OcclusionState State(uint32_t object)
+    {
+        OcclusionState state = OCCLUSION_VISIBLE;
+        if (enabled && object < records.size() && records[object].Frame + 1 == frame)
+        {
+            Record& record = records[object];
+            if (record.Result == RESULT_WAITING)
+            {
+                GLuint available = 0;
+                glGetQueryObjectuiv(record.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available)
+                {
+                    GLuint passed = 0;
+                    glGetQueryObjectuiv(record.Query, GL_QUERY_RESULT, &passed);
+                    record.Result = passed ? RESULT_PASSED : RESULT_FAILED;
+                }
+            }
+            if (record.Result == RESULT_FAILED)
+                state = OCCLUSION_HIDDEN;
+            else if (record.Result == RESULT_WAITING)
+                state = OCCLUSION_PENDING;
+        }
+
+        if (state == OCCLUSION_VISIBLE)
+            Visible++;
+        else if (state == OCCLUSION_HIDDEN)
+            Culled++;
+        else
+            Pending++;
+        return state;
+    }
+
+    // around the draw of an object whose State was OCCLUSION_PENDING
+    void BeginConditional(uint32_t object) { glBeginConditionalRender(records[object].Query, GL_QUERY_WAIT); }
+    void EndConditional() { glEndConditionalRender(); }
+
+    // after the scene, before the first Test: depth test only, with the box program and mesh
+    void BeginTests(const glm::mat4& view, const glm::mat4& projection)
+    {
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glBindVertexArray(vao);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);     // a box face lying on the surface it bounds counts as seen
+    }
+
+    // queries whether any of the box, the unit cube through boxModel, is in front of the depth buffer.
+    // The box must not reach the near plane: a clipped box can be hidden while its object is not.
+    void Test(uint32_t object, const glm::mat4& boxModel)
+    {
+        if (object >= records.size())
+            records.resize(object + 1);
+        Record& record = records[object];
+        if (record.Query == 0)
+            glGenQueries(1, &record.Query);
+        record.Frame = frame;
+        record.Result = RESULT_WAITING;
+
+        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(boxModel));
+        glBeginQuery(target, record.Query);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, (void*)0);
+        glEndQuery(target);
+    }
+
+    void EndTests()
+    {
+        glBindVertexArray(0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+private:
+    enum QueryResult {
+        RESULT_WAITING,
+        RESULT_PASSED,
+        RESULT_FAILED
+    };
+
+    struct Record
+    {
+        GLuint Query = 0;
+        uint64_t Frame = 0;             // when the query was last issued
+        QueryResult Result = RESULT_WAITING;
+    };
+
+    std::vector<Record> records;        // by object
+    uint64_t frame = 1;                 // records of frame - 1 are what State reads
+    GLenum target = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+    GLuint program = 0;
+    GLint modelLocation = -1;
+    GLuint vao = 0;
+    GLuint buffers[2] = {};
+    bool enabled = false;
+};
+
+#endif
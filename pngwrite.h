@@ -0,0 +1,276 @@
+#ifndef PNGWRITE_H
+#define PNGWRITE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Minimal PNG encoder for 8 bit RGB images: per row filter chosen by the usual minimum sum of absolute
+// differences heuristic, then a single deflate block with the fixed Huffman code and greedy LZ77 matches.
+// Files are larger than a full zlib would make them, but encoding is fast and needs no dependency.
+
+const int PNG_HASH_BITS = 15;
+const int PNG_WINDOW = 32768;
+const int PNG_MIN_MATCH = 3;
+const int PNG_MAX_MATCH = 258;
+
+// Writes bits least significant first, as deflate wants them
+class PngBitWriter
+{
+public:
+    std::vector<unsigned char>& Bytes;
+
+    explicit PngBitWriter(std::vector<unsigned char>& bytes) : Bytes(bytes), buffer(0), count(0) {}
+
+    void Bits(uint32_t value, int bits)
+    {
+        buffer |= (uint64_t)value << count;
+        count += bits;
+        while (count >= 8)
+        {
+            Bytes.push_back((unsigned char)buffer);
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Huffman codes are defined most significant bit first
+    void Code(uint32_t code, int bits)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < bits; i++)
+            reversed |= ((code >> i) & 1u) << (bits - 1 - i);
+        Bits(reversed, bits);
+    }
+
+    void Flush()
+    {
+        if (count > 0)
+            Bytes.push_back((unsigned char)buffer);
+        buffer = 0;
+        count = 0;
+    }
+
+private:
+    uint64_t buffer;
+    int count;
+};
+
+// Fixed Huffman literal / length symbol (RFC 1951 3.2.6)
+inline void PngWriteSymbol(PngBitWriter& out, int symbol)
+{
+    if (symbol < 144)
+        out.Code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        out.Code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        out.Code(symbol - 256, 7);
+    else
+        out.Code(0xc0 + symbol - 280, 8);
+}
+
+inline void PngWriteMatch(PngBitWriter& out, int length, int distance)
+{
+    static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+        131, 163, 195, 227, 258 };
+    static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+        2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int l = 28;
+    while (lengthBase[l] > length)
+        l--;
+    PngWriteSymbol(out, 257 + l);
+    out.Bits(length - lengthBase[l], lengthExtra[l]);
+
+    int d = 29;
+    while (distanceBase[d] > distance)
+        d--;
+    out.Code(d, 5);
+    out.Bits(distance - distanceBase[d], distanceExtra[d]);
+}
+
+// zlib stream (RFC 1950) holding one fixed Huffman deflate block
+inline void PngDeflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& out)
+{
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    PngBitWriter bits(out);
+    bits.Bits(1, 1);    // final block
+    bits.Bits(1, 2);    // fixed Huffman codes
+
+    std::vector<int32_t> head((size_t)1 << PNG_HASH_BITS, -1);
+    size_t size = data.size();
+    size_t i = 0;
+    while (i < size)
+    {
+        int bestLength = 0;
+        size_t bestDistance = 0;
+        if (i + PNG_MIN_MATCH <= size)
+        {
+            uint32_t hash = ((data[i] << 16) | (data[i + 1] << 8) | data[i + 2]) * 2654435761u >> (32 - PNG_HASH_BITS);
+            int32_t candidate = head[hash];
+            head[hash] = (int32_t)i;
+            if (candidate >= 0 && i - candidate <= (size_t)PNG_WINDOW)
+            {
+                size_t limit = size - i < (size_t)PNG_MAX_MATCH ? size - i : (size_t)PNG_MAX_MATCH;
+                size_t length = 0;
+                while (length < limit && data[candidate + length] == data[i + length])
+                    length++;
+                if (length >= (size_t)PNG_MIN_MATCH)
+                {
+                    bestLength = (int)length;
+                    bestDistance = i - candidate;
+                }
+            }
+        }
+
+        if (bestLength > 0)
+        {
+            PngWriteMatch(bits, bestLength, (int)bestDistance);
+            i += bestLength;
+        }
+        else
+            PngWriteSymbol(bits, data[i++]);
+    }
+    PngWriteSymbol(bits, 256);  // end of block
+    bits.Flush();
+
+    uint32_t a = 1, b = 0;
+    for (size_t k = 0; k < size; k++)
+    {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((unsigned char)(adler >> shift));
+}
+
+struct PngCrcTable
+{
+    uint32_t Entries[256];
+
+    PngCrcTable()
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            Entries[n] = c;
+        }
+    }
+};
+
+inline uint32_t PngCrc(const unsigned char* data, size_t size, uint32_t crc = 0xffffffffu)
+{
+    static const PngCrcTable table;     // built once, safe with several encoding threads
+    for (size_t i = 0; i < size; i++)
+        crc = table.Entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+inline void PngChunk(FILE* file, const char* type, const unsigned char* data, size_t size)
+{
+    unsigned char length[4] = { (unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size };
+    fwrite(length, 1, 4, file);
+    fwrite(type, 1, 4, file);
+    if (size > 0)
+        fwrite(data, 1, size, file);
+
+    uint32_t crc = PngCrc((const unsigned char*)type, 4);
+    crc = PngCrc(data, size, crc) ^ 0xffffffffu;
+    unsigned char footer[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+    fwrite(footer, 1, 4, file);
+}
+
+inline int PngPaeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+// Writes RGBA pixels as an RGB PNG; bottomUp flips the rows (glReadPixels returns the bottom row first)
+inline bool PngWrite(const char* path, int width, int height, const unsigned char* rgba, bool bottomUp)
+{
+    const int channels = 3;
+    size_t rowBytes = (size_t)width * channels;
+    std::vector<unsigned char> previous(rowBytes, 0), current(rowBytes);
+    std::vector<unsigned char> raw;
+    raw.reserve((rowBytes + 1) * height);
+
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* source = rgba + (size_t)(bottomUp ? height - 1 - y : y) * width * 4;
+        for (int x = 0; x < width; x++)
+        {
+            current[x * 3 + 0] = source[x * 4 + 0];
+            current[x * 3 + 1] = source[x * 4 + 1];
+            current[x * 3 + 2] = source[x * 4 + 2];
+        }
+
+        // try every filter type, keep the one with the smallest sum of absolute (signed) residuals
+        int bestFilter = 0;
+        long bestSum = -1;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            long sum = 0;
+            for (size_t i = 0; i < rowBytes; i++)
+            {
+                int left = i >= (size_t)channels ? current[i - channels] : 0;
+                int up = previous[i];
+                int upLeft = i >= (size_t)channels ? previous[i - channels] : 0;
+                int predicted = filter == 0 ? 0 : filter == 1 ? left : filter == 2 ? up : filter == 3 ? (left + up) / 2 : PngPaeth(left, up, upLeft);
+                unsigned char residual = (unsigned char)(current[i] - predicted);
+                sum += residual < 128 ? residual : 256 - residual;
+            }
+            if (bestSum < 0 || sum < bestSum)
+            {
+                bestSum = sum;
+                bestFilter = filter;
+            }
+        }
+
+        raw.push_back((unsigned char)bestFilter);
+        for (size_t i = 0; i < rowBytes; i++)
+        {
+            int left = i >= (size_t)channels ? current[i - channels] : 0;
+            int up = previous[i];
+            int upLeft = i >= (size_t)channels ? previous[i - channels] : 0;
+            int predicted = bestFilter == 0 ? 0 : bestFilter == 1 ? left : bestFilter == 2 ? up : bestFilter == 3 ? (left + up) / 2 : PngPaeth(left, up, upLeft);
+            raw.push_back((unsigned char)(current[i] - predicted));
+        }
+        previous.swap(current);
+    }
+
+    std::vector<unsigned char> compressed;
+    compressed.reserve(raw.size() / 2);
+    PngDeflate(raw, compressed);
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, sizeof(signature), file);
+
+    unsigned char header[13] = {
+        (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+        (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+        8, 2, 0, 0, 0   // 8 bits, truecolor, deflate, adaptive filtering, no interlace
+    };
+    PngChunk(file, "IHDR", header, sizeof(header));
+    PngChunk(file, "IDAT", compressed.data(), compressed.size());
+    PngChunk(file, "IEND", nullptr, 0);
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+#endif
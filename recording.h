@@ -0,0 +1,178 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// File layout: CameraTrackHeader followed by a tightly packed array of CameraSample
+const char CAMERA_TRACK_MAGIC[4] = { 'E', 'G', 'G', 'R' };
+const uint32_t CAMERA_TRACK_VERSION = 1;
+
+struct CameraTrackHeader
+{
+    char Magic[4];
+    uint32_t Version;
+    uint32_t SampleSize;    // sizeof(CameraSample) when the file was written
+    uint32_t Reserved;
+};
+
+// Camera state captured once per frame (32 bytes)
+struct CameraSample
+{
+    float Time;             // seconds since recording started
+    float Position[3];
+    float Yaw;
+    float Pitch;
+    float Zoom;
+    float DeltaTime;        // frame time while recording, for reference only
+};
+
+// Streams camera samples to disk while the user flies around
+class CameraRecorder
+{
+public:
+    CameraRecorder() : file(nullptr), count(0) {}
+    ~CameraRecorder() { Close(); }
+
+    bool Open(const char* path)
+    {
+        file = fopen(path, "wb");
+        if (file == nullptr)
+            return false;
+
+        CameraTrackHeader header;
+        memcpy(header.Magic, CAMERA_TRACK_MAGIC, sizeof(header.Magic));
+        header.Version = CAMERA_TRACK_VERSION;
+        header.SampleSize = sizeof(CameraSample);
+        header.Reserved = 0;
+        fwrite(&header, sizeof(header), 1, file);
+        return true;
+    }
+
+    void Write(const CameraSample& sample)
+    {
+        if (file != nullptr && fwrite(&sample, sizeof(sample), 1, file) == 1)
+            count++;
+    }
+
+    void Close()
+    {
+        if (file != nullptr)
+            fclose(file);
+        file = nullptr;
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+    int SampleCount() const { return count; }
+
+private:
+    FILE* file;
+    int count;
+};
+
+// A recorded camera path that can be sampled at any time for deterministic replay
+class CameraTrack
+{
+public:
+    std::vector<CameraSample> Samples;
+
+    bool Load(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+
+        CameraTrackHeader header;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.Magic, CAMERA_TRACK_MAGIC, sizeof(header.Magic)) == 0
+            && header.Version == CAMERA_TRACK_VERSION
+            && header.SampleSize == sizeof(CameraSample);
+
+        Samples.clear();
+        CameraSample sample;
+        while (valid && fread(&sample, sizeof(sample), 1, file) == 1)
+            Samples.push_back(sample);
+
+        fclose(file);
+        return valid && !Samples.empty();
+    }
+
+    float Duration() const
+    {
+        return Samples.empty() ? 0.0f : Samples.back().Time;
+    }
+
+    // linearly interpolates the camera state at the given time (clamped to the track)
+    CameraSample Sample(float time) const
+    {
+        if (time <= Samples.front().Time)
+            return Samples.front();
+        if (time >= Samples.back().Time)
+            return Samples.back();
+
+        // first sample recorded after the requested time
+        std::vector<CameraSample>::const_iterator next = std::upper_bound(Samples.begin(), Samples.end(), time,
+            [](float t, const CameraSample& s) { return t < s.Time; });
+        const CameraSample& a = *(next - 1);
+        const CameraSample& b = *next;
+
+        float span = b.Time - a.Time;
+        float t = span > 0.0f ? (time - a.Time) / span : 0.0f;
+
+        CameraSample result;
+        result.Time = time;
+        for (int i = 0; i < 3; i++)
+            result.Position[i] = a.Position[i] + (b.Position[i] - a.Position[i]) * t;
+        result.Yaw = a.Yaw + (b.Yaw - a.Yaw) * t;
+        result.Pitch = a.Pitch + (b.Pitch - a.Pitch) * t;
+        result.Zoom = a.Zoom + (b.Zoom - a.Zoom) * t;
+        result.DeltaTime = a.DeltaTime;
+        return result;
+    }
+};
+
+// Collects per-frame timings and summarizes them
+class FrameTimings
+{
+public:
+    std::vector<float> FrameMs;
+
+    void Add(float ms) { FrameMs.push_back(ms); }
+
+    // value at the given percentile (0-100)
+    float Percentile(float p) const
+    {
+        if (FrameMs.empty())
+            return 0.0f;
+        std::vector<float> sorted(FrameMs);
+        std::sort(sorted.begin(), sorted.end());
+        size_t index = (size_t)(p / 100.0f * (sorted.size() - 1) + 0.5f);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    float Average() const
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < FrameMs.size(); i++)
+            sum += FrameMs[i];
+        return FrameMs.empty() ? 0.0f : (float)(sum / FrameMs.size());
+    }
+
+    // writes one "frame,ms" line per frame
+    bool WriteCsv(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (file == nullptr)
+            return false;
+        fprintf(file, "frame,ms\n");
+        for (size_t i = 0; i < FrameMs.size(); i++)
+            fprintf(file, "%u,%.4f\n", (unsigned)i, FrameMs[i]);
+        fclose(file);
+        return true;
+    }
+};
+
+#endif
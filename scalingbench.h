@@ -0,0 +1,116 @@
+#ifndef SCALINGBENCH_H
+#define SCALINGBENCH_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// One configuration of the scaling benchmark and what it measured
+struct ScalingResult
+{
+    std::string Name;           // identifies the configuration in baselines, e.g. "t16_l1_1280x720"
+    int Objects = 0;            // generated objects (before culling)
+    int Lights = 0;
+    int Width = 0;
+    int Height = 0;
+    double FrameMs = 0.0;       // average, GPU work included
+    double P95Ms = 0.0;
+    double Draws = 0.0;         // per frame, after culling
+    double Instances = 0.0;
+    double Triangles = 0.0;
+    double GpuMB = 0.0;         // buffers, textures and render targets the configuration uses
+    double ProcessMB = 0.0;     // peak resident set of the process so far
+};
+
+// Columns of the CSV files the benchmark writes and reads back as a baseline
+const char* const SCALING_CSV_HEADER = "name,objects,lights,width,height,frame_ms,p95_ms,draws,instances,triangles,gpu_mb,process_mb";
+
+inline bool ScalingWriteCsv(const char* path, const std::vector<ScalingResult>& results)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+        return false;
+    fprintf(file, "%s\n", SCALING_CSV_HEADER);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const ScalingResult& r = results[i];
+        fprintf(file, "%s,%d,%d,%d,%d,%.4f,%.4f,%.1f,%.1f,%.0f,%.3f,%.1f\n", r.Name.c_str(), r.Objects, r.Lights, r.Width, r.Height,
+            r.FrameMs, r.P95Ms, r.Draws, r.Instances, r.Triangles, r.GpuMB, r.ProcessMB);
+    }
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+inline bool ScalingLoadCsv(const char* path, std::vector<ScalingResult>& results)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+        return false;
+
+    char line[512];
+    bool valid = fgets(line, sizeof(line), file) != nullptr && strncmp(line, SCALING_CSV_HEADER, strlen(SCALING_CSV_HEADER)) == 0;
+    while (valid && fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (line[0] == '\n' || line[0] == '\r')
+            continue;
+        char name[128];
+        ScalingResult r;
+        valid = sscanf(line, "%127[^,],%d,%d,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf", name, &r.Objects, &r.Lights, &r.Width, &r.Height,
+            &r.FrameMs, &r.P95Ms, &r.Draws, &r.Instances, &r.Triangles, &r.GpuMB, &r.ProcessMB) == 12;
+        r.Name = name;
+        if (valid)
+            results.push_back(r);
+    }
+    fclose(file);
+    return valid;
+}
+
+// Checks a result against the baseline entry of the same name. Frame time and GPU memory may grow by
+// tolerance (a fraction) before it counts as a regression; draw calls, which do not vary between runs,
+// may not grow at all. Returns false on regression and describes it in reason.
+inline bool ScalingCompare(const ScalingResult& result, const ScalingResult& baseline, double tolerance, std::string& reason)
+{
+    char text[256];
+    reason.clear();
+    if (result.FrameMs > baseline.FrameMs * (1.0 + tolerance))
+    {
+        snprintf(text, sizeof(text), "frame time %.3f ms > %.3f ms baseline; ", result.FrameMs, baseline.FrameMs);
+        reason += text;
+    }
+    if (result.Draws > baseline.Draws + 0.5)
+    {
+        snprintf(text, sizeof(text), "%.0f draws > %.0f baseline; ", result.Draws, baseline.Draws);
+        reason += text;
+    }
+    if (result.GpuMB > baseline.GpuMB * (1.0 + tolerance))
+    {
+        snprintf(text, sizeof(text), "GPU memory %.2f MB > %.2f MB baseline; ", result.GpuMB, baseline.GpuMB);
+        reason += text;
+    }
+    return reason.empty();
+}
+
+// Peak resident set size of this process in MB (0 where it is not available)
+inline double ScalingProcessMB()
+{
+#ifdef _WIN32
+    return 0.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);     // bytes
+#else
+    return usage.ru_maxrss / 1024.0;                // kilobytes
+#endif
+#endif
+}
+
+#endif
@@ -0,0 +1,766 @@
+#ifndef SOFTRENDER_H
+#define SOFTRENDER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFT_SSE2 1
+#endif
+
+#include "materials.h"
+#include "vertexformat.h"
+#include "workerpool.h"
+
+// Software renderer settings
+const int SOFT_TILE_SIZE = 64;          // pixels per tile side; a tile is the unit of work of a raster thread
+const int SOFT_BLOCK_SIZE = 8;          // pixels per side of a hierarchical depth block
+const int SOFT_BLOCKS_PER_TILE = SOFT_TILE_SIZE / SOFT_BLOCK_SIZE;
+const float SOFT_SUBPIXELS = 16.0f;     // vertex positions snap to 1/16 pixel, as GPUs do
+const int SOFT_VERTEX_BATCH = 4096;     // vertices transformed per job
+const int SOFT_ATTRIBUTES = 10;         // interpolated per pixel: depth, 1/w, then world position, normal and uv over w
+const int SOFT_MAX_LIGHTS = 8;          // as the light arrays of the fragment shader
+const glm::vec3 SOFT_HIGHLIGHT_COLOR(1.0f, 0.8f, 0.2f); // selected objects are tinted toward this, as in the fragment shader
+const float SOFT_HIGHLIGHT_MIX = 0.4f;
+
+// Four float lanes with the few operations the rasterizer needs: SSE2 where the compiler targets it,
+// plain loops otherwise. Comparisons return lane masks (all bits set or clear), Mask packs their sign bits.
+#ifdef SOFT_SSE2
+struct SoftFloat4
+{
+    __m128 v;
+
+    static SoftFloat4 Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static SoftFloat4 Set(float a) { return { _mm_set1_ps(a) }; }
+    static SoftFloat4 Set(float a, float b, float c, float d) { return { _mm_setr_ps(a, b, c, d) }; }
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+    int Mask() const { return _mm_movemask_ps(v); }
+};
+inline SoftFloat4 operator+(SoftFloat4 a, SoftFloat4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline SoftFloat4 operator-(SoftFloat4 a, SoftFloat4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline SoftFloat4 operator*(SoftFloat4 a, SoftFloat4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline SoftFloat4 operator&(SoftFloat4 a, SoftFloat4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline SoftFloat4 SoftMax(SoftFloat4 a, SoftFloat4 b) { return { _mm_max_ps(a.v, b.v) }; }
+inline SoftFloat4 SoftGreater(SoftFloat4 a, SoftFloat4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline SoftFloat4 SoftGreaterEqual(SoftFloat4 a, SoftFloat4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+inline SoftFloat4 SoftLess(SoftFloat4 a, SoftFloat4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline SoftFloat4 SoftLessEqual(SoftFloat4 a, SoftFloat4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+// mask ? a : b
+inline SoftFloat4 SoftSelect(SoftFloat4 mask, SoftFloat4 a, SoftFloat4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+inline float SoftHorizontalMax(SoftFloat4 a)
+{
+    __m128 m = _mm_max_ps(a.v, _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(m);
+}
+#else
+struct SoftFloat4
+{
+    float v[4];
+
+    static SoftFloat4 Load(const float* p) { SoftFloat4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    static SoftFloat4 Set(float a) { return { { a, a, a, a } }; }
+    static SoftFloat4 Set(float a, float b, float c, float d) { return { { a, b, c, d } }; }
+    void Store(float* p) const { memcpy(p, v, sizeof(v)); }
+    int Mask() const
+    {
+        int bits = 0;
+        for (int i = 0; i < 4; i++)
+            bits |= (Bits(v[i]) >> 31) << i;
+        return bits;
+    }
+
+    static uint32_t Bits(float f) { uint32_t u; memcpy(&u, &f, sizeof(u)); return u; }
+    static float Float(uint32_t u) { float f; memcpy(&f, &u, sizeof(f)); return f; }
+    static float Lane(bool set) { return Float(set ? 0xffffffffu : 0u); }
+};
+inline SoftFloat4 operator+(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline SoftFloat4 operator-(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline SoftFloat4 operator*(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline SoftFloat4 operator&(SoftFloat4 a, SoftFloat4 b)
+{
+    for (int i = 0; i < 4; i++)
+        a.v[i] = SoftFloat4::Float(SoftFloat4::Bits(a.v[i]) & SoftFloat4::Bits(b.v[i]));
+    return a;
+}
+inline SoftFloat4 SoftMax(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline SoftFloat4 SoftGreater(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] = SoftFloat4::Lane(a.v[i] > b.v[i]); return a; }
+inline SoftFloat4 SoftGreaterEqual(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] = SoftFloat4::Lane(a.v[i] >= b.v[i]); return a; }
+inline SoftFloat4 SoftLess(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] = SoftFloat4::Lane(a.v[i] < b.v[i]); return a; }
+inline SoftFloat4 SoftLessEqual(SoftFloat4 a, SoftFloat4 b) { for (int i = 0; i < 4; i++) a.v[i] = SoftFloat4::Lane(a.v[i] <= b.v[i]); return a; }
+inline SoftFloat4 SoftSelect(SoftFloat4 mask, SoftFloat4 a, SoftFloat4 b)
+{
+    for (int i = 0; i < 4; i++)
+        a.v[i] = SoftFloat4::Bits(mask.v[i]) != 0 ? a.v[i] : b.v[i];
+    return a;
+}
+inline float SoftHorizontalMax(SoftFloat4 a) { return std::max(std::max(a.v[0], a.v[1]), std::max(a.v[2], a.v[3])); }
+#endif
+
+// Per-frame constants, as the GL path passes them in uniforms
+struct SoftFrame
+{
+    glm::mat4 View;
+    glm::mat4 Projection;
+    glm::vec3 CameraPosition;
+    int LightCount;
+    glm::vec3 LightPositions[SOFT_MAX_LIGHTS];
+    glm::vec3 LightColors[SOFT_MAX_LIGHTS];
+    glm::vec2 UVScale;
+};
+
+// One object: an index range of a decoded mesh, its transform and its material
+struct SoftDraw
+{
+    const MeshData* Mesh;
+    glm::mat4 Model;
+    int Material;
+    uint32_t FirstIndex;
+    uint32_t IndexCount;
+    bool Highlight = false;     // the selected object
+};
+
+// What the last frame did and where its time went
+struct SoftStats
+{
+    unsigned Triangles = 0;         // after frustum culling and near plane clipping
+    unsigned TileTriangles = 0;     // triangle and tile pairs binned
+    unsigned ShadedPixels = 0;
+    unsigned RejectedBlocks = 0;    // blocks (and whole tiles, counted by their blocks) skipped by the depth hierarchy
+    double VertexMs = 0.0;
+    double BinMs = 0.0;
+    double RasterMs = 0.0;
+};
+
+// Renders the scene on the CPU with the vertex transform and Phong + texture shading of the GL shaders.
+// Frames go through three parallel phases: vertices are transformed in batches, triangles are clipped,
+// set up and binned into 64x64 tiles (each thread in its own bins, so nothing is locked and the draw
+// order is kept), and the tiles are rasterized by whichever thread is free. Coverage and depth are
+// evaluated four pixels at a time; a depth hierarchy (the farthest depth of every tile and 8x8 block)
+// skips blocks the triangle is entirely behind before any pixel is looked at.
+class SoftRenderer
+{
+public:
+    SoftStats Stats;
+
+    ~SoftRenderer() { Stop(); }
+
+    // threads <= 0 uses every hardware thread; the calling thread only waits while a frame renders
+    void Start(int threads)
+    {
+        if (threads <= 0)
+            threads = (int)std::thread::hardware_concurrency();
+        pool.Start(std::max(threads, 1), 1 << 16);
+        bins.assign(pool.ThreadCount(), SoftBin());
+        for (size_t j = 0; j < bins.size(); j++)
+            bins[j].Tiles.assign(tileCount, std::vector<uint32_t>());
+    }
+
+    void Stop() { pool.Stop(); }
+
+    int ThreadCount() const { return pool.ThreadCount(); }
+
+    // takes the material table and keeps references to its texture pixels (which must stay loaded)
+    void SetMaterials(const MaterialSystem& system)
+    {
+        materials.clear();
+        for (int i = 0; i < system.Count(); i++)
+            materials.push_back(system.Get(i));
+        layers.clear();
+        for (int i = 0; i < system.LayerCount(); i++)
+            layers.push_back(&system.LayerLevels(i));
+        layerWidth = system.LayerWidth;
+        layerHeight = system.LayerHeight;
+    }
+
+    void Resize(int newWidth, int newHeight)
+    {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+        tilesX = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+        tilesY = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+        tileCount = tilesX * tilesY;
+        pitch = tilesX * SOFT_TILE_SIZE;
+        color.assign((size_t)pitch * tilesY * SOFT_TILE_SIZE, 0);
+        depth.assign(color.size(), 1.0f);
+        blockMax.assign((size_t)tileCount * SOFT_BLOCKS_PER_TILE * SOFT_BLOCKS_PER_TILE, 1.0f);
+        tileMax.assign(tileCount, 1.0f);
+        for (size_t j = 0; j < bins.size(); j++)
+            bins[j].Tiles.assign(tileCount, std::vector<uint32_t>());
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // renders the draws into the color and depth buffers (cleared first)
+    void Render(const SoftFrame& frame, const std::vector<SoftDraw>& draws)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        this->frame = &frame;
+        this->draws = &draws;
+        viewProjection = frame.Projection * frame.View;
+
+        // 1. vertices, in batches across the pool
+        transformed.resize(draws.size());
+        for (size_t d = 0; d < draws.size(); d++)
+        {
+            const MeshData& mesh = *draws[d].Mesh;
+            transformed[d].resize(mesh.Positions.size());
+            for (size_t first = 0; first < mesh.Positions.size(); first += SOFT_VERTEX_BATCH)
+            {
+                size_t end = std::min(first + SOFT_VERTEX_BATCH, mesh.Positions.size());
+                pool.Submit([this, d, first, end]() { TransformVertices(d, first, end); });
+            }
+        }
+        pool.Wait();
+        Clock::time_point transformedTime = Clock::now();
+
+        // 2. triangle setup and binning; bin j takes the j-th share of all triangles in draw order
+        firstTriangles.assign(1, 0);
+        for (size_t d = 0; d < draws.size(); d++)
+            firstTriangles.push_back(firstTriangles.back() + draws[d].IndexCount / 3);
+        for (size_t j = 0; j < bins.size(); j++)
+            pool.Submit([this, j]() { BinTriangles(j); });
+        pool.Wait();
+        Clock::time_point binnedTime = Clock::now();
+
+        // 3. tiles, handed out one at a time to whichever thread asks
+        nextTile = 0;
+        shadedPixels = 0;
+        rejectedBlocks = 0;
+        for (int t = 0; t < pool.ThreadCount(); t++)
+        {
+            pool.Submit([this]()
+            {
+                unsigned shaded = 0, rejected = 0;
+                for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+                    RasterTile(tile, shaded, rejected);
+                shadedPixels += shaded;
+                rejectedBlocks += rejected;
+            });
+        }
+        pool.Wait();
+        Clock::time_point rasterTime = Clock::now();
+
+        Stats.Triangles = 0;
+        Stats.TileTriangles = 0;
+        for (size_t j = 0; j < bins.size(); j++)
+        {
+            Stats.Triangles += (unsigned)bins[j].Triangles.size();
+            Stats.TileTriangles += bins[j].Binned;
+        }
+        Stats.ShadedPixels = shadedPixels;
+        Stats.RejectedBlocks = rejectedBlocks;
+        Stats.VertexMs = std::chrono::duration<double, std::milli>(transformedTime - start).count();
+        Stats.BinMs = std::chrono::duration<double, std::milli>(binnedTime - transformedTime).count();
+        Stats.RasterMs = std::chrono::duration<double, std::milli>(rasterTime - binnedTime).count();
+    }
+
+    // the image as glReadPixels would return it: width x height RGBA, bottom row first
+    void ReadPixels(std::vector<unsigned char>& rgba) const
+    {
+        rgba.resize((size_t)width * height * 4);
+        for (int y = 0; y < height; y++)
+            memcpy(&rgba[(size_t)y * width * 4], &color[(size_t)y * pitch], (size_t)width * 4);
+    }
+
+    // rows of the color buffer are Pitch() pixels apart (the width rounded up to whole tiles)
+    const uint32_t* Pixels() const { return color.data(); }
+    int Pitch() const { return pitch; }
+
+private:
+    // a vertex after the vertex stage
+    struct SoftVertex
+    {
+        glm::vec4 Clip;
+        glm::vec3 World;
+        glm::vec3 Normal;
+        glm::vec2 UV;
+    };
+
+    // a screen space triangle ready to rasterize
+    struct SoftTriangle
+    {
+        // edge functions E(p) = A * (p.y - Y) - B * (p.x - X), positive inside. Each edge is evaluated from
+        // the same end point by both triangles sharing it, so their values are exact negations and a pixel
+        // on the edge is never drawn twice or dropped; TopLeft breaks the tie at exactly zero.
+        float X[3], Y[3], A[3], B[3];
+        bool TopLeft[3];
+        float OriginX, OriginY;             // attribute planes: value + ddx * (x - OriginX) + ddy * (y - OriginY)
+        float Plane[SOFT_ATTRIBUTES][3];    // value, ddx, ddy
+        float MinZ;
+        int MinX, MinY, MaxX, MaxY;         // pixel bounds, inclusive
+        int Material;
+        bool Highlight;
+    };
+
+    // what one binning thread produced
+    struct SoftBin
+    {
+        std::vector<SoftTriangle> Triangles;
+        std::vector<std::vector<uint32_t>> Tiles;   // triangle indices per tile, in draw order
+        unsigned Binned = 0;
+    };
+
+    WorkerPool pool;
+    std::vector<SoftBin> bins;
+    std::vector<std::vector<SoftVertex>> transformed;   // per draw
+    std::vector<uint32_t> firstTriangles;               // per draw, plus the total at the end
+    std::vector<Material> materials;
+    std::vector<const std::vector<std::vector<unsigned char>>*> layers;
+    int layerWidth = 0;
+    int layerHeight = 0;
+
+    const SoftFrame* frame = nullptr;
+    const std::vector<SoftDraw>* draws = nullptr;
+    glm::mat4 viewProjection;
+
+    int width = 0;
+    int height = 0;
+    int pitch = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    int tileCount = 0;
+    std::vector<uint32_t> color;        // RGBA bytes in memory order, bottom row first, pitch pixels per row
+    std::vector<float> depth;           // window depth in [0, 1]
+    std::vector<float> blockMax;        // farthest depth of each 8x8 block, per tile
+    std::vector<float> tileMax;         // farthest depth of each tile
+    std::atomic<int> nextTile{ 0 };
+    std::atomic<unsigned> shadedPixels{ 0 };
+    std::atomic<unsigned> rejectedBlocks{ 0 };
+
+    // the vertex shader: object to clip space, world position and normal
+    void TransformVertices(size_t d, size_t first, size_t end)
+    {
+        const SoftDraw& draw = (*draws)[d];
+        const MeshData& mesh = *draw.Mesh;
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(draw.Model)));
+        bool hasUVs = !mesh.UVs.empty();
+        for (size_t i = first; i < end; i++)
+        {
+            SoftVertex& vertex = transformed[d][i];
+            glm::vec4 world = draw.Model * glm::vec4(mesh.Positions[i], 1.0f);
+            vertex.Clip = viewProjection * world;
+            vertex.World = glm::vec3(world);
+            vertex.Normal = normalMatrix * mesh.Normals[i];
+            vertex.UV = hasUVs ? mesh.UVs[i] : glm::vec2(0.0f);
+        }
+    }
+
+    static SoftVertex Lerp(const SoftVertex& a, const SoftVertex& b, float t)
+    {
+        SoftVertex v;
+        v.Clip = a.Clip + (b.Clip - a.Clip) * t;
+        v.World = a.World + (b.World - a.World) * t;
+        v.Normal = a.Normal + (b.Normal - a.Normal) * t;
+        v.UV = a.UV + (b.UV - a.UV) * t;
+        return v;
+    }
+
+    void BinTriangles(size_t j)
+    {
+        SoftBin& bin = bins[j];
+        bin.Triangles.clear();
+        bin.Binned = 0;
+        for (size_t t = 0; t < bin.Tiles.size(); t++)
+            bin.Tiles[t].clear();
+
+        uint32_t total = firstTriangles.back();
+        uint32_t begin = (uint32_t)((uint64_t)total * j / bins.size());
+        uint32_t end = (uint32_t)((uint64_t)total * (j + 1) / bins.size());
+        size_t d = std::upper_bound(firstTriangles.begin(), firstTriangles.end(), begin) - firstTriangles.begin() - 1;
+        for (uint32_t t = begin; t < end; t++)
+        {
+            while (t >= firstTriangles[d + 1])
+                d++;
+            const SoftDraw& draw = (*draws)[d];
+            const uint32_t* indices = &draw.Mesh->Indices[draw.FirstIndex + (t - firstTriangles[d]) * 3];
+            const SoftVertex* v[3] = { &transformed[d][indices[0]], &transformed[d][indices[1]], &transformed[d][indices[2]] };
+            ClipTriangle(v, draw, bin);
+        }
+    }
+
+    // frustum culling, and clipping against the near plane (the other planes are handled per pixel)
+    void ClipTriangle(const SoftVertex* v[3], const SoftDraw& draw, SoftBin& bin)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (v[0]->Clip[axis] > v[0]->Clip.w && v[1]->Clip[axis] > v[1]->Clip.w && v[2]->Clip[axis] > v[2]->Clip.w)
+                return;
+            if (v[0]->Clip[axis] < -v[0]->Clip.w && v[1]->Clip[axis] < -v[1]->Clip.w && v[2]->Clip[axis] < -v[2]->Clip.w)
+                return;
+        }
+
+        float distance[3];
+        bool inside = true;
+        for (int i = 0; i < 3; i++)
+        {
+            distance[i] = v[i]->Clip.z + v[i]->Clip.w;
+            inside &= distance[i] >= 0.0f;
+        }
+        if (inside)
+        {
+            SetupTriangle(*v[0], *v[1], *v[2], draw, bin);
+            return;
+        }
+
+        SoftVertex polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            int next = (i + 1) % 3;
+            if (distance[i] >= 0.0f)
+                polygon[count++] = *v[i];
+            if ((distance[i] >= 0.0f) != (distance[next] >= 0.0f))
+                polygon[count++] = Lerp(*v[i], *v[next], distance[i] / (distance[i] - distance[next]));
+        }
+        for (int i = 1; i + 1 < count; i++)
+            SetupTriangle(polygon[0], polygon[i], polygon[i + 1], draw, bin);
+    }
+
+    void SetupTriangle(const SoftVertex& v0, const SoftVertex& v1, const SoftVertex& v2, const SoftDraw& draw, SoftBin& bin)
+    {
+        const SoftVertex* v[3] = { &v0, &v1, &v2 };
+        float x[3], y[3], values[3][SOFT_ATTRIBUTES];
+        for (int i = 0; i < 3; i++)
+        {
+            float invW = 1.0f / v[i]->Clip.w;
+            x[i] = std::floor((v[i]->Clip.x * invW * 0.5f + 0.5f) * width * SOFT_SUBPIXELS + 0.5f) / SOFT_SUBPIXELS;
+            y[i] = std::floor((v[i]->Clip.y * invW * 0.5f + 0.5f) * height * SOFT_SUBPIXELS + 0.5f) / SOFT_SUBPIXELS;
+            if (!std::isfinite(x[i]) || !std::isfinite(y[i]))
+                return;
+
+            float* value = values[i];
+            value[0] = v[i]->Clip.z * invW * 0.5f + 0.5f;
+            value[1] = invW;
+            value[2] = v[i]->World.x * invW;
+            value[3] = v[i]->World.y * invW;
+            value[4] = v[i]->World.z * invW;
+            value[5] = v[i]->Normal.x * invW;
+            value[6] = v[i]->Normal.y * invW;
+            value[7] = v[i]->Normal.z * invW;
+            value[8] = v[i]->UV.x * invW;
+            value[9] = v[i]->UV.y * invW;
+        }
+
+        // nothing is culled by facing (the GL path does not cull either): clockwise triangles are flipped
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f)
+            return;
+        int order[3] = { 0, 1, 2 };
+        if (area < 0.0f)
+        {
+            std::swap(order[1], order[2]);
+            area = -area;
+        }
+
+        SoftTriangle tri;
+        float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+        tri.MinX = std::max((int)std::ceil(minX - 0.5f), 0);
+        tri.MaxX = std::min((int)std::floor(maxX - 0.5f), width - 1);
+        tri.MinY = std::max((int)std::ceil(minY - 0.5f), 0);
+        tri.MaxY = std::min((int)std::floor(maxY - 0.5f), height - 1);
+        if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+            return;
+
+        for (int e = 0; e < 3; e++)
+        {
+            int a = order[e], b = order[(e + 1) % 3];
+            float dx = x[b] - x[a], dy = y[b] - y[a];
+            tri.TopLeft[e] = dy > 0.0f || (dy == 0.0f && dx < 0.0f);
+
+            // evaluate from the lower end point, whichever way the edge runs
+            bool forward = y[a] < y[b] || (y[a] == y[b] && x[a] < x[b]);
+            int origin = forward ? a : b, other = forward ? b : a;
+            float sign = forward ? 1.0f : -1.0f;
+            tri.X[e] = x[origin];
+            tri.Y[e] = y[origin];
+            tri.A[e] = sign * (x[other] - x[origin]);
+            tri.B[e] = sign * (y[other] - y[origin]);
+        }
+
+        int i0 = order[0], i1 = order[1], i2 = order[2];
+        tri.OriginX = x[i0];
+        tri.OriginY = y[i0];
+        float x1 = x[i1] - x[i0], y1 = y[i1] - y[i0], x2 = x[i2] - x[i0], y2 = y[i2] - y[i0];
+        for (int k = 0; k < SOFT_ATTRIBUTES; k++)
+        {
+            float q1 = values[i1][k] - values[i0][k], q2 = values[i2][k] - values[i0][k];
+            tri.Plane[k][0] = values[i0][k];
+            tri.Plane[k][1] = (q1 * y2 - q2 * y1) / area;
+            tri.Plane[k][2] = (q2 * x1 - q1 * x2) / area;
+        }
+        tri.MinZ = std::max(std::min(values[0][0], std::min(values[1][0], values[2][0])), 0.0f);
+        tri.Material = draw.Material;
+        tri.Highlight = draw.Highlight;
+
+        uint32_t index = (uint32_t)bin.Triangles.size();
+        bin.Triangles.push_back(tri);
+        for (int ty = tri.MinY / SOFT_TILE_SIZE; ty <= tri.MaxY / SOFT_TILE_SIZE; ty++)
+        {
+            for (int tx = tri.MinX / SOFT_TILE_SIZE; tx <= tri.MaxX / SOFT_TILE_SIZE; tx++)
+            {
+                bin.Tiles[ty * tilesX + tx].push_back(index);
+                bin.Binned++;
+            }
+        }
+    }
+
+    void RasterTile(int tile, unsigned& shaded, unsigned& rejected)
+    {
+        int tileX = (tile % tilesX) * SOFT_TILE_SIZE, tileY = (tile / tilesX) * SOFT_TILE_SIZE;
+        float* blocks = &blockMax[(size_t)tile * SOFT_BLOCKS_PER_TILE * SOFT_BLOCKS_PER_TILE];
+
+        // clear to the GL clear color (opaque black) and the far plane
+        uint32_t black = PackColor(0, 0, 0, 255);
+        for (int y = 0; y < SOFT_TILE_SIZE; y++)
+        {
+            size_t row = (size_t)(tileY + y) * pitch + tileX;
+            std::fill(&color[row], &color[row] + SOFT_TILE_SIZE, black);
+            std::fill(&depth[row], &depth[row] + SOFT_TILE_SIZE, 1.0f);
+        }
+        std::fill(blocks, blocks + SOFT_BLOCKS_PER_TILE * SOFT_BLOCKS_PER_TILE, 1.0f);
+        tileMax[tile] = 1.0f;
+
+        for (size_t j = 0; j < bins.size(); j++)
+        {
+            const SoftBin& bin = bins[j];
+            const std::vector<uint32_t>& list = bin.Tiles[tile];
+            for (size_t n = 0; n < list.size(); n++)
+            {
+                const SoftTriangle& tri = bin.Triangles[list[n]];
+                if (tri.MinZ >= tileMax[tile])
+                {
+                    rejected += SOFT_BLOCKS_PER_TILE * SOFT_BLOCKS_PER_TILE;
+                    continue;
+                }
+                if (RasterTriangle(tri, tileX, tileY, blocks, shaded, rejected))
+                {
+                    float farthest = 0.0f;
+                    for (int b = 0; b < SOFT_BLOCKS_PER_TILE * SOFT_BLOCKS_PER_TILE; b++)
+                        farthest = std::max(farthest, blocks[b]);
+                    tileMax[tile] = farthest;
+                }
+            }
+        }
+    }
+
+    // true when a depth was written
+    bool RasterTriangle(const SoftTriangle& tri, int tileX, int tileY, float* blocks, unsigned& shaded, unsigned& rejected)
+    {
+        int x0 = std::max(tri.MinX, tileX), x1 = std::min(tri.MaxX, tileX + SOFT_TILE_SIZE - 1);
+        int y0 = std::max(tri.MinY, tileY), y1 = std::min(tri.MaxY, tileY + SOFT_TILE_SIZE - 1);
+        const SoftFloat4 laneOffsets = SoftFloat4::Set(0.5f, 1.5f, 2.5f, 3.5f);
+        const SoftFloat4 zero = SoftFloat4::Set(0.0f), one = SoftFloat4::Set(1.0f);
+        bool written = false;
+
+        for (int by = (y0 - tileY) / SOFT_BLOCK_SIZE; by <= (y1 - tileY) / SOFT_BLOCK_SIZE; by++)
+        {
+            for (int bx = (x0 - tileX) / SOFT_BLOCK_SIZE; bx <= (x1 - tileX) / SOFT_BLOCK_SIZE; bx++)
+            {
+                float& farthest = blocks[by * SOFT_BLOCKS_PER_TILE + bx];
+                if (tri.MinZ >= farthest)
+                {
+                    rejected++;
+                    continue;
+                }
+
+                int bx0 = std::max(x0, tileX + bx * SOFT_BLOCK_SIZE), bx1 = std::min(x1, tileX + bx * SOFT_BLOCK_SIZE + SOFT_BLOCK_SIZE - 1);
+                int by0 = std::max(y0, tileY + by * SOFT_BLOCK_SIZE), by1 = std::min(y1, tileY + by * SOFT_BLOCK_SIZE + SOFT_BLOCK_SIZE - 1);
+                if (BlockOutside(tri, bx0, bx1, by0, by1))
+                    continue;
+
+                bool blockWritten = false;
+                for (int y = by0; y <= by1; y++)
+                {
+                    float* depthRow = &depth[(size_t)y * pitch];
+                    SoftFloat4 py = SoftFloat4::Set(y + 0.5f);
+                    for (int gx = bx0 & ~3; gx <= bx1; gx += 4)
+                    {
+                        // lanes inside the triangle's pixel bounds
+                        int valid = 0;
+                        for (int lane = 0; lane < 4; lane++)
+                            valid |= (gx + lane >= bx0 && gx + lane <= bx1) << lane;
+
+                        SoftFloat4 px = SoftFloat4::Set((float)gx) + laneOffsets;
+                        SoftFloat4 covered = SoftLessEqual(zero, zero);
+                        for (int e = 0; e < 3; e++)
+                        {
+                            SoftFloat4 edge = SoftFloat4::Set(tri.A[e]) * (py - SoftFloat4::Set(tri.Y[e]))
+                                - SoftFloat4::Set(tri.B[e]) * (px - SoftFloat4::Set(tri.X[e]));
+                            covered = covered & (tri.TopLeft[e] ? SoftGreaterEqual(edge, zero) : SoftGreater(edge, zero));
+                        }
+                        int bits = covered.Mask() & valid;
+                        if (bits == 0)
+                            continue;
+
+                        // depth test (less) and the far plane
+                        SoftFloat4 z = SoftFloat4::Set(tri.Plane[0][0]) + SoftFloat4::Set(tri.Plane[0][1]) * (px - SoftFloat4::Set(tri.OriginX))
+                            + SoftFloat4::Set(tri.Plane[0][2]) * (py - SoftFloat4::Set(tri.OriginY));
+                        SoftFloat4 stored = SoftFloat4::Load(depthRow + gx);
+                        SoftFloat4 passed = SoftLess(z, stored) & SoftLessEqual(z, one) & SoftGreaterEqual(z, zero);
+                        bits &= passed.Mask();
+                        if (bits == 0)
+                            continue;
+
+                        SoftFloat4 laneMask = SoftFloat4::Set(bits & 1 ? -1.0f : 0.0f, bits & 2 ? -1.0f : 0.0f, bits & 4 ? -1.0f : 0.0f,
+                            bits & 8 ? -1.0f : 0.0f);
+                        SoftSelect(SoftLess(laneMask, zero), z, stored).Store(depthRow + gx);
+                        for (int lane = 0; lane < 4; lane++)
+                        {
+                            if (bits & (1 << lane))
+                                color[(size_t)y * pitch + gx + lane] = Shade(tri, gx + lane + 0.5f, y + 0.5f);
+                        }
+                        shaded += (unsigned)((bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1));
+                        blockWritten = true;
+                    }
+                }
+
+                if (blockWritten)
+                {
+                    farthest = BlockFarthest(tileX + bx * SOFT_BLOCK_SIZE, tileY + by * SOFT_BLOCK_SIZE);
+                    written = true;
+                }
+            }
+        }
+        return written;
+    }
+
+    // true when no pixel center of the rectangle can be inside an edge (with a little slack for rounding)
+    static bool BlockOutside(const SoftTriangle& tri, int x0, int x1, int y0, int y1)
+    {
+        for (int e = 0; e < 3; e++)
+        {
+            // E grows with y when A > 0 and with x when B < 0; take the corner where it is largest
+            float x = (tri.B[e] < 0.0f ? x1 : x0) + 0.5f;
+            float y = (tri.A[e] > 0.0f ? y1 : y0) + 0.5f;
+            float largest = tri.A[e] * (y - tri.Y[e]) - tri.B[e] * (x - tri.X[e]);
+            if (largest < -1.0e-3f * (std::fabs(tri.A[e]) + std::fabs(tri.B[e])))
+                return true;
+        }
+        return false;
+    }
+
+    float BlockFarthest(int x, int y) const
+    {
+        SoftFloat4 farthest = SoftFloat4::Set(0.0f);
+        for (int row = 0; row < SOFT_BLOCK_SIZE; row++)
+        {
+            const float* d = &depth[(size_t)(y + row) * pitch + x];
+            for (int column = 0; column < SOFT_BLOCK_SIZE; column += 4)
+                farthest = SoftMax(farthest, SoftFloat4::Load(d + column));
+        }
+        return SoftHorizontalMax(farthest);
+    }
+
+    static uint32_t PackColor(int r, int g, int b, int a)
+    {
+        unsigned char bytes[4] = { (unsigned char)r, (unsigned char)g, (unsigned char)b, (unsigned char)a };
+        uint32_t packed;
+        memcpy(&packed, bytes, sizeof(packed));
+        return packed;
+    }
+
+    // the fragment shader: Phong lighting of the texture color, with the material's specular values
+    uint32_t Shade(const SoftTriangle& tri, float x, float y) const
+    {
+        float dx = x - tri.OriginX, dy = y - tri.OriginY;
+        float attribute[SOFT_ATTRIBUTES];
+        for (int k = 1; k < SOFT_ATTRIBUTES; k++)
+            attribute[k] = tri.Plane[k][0] + tri.Plane[k][1] * dx + tri.Plane[k][2] * dy;
+        float w = 1.0f / attribute[1];
+        glm::vec3 position(attribute[2] * w, attribute[3] * w, attribute[4] * w);
+        glm::vec3 normal(attribute[5] * w, attribute[6] * w, attribute[7] * w);
+        glm::vec2 uv(attribute[8] * w, attribute[9] * w);
+
+        const Material& material = materials[tri.Material];
+        const SoftFrame& f = *frame;
+
+        glm::vec3 norm = glm::normalize(normal);
+        glm::vec3 viewDir = glm::normalize(f.CameraPosition - position);
+        glm::vec3 lighting(0.0f);
+        for (int l = 0; l < f.LightCount; l++)
+        {
+            glm::vec3 ambient = 0.1f * f.LightColors[l];
+            glm::vec3 lightDirection = glm::normalize(f.LightPositions[l] - position);
+            float impact = std::max(glm::dot(norm, lightDirection), 0.0f);
+            glm::vec3 diffuse = impact * f.LightColors[l];
+            glm::vec3 reflectDir = 2.0f * glm::dot(norm, lightDirection) * norm - lightDirection;     // reflect(-lightDir, norm)
+            float specularComponent = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), material.HighlightSize);
+            glm::vec3 specular = material.SpecularIntensity * specularComponent * f.LightColors[l];
+            lighting += ambient + diffuse + specular;
+        }
+
+        // screen space derivatives of the texture coordinate (quotient rule on the planes of uv / w and 1 / w)
+        glm::vec2 scale = f.UVScale * material.UVScale;
+        glm::vec2 ddx((tri.Plane[8][1] - uv.x * tri.Plane[1][1]) * w, (tri.Plane[9][1] - uv.y * tri.Plane[1][1]) * w);
+        glm::vec2 ddy((tri.Plane[8][2] - uv.x * tri.Plane[1][2]) * w, (tri.Plane[9][2] - uv.y * tri.Plane[1][2]) * w);
+        glm::vec3 textureColor = Sample(material.Layer, uv * scale, ddx * scale, ddy * scale);
+
+        glm::vec3 phong = lighting * textureColor;
+        if (tri.Highlight)
+            phong = glm::mix(phong, SOFT_HIGHLIGHT_COLOR, SOFT_HIGHLIGHT_MIX);
+        phong = glm::clamp(phong, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return PackColor((int)phong.r, (int)phong.g, (int)phong.b, 255);
+    }
+
+    // trilinear filtering with repeat wrapping, the level picked as GL does from the larger footprint axis
+    glm::vec3 Sample(int layer, glm::vec2 uv, glm::vec2 ddx, glm::vec2 ddy) const
+    {
+        if (layer >= (int)layers.size() || layers[layer]->empty())
+            return glm::vec3(1.0f);
+        const std::vector<std::vector<unsigned char>>& levels = *layers[layer];
+
+        float footprint = std::max(glm::length(ddx * glm::vec2((float)layerWidth, (float)layerHeight)),
+            glm::length(ddy * glm::vec2((float)layerWidth, (float)layerHeight)));
+        float lod = footprint > 0.0f ? std::log2(footprint) : 0.0f;
+        lod = std::min(std::max(lod, 0.0f), (float)(levels.size() - 1));
+
+        int level = (int)lod;
+        float blend = lod - level;
+        glm::vec3 result = Bilinear(levels, level, uv);
+        if (blend > 0.0f && level + 1 < (int)levels.size())
+            result += (Bilinear(levels, level + 1, uv) - result) * blend;
+        return result;
+    }
+
+    glm::vec3 Bilinear(const std::vector<std::vector<unsigned char>>& levels, int level, glm::vec2 uv) const
+    {
+        int w = std::max(layerWidth >> level, 1), h = std::max(layerHeight >> level, 1);
+        float x = uv.x * w - 0.5f, y = uv.y * h - 0.5f;
+        float fx = std::floor(x), fy = std::floor(y);
+        float tx = x - fx, ty = y - fy;
+        int x0 = Wrap((int)fx, w), x1 = Wrap((int)fx + 1, w), y0 = Wrap((int)fy, h), y1 = Wrap((int)fy + 1, h);
+
+        const unsigned char* texels = levels[level].data();
+        glm::vec3 result;
+        for (int c = 0; c < 3; c++)
+        {
+            float top = texels[((size_t)y0 * w + x0) * 4 + c] * (1.0f - tx) + texels[((size_t)y0 * w + x1) * 4 + c] * tx;
+            float bottom = texels[((size_t)y1 * w + x0) * 4 + c] * (1.0f - tx) + texels[((size_t)y1 * w + x1) * 4 + c] * tx;
+            result[c] = (top * (1.0f - ty) + bottom * ty) / 255.0f;
+        }
+        return result;
+    }
+
+    static int Wrap(int i, int n)
+    {
+        i %= n;
+        return i < 0 ? i + n : i;
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef STRESSSCENE_H
+#define STRESSSCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "materials.h"
+
+// Stress scene layout, in world units
+const float STRESS_TABLE_SIZE = 3.0f;       // side of a square table top
+const float STRESS_TABLE_SPACING = 4.0f;    // between table centers
+const float STRESS_CYLINDER_RADIUS = 0.25f; // radius and half height of the cylinder mesh the plates and food are made of
+const float STRESS_CYLINDER_HALF = 0.02f;
+const int STRESS_MATERIAL_COUNT = 16;       // random materials added to the material table for the scene
+
+// What a generated object is; the renderer maps each kind to one of its meshes
+enum StressKind {
+    STRESS_TABLE,       // plate quad, scaled up and laid flat
+    STRESS_PLATE,       // cylinder, wide and flat
+    STRESS_EGG_WHITE,   // cylinder
+    STRESS_EGG_YOLK,    // smaller cylinder on top of a white
+    STRESS_TOAST,       // pyramid, flattened
+    STRESS_BACON,       // cylinder, stretched into a strip
+    STRESS_KIND_COUNT
+};
+
+const char* const STRESS_KIND_NAMES[STRESS_KIND_COUNT] = {
+    "table", "plate", "egg white", "egg yolk", "toast", "bacon"
+};
+
+// How much to generate; the same description and seed always give the same scene
+struct StressSceneDesc
+{
+    int Tables = 16;
+    int Plates = 8;             // per table
+    int Items = 3;              // eggs, toast or bacon per plate
+    int Lights = 1;
+    uint32_t Seed = 1;
+    int FirstMaterial = 0;      // objects pick from MaterialCount materials starting here
+    int MaterialCount = 1;
+};
+
+struct StressObject
+{
+    StressKind Kind;
+    glm::mat4 Model;
+    int Material;
+};
+
+struct StressLight
+{
+    glm::vec3 Position;
+    glm::vec3 Color;
+};
+
+// Uniform [0, 1) from the raw generator output. std::uniform_real_distribution is implementation defined,
+// so it would give different scenes (and different baselines) with different standard libraries.
+inline float StressRandom(std::mt19937& rng)
+{
+    return (rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float StressRange(std::mt19937& rng, float low, float high)
+{
+    return low + (high - low) * StressRandom(rng);
+}
+
+inline int StressPick(std::mt19937& rng, int count)
+{
+    return std::min((int)(StressRandom(rng) * count), count - 1);
+}
+
+// Radius of a circle around the origin holding every table
+inline float StressSceneRadius(const StressSceneDesc& desc)
+{
+    int columns = (int)std::ceil(std::sqrt((float)std::max(desc.Tables, 1)));
+    int rows = (std::max(desc.Tables, 1) + columns - 1) / columns;
+    float halfX = (columns - 1) * STRESS_TABLE_SPACING * 0.5f + STRESS_TABLE_SIZE * 0.5f;
+    float halfZ = (rows - 1) * STRESS_TABLE_SPACING * 0.5f + STRESS_TABLE_SIZE * 0.5f;
+    return std::sqrt(halfX * halfX + halfZ * halfZ);
+}
+
+// Random materials over the texture layers, to append to the material table
+inline void StressGenerateMaterials(uint32_t seed, int layerCount, std::vector<Material>& materials)
+{
+    std::mt19937 rng(seed ^ 0x9e3779b9u);
+    materials.clear();
+    for (int i = 0; i < STRESS_MATERIAL_COUNT; i++)
+    {
+        Material material;
+        float repeats = StressRange(rng, 0.25f, 2.0f);
+        material.UVScale = glm::vec2(repeats, repeats * StressRange(rng, 0.5f, 2.0f));
+        material.SpecularIntensity = StressRange(rng, 0.0f, 0.6f);
+        material.HighlightSize = std::pow(2.0f, StressRange(rng, 2.0f, 7.0f));
+        material.Layer = StressPick(rng, layerCount);
+        materials.push_back(material);
+    }
+}
+
+// Lays out Tables tables in a grid centered on the origin (y up, table tops at y = 0), each with Plates
+// plates in a grid of its own and Items eggs, toast or bacon at random spots on every plate, all with
+// jittered rotations and sizes and random materials; and Lights lights scattered above the tables.
+inline void StressGenerate(const StressSceneDesc& desc, std::vector<StressObject>& objects, std::vector<StressLight>& lights)
+{
+    std::mt19937 rng(desc.Seed);
+    objects.clear();
+    lights.clear();
+    auto material = [&]() { return desc.FirstMaterial + StressPick(rng, std::max(desc.MaterialCount, 1)); };
+    auto add = [&](StressKind kind, const glm::mat4& model)
+    {
+        StressObject object;
+        object.Kind = kind;
+        object.Model = model;
+        object.Material = material();
+        objects.push_back(object);
+    };
+
+    int columns = (int)std::ceil(std::sqrt((float)std::max(desc.Tables, 1)));
+    int rows = (std::max(desc.Tables, 1) + columns - 1) / columns;
+    int plateColumns = (int)std::ceil(std::sqrt((float)std::max(desc.Plates, 1)));
+    float cell = STRESS_TABLE_SIZE / plateColumns;
+    float plateRadius = cell * 0.4f;
+    float plateTop = 2.0f * STRESS_CYLINDER_HALF;
+    const glm::vec3 up(0.0f, 1.0f, 0.0f);
+
+    for (int t = 0; t < desc.Tables; t++)
+    {
+        glm::vec3 center(((t % columns) - (columns - 1) * 0.5f) * STRESS_TABLE_SPACING, 0.0f,
+            ((t / columns) - (rows - 1) * 0.5f) * STRESS_TABLE_SPACING);
+        glm::mat4 table = glm::translate(center) * glm::rotate(glm::radians(StressRange(rng, -10.0f, 10.0f)), up);
+
+        // the quad spans [-0.5, 0.5] in x and y; it is turned to face up
+        add(STRESS_TABLE, table * glm::rotate(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f))
+            * glm::scale(glm::vec3(STRESS_TABLE_SIZE, STRESS_TABLE_SIZE, 1.0f)));
+
+        for (int p = 0; p < desc.Plates; p++)
+        {
+            glm::vec3 offset(((p % plateColumns) + 0.5f) * cell - STRESS_TABLE_SIZE * 0.5f, STRESS_CYLINDER_HALF,
+                ((p / plateColumns) + 0.5f) * cell - STRESS_TABLE_SIZE * 0.5f);
+            glm::mat4 plate = table * glm::translate(offset) * glm::rotate(glm::radians(StressRange(rng, 0.0f, 360.0f)), up);
+            float plateScale = plateRadius / STRESS_CYLINDER_RADIUS;
+            add(STRESS_PLATE, plate * glm::scale(glm::vec3(plateScale, 1.0f, plateScale)));
+
+            for (int i = 0; i < desc.Items; i++)
+            {
+                float angle = StressRange(rng, 0.0f, 6.2831853f);
+                float distance = std::sqrt(StressRandom(rng)) * plateRadius * 0.55f;
+                float size = plateRadius * StressRange(rng, 0.25f, 0.4f);
+                glm::mat4 spot = plate * glm::translate(glm::vec3(std::cos(angle) * distance, plateTop, std::sin(angle) * distance))
+                    * glm::rotate(glm::radians(StressRange(rng, 0.0f, 360.0f)), up);
+
+                int kind = StressPick(rng, 3);
+                if (kind == 0)
+                {
+                    float scale = size / STRESS_CYLINDER_RADIUS;
+                    add(STRESS_EGG_WHITE, spot * glm::scale(glm::vec3(scale, 1.0f, scale)));
+                    add(STRESS_EGG_YOLK, spot * glm::translate(glm::vec3(0.0f, plateTop, 0.0f))
+                        * glm::scale(glm::vec3(scale * 0.4f, 1.5f, scale * 0.4f)));
+                }
+                else if (kind == 1)
+                {
+                    // the pyramid spans [-0.5, 0.5] on every axis
+                    add(STRESS_TOAST, spot * glm::translate(glm::vec3(0.0f, size * 0.25f, 0.0f))
+                        * glm::scale(glm::vec3(size * 1.6f, size * 0.5f, size * 1.6f)));
+                }
+                else
+                {
+                    float scale = size / STRESS_CYLINDER_RADIUS;
+                    add(STRESS_BACON, spot * glm::scale(glm::vec3(scale * 1.6f, 0.5f, scale * 0.35f)));
+                }
+            }
+        }
+    }
+
+    // lights dim as more are added, so they cost shading time without washing the image out
+    float radius = StressSceneRadius(desc);
+    for (int l = 0; l < desc.Lights; l++)
+    {
+        StressLight light;
+        light.Position = glm::vec3(StressRange(rng, -radius, radius), StressRange(rng, 2.0f, 4.0f), StressRange(rng, -radius, radius));
+        light.Color = glm::vec3(StressRange(rng, 0.7f, 1.0f), StressRange(rng, 0.6f, 1.0f), StressRange(rng, 0.5f, 1.0f))
+            / std::sqrt((float)desc.Lights);
+        lights.push_back(light);
+    }
+}
+
+#endif
@@ -0,0 +1,481 @@
+#ifndef TEXTURESTREAM_H
+#define TEXTURESTREAM_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the implementation is compiled in Source1.cpp, which includes stb_image.h first
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+#include "logger.h"
+
+// Thumbnail cache next to each image (<image>.thumb): header followed by the RGBA pixels of one small mip level
+const char TEXTURE_THUMB_MAGIC[4] = { 'E', 'G', 'G', 'B' };
+const int TEXTURE_THUMB_SIZE = 64;      // the thumbnail is the first level no larger than this
+
+struct TextureThumbHeader
+{
+    char Magic[4];
+    uint32_t Width;         // full resolution size, to detect a changed image
+    uint32_t Height;
+    uint32_t Level;         // mip level the pixels belong to
+};
+
+// A layer of a texture array whose mip levels arrive over several frames, coarsest first. Storage for
+// every level is allocated with the array; levels outside [ResidentBase, LevelCount - 1] just hold no
+// image yet.
+struct StreamedTexture
+{
+    GLuint Id = 0;          // the GL_TEXTURE_2D_ARRAY, which the caller owns
+    int Layer = 0;
+    std::string Path;
+    int Width = 0;
+    int Height = 0;
+    int LevelCount = 0;
+    int ResidentBase = 0;   // finest level uploaded
+    int DesiredBase = 0;    // finest level worth having at the current screen size
+    int MinBase = 0;        // array layers: finest level the array still has storage for
+    float Priority = 0.0f;  // texels needed across the screen this frame (0 = not drawn)
+    bool Placeholder = false; // the coarsest level is a grey stand-in until the decode finishes
+
+    // written by the decode thread, guarded by the streamer mutex
+    std::vector<std::vector<unsigned char>> Levels;
+    bool Decoded = false;
+    bool Requested = false;
+    bool Failed = false;
+    float DecodePriority = 0.0f; // Priority as of the last frame that wanted the decode; Priority is reset every frame
+};
+
+// Streams texture array layers in the background: the GL thread starts each layer with a placeholder (or
+// a cached thumbnail), a worker decodes the images and builds their mip chains, and Update uploads levels
+// from coarse to fine under a per-frame byte budget. Uploads fill storage the array already has, so the
+// GPU memory budget is not the streamer's concern; MaterialSystem holds it by dropping array levels.
+class TextureStreamer
+{
+public:
+    size_t UploadBudget = 1 << 20;      // bytes uploaded per frame (the first level of a frame always goes)
+
+    static TextureStreamer& Instance()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    void Start()
+    {
+        if (running.exchange(true))
+            return;
+        worker = std::thread(&TextureStreamer::WorkerLoop, this);
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running.exchange(false))
+                return;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    // streams an image into one layer of a GL_TEXTURE_2D_ARRAY of width x height layers with full mip
+    // chains; only the image header is read here. An image of another size is resampled to the layer
+    // size. Returns a handle, or -1.
+    int CreateLayer(const char* path, GLuint array, int layer, int width, int height)
+    {
+        int imageWidth, imageHeight, channels;
+        if (!stbi_info(path, &imageWidth, &imageHeight, &channels))
+            return -1;
+
+        std::unique_ptr<StreamedTexture> texture(new StreamedTexture());
+        texture->Id = array;
+        texture->Layer = layer;
+        texture->Path = path;
+        texture->Width = width;
+        texture->Height = height;
+        texture->LevelCount = MipLevelCount(width, height);
+        texture->ResidentBase = texture->LevelCount;
+        texture->DesiredBase = texture->LevelCount - 1;
+
+        // the sampler cannot be clamped per layer; the shader reads ResidentLevel instead
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        UploadTail(*texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        textures.push_back(std::move(texture));
+        return (int)textures.size() - 1;
+    }
+
+    GLuint Texture(int handle) const { return textures[handle]->Id; }
+
+    // finest level of the texture that holds image data
+    int ResidentLevel(int handle) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const StreamedTexture& texture = *textures[handle];
+        return std::min(texture.ResidentBase, texture.LevelCount - 1);
+    }
+
+    // the array lost its levels finer than level (MaterialSystem gave them up under the memory budget),
+    // so the layer stops streaming them. GL thread.
+    void LimitLevel(int handle, int level)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        StreamedTexture& texture = *textures[handle];
+        texture.MinBase = std::min(level, texture.LevelCount - 1);
+        texture.ResidentBase = std::max(texture.ResidentBase, texture.MinBase);
+        texture.DesiredBase = std::max(texture.DesiredBase, texture.MinBase);
+    }
+
+    // levels of a full mip chain down to 1x1
+    static int MipLevelCount(int width, int height)
+    {
+        return 1 + (int)std::floor(std::log2((double)std::max(std::max(width, height), 1)));
+    }
+
+    // full image plus its box filtered mip chain, flipped so that row 0 is the bottom as OpenGL expects.
+    // A resize size other than 0 x 0 resamples the image to it first; width and height receive the final size.
+    static bool Decode(const char* path, std::vector<std::vector<unsigned char>>& levels, int& width, int& height,
+        int resizeWidth = 0, int resizeHeight = 0)
+    {
+        int channels;
+        unsigned char* image = stbi_load(path, &width, &height, &channels, 4);
+        if (image == nullptr)
+            return false;
+
+        levels.clear();
+        levels.push_back(std::vector<unsigned char>((size_t)width * height * 4));
+        size_t rowBytes = (size_t)width * 4;
+        for (int row = 0; row < height; row++)
+            memcpy(&levels[0][row * rowBytes], image + (height - 1 - row) * rowBytes, rowBytes);
+        stbi_image_free(image);
+
+        if (resizeWidth > 0 && resizeHeight > 0 && (resizeWidth != width || resizeHeight != height))
+        {
+            levels[0] = Resample(levels[0], width, height, resizeWidth, resizeHeight);
+            width = resizeWidth;
+            height = resizeHeight;
+        }
+
+        BuildMipTail(levels, width, height);
+        return true;
+    }
+
+    // the object drawn with this texture needs about this many texels across (texture repeats included)
+    void Request(int handle, float texelsAcross)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        StreamedTexture& texture = *textures[handle];
+        texture.Priority = std::max(texture.Priority, texelsAcross);
+    }
+
+    // once per frame on the GL thread, after drawing: picks levels, uploads and starts decodes
+    void Update()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // finest useful level for what was drawn this frame
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            StreamedTexture& texture = *textures[i];
+            if (texture.Priority > 0.0f)
+            {
+                float ratio = std::max(texture.Width, texture.Height) / std::max(texture.Priority, 1.0f);
+                int level = ratio > 1.0f ? (int)std::floor(std::log2(ratio)) : 0;
+                texture.DesiredBase = std::max(std::min(level, texture.LevelCount - 1), texture.MinBase);
+            }
+        }
+
+        // highest priority first
+        std::vector<StreamedTexture*> order;
+        for (size_t i = 0; i < textures.size(); i++)
+            order.push_back(textures[i].get());
+        std::stable_sort(order.begin(), order.end(),
+            [](const StreamedTexture* a, const StreamedTexture* b) { return a->Priority > b->Priority; });
+
+        size_t uploaded = 0;
+        bool requested = false;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            StreamedTexture& texture = *order[i];
+            if (texture.ResidentBase <= texture.DesiredBase || texture.Failed)
+                continue;
+
+            if (!texture.Decoded)
+            {
+                requested |= !texture.Requested;
+                texture.Requested = true;
+                texture.DecodePriority = texture.Priority;
+                continue;
+            }
+
+            // one level at a time, coarse to fine
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture.Id);
+            if (texture.Placeholder)
+            {
+                int level = texture.LevelCount - 1;
+                WriteLevel(texture, level, texture.Levels[level].data());
+                texture.Placeholder = false;
+            }
+            while (texture.ResidentBase > texture.DesiredBase)
+            {
+                int level = texture.ResidentBase - 1;
+                size_t bytes = LevelBytes(texture, level);
+                if (uploaded > 0 && uploaded + bytes > UploadBudget)
+                    break;
+
+                WriteLevel(texture, level, texture.Levels[level].data());
+                texture.ResidentBase = level;
+                uploaded += bytes;
+            }
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            // the decoded chain is only kept until everything wanted is resident
+            if (texture.ResidentBase <= texture.DesiredBase)
+            {
+                std::vector<std::vector<unsigned char>>().swap(texture.Levels);
+                texture.Decoded = false;
+            }
+        }
+
+        for (size_t i = 0; i < textures.size(); i++)
+            textures[i]->Priority = 0.0f;
+
+        lock.unlock();
+        if (requested)
+            wake.notify_one();
+    }
+
+    // true once every texture has the levels its last screen size asked for
+    bool Settled() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            if (textures[i]->ResidentBase > textures[i]->DesiredBase && !textures[i]->Failed)
+                return false;
+        }
+        return true;
+    }
+
+    // stops streaming a layer; the array belongs to the caller
+    void Destroy(int handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        StreamedTexture& texture = *textures[handle];
+        texture.Id = 0;
+        texture.ResidentBase = texture.LevelCount;
+        texture.DesiredBase = texture.LevelCount;
+    }
+
+private:
+    std::vector<std::unique_ptr<StreamedTexture>> textures;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> running{ false };
+    std::thread worker;
+
+    TextureStreamer() {}
+    ~TextureStreamer() { Stop(); }
+
+    static size_t LevelBytes(const StreamedTexture& texture, int level)
+    {
+        return (size_t)std::max(texture.Width >> level, 1) * std::max(texture.Height >> level, 1) * 4;
+    }
+
+    // the array must be bound
+    static void WriteLevel(const StreamedTexture& texture, int level, const unsigned char* pixels)
+    {
+        int width = std::max(texture.Width >> level, 1), height = std::max(texture.Height >> level, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, texture.Layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    // something to sample until the decode finishes: the cached thumbnail and its tail, or mid grey.
+    // Texture must be bound; sets ResidentBase.
+    void UploadTail(StreamedTexture& texture)
+    {
+        std::vector<std::vector<unsigned char>> tail;
+        int tailBase = LoadThumbnail(texture, tail);
+        if (tailBase < 0)
+        {
+            tailBase = texture.LevelCount - 1;
+            tail.assign(1, std::vector<unsigned char>(4, 128));
+            texture.Placeholder = true;
+        }
+        for (int level = texture.LevelCount - 1; level >= tailBase; level--)
+            WriteLevel(texture, level, tail[level - tailBase].data());
+        texture.ResidentBase = tailBase;
+    }
+
+    // decodes requested textures, the highest priority first
+    void WorkerLoop()
+    {
+        for (;;)
+        {
+            StreamedTexture* next = nullptr;
+            std::string path;
+            int resizeWidth = 0, resizeHeight = 0;     // layers all have the array's size
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    for (size_t i = 0; i < textures.size(); i++)
+                    {
+                        StreamedTexture* texture = textures[i].get();
+                        if (texture->Requested && !texture->Decoded && (next == nullptr || texture->DecodePriority > next->DecodePriority))
+                            next = texture;
+                    }
+                    if (next != nullptr || !running)
+                        break;
+                    wake.wait(lock);
+                }
+                if (next == nullptr)
+                    return;
+                path = next->Path;
+                resizeWidth = next->Width;
+                resizeHeight = next->Height;
+            }
+
+            std::vector<std::vector<unsigned char>> levels;
+            int width = 0, height = 0;
+            bool decoded = Decode(path.c_str(), levels, width, height, resizeWidth, resizeHeight);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            next->Requested = false;
+            if (!decoded || width != next->Width || height != next->Height)
+            {
+                LOG(LOG_ERROR, "Failed to stream texture %s", path.c_str());
+                next->Failed = true;
+                continue;
+            }
+            next->Levels.swap(levels);
+            next->Decoded = true;
+            SaveThumbnail(*next);
+        }
+    }
+
+    // bilinear resampling of RGBA pixels to another size
+    static std::vector<unsigned char> Resample(const std::vector<unsigned char>& src, int w, int h, int nw, int nh)
+    {
+        std::vector<unsigned char> dst((size_t)nw * nh * 4);
+        for (int y = 0; y < nh; y++)
+        {
+            float sy = std::min(std::max((y + 0.5f) * h / nh - 0.5f, 0.0f), (float)(h - 1));
+            int y0 = (int)sy, y1 = std::min(y0 + 1, h - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < nw; x++)
+            {
+                float sx = std::min(std::max((x + 0.5f) * w / nw - 0.5f, 0.0f), (float)(w - 1));
+                int x0 = (int)sx, x1 = std::min(x0 + 1, w - 1);
+                float fx = sx - x0;
+                for (int c = 0; c < 4; c++)
+                {
+                    float top = src[(y0 * w + x0) * 4 + c] * (1.0f - fx) + src[(y0 * w + x1) * 4 + c] * fx;
+                    float bottom = src[(y1 * w + x0) * 4 + c] * (1.0f - fx) + src[(y1 * w + x1) * 4 + c] * fx;
+                    dst[((size_t)y * nw + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+        return dst;
+    }
+
+    // appends 2x2 box filtered levels to the last one (of size w x h) down to 1x1
+    static void BuildMipTail(std::vector<std::vector<unsigned char>>& levels, int w, int h)
+    {
+        while (w > 1 || h > 1)
+        {
+            int nw = std::max(w / 2, 1), nh = std::max(h / 2, 1);
+            std::vector<unsigned char> dst((size_t)nw * nh * 4);
+            const std::vector<unsigned char>& src = levels.back();
+            for (int y = 0; y < nh; y++)
+            {
+                int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+                for (int x = 0; x < nw; x++)
+                {
+                    int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int sum = src[(y0 * w + x0) * 4 + c] + src[(y0 * w + x1) * 4 + c] + src[(y1 * w + x0) * 4 + c] + src[(y1 * w + x1) * 4 + c];
+                        dst[(y * nw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+            levels.push_back(std::move(dst));
+            w = nw;
+            h = nh;
+        }
+    }
+
+    static int ThumbnailLevel(const StreamedTexture& texture)
+    {
+        int level = 0;
+        while (level < texture.LevelCount - 1 && std::max(texture.Width >> level, texture.Height >> level) > TEXTURE_THUMB_SIZE)
+            level++;
+        return level;
+    }
+
+    // reads <image>.thumb; returns the level it starts at (tail filled down to 1x1), or -1
+    static int LoadThumbnail(const StreamedTexture& texture, std::vector<std::vector<unsigned char>>& tail)
+    {
+        FILE* file = fopen((texture.Path + ".thumb").c_str(), "rb");
+        if (file == nullptr)
+            return -1;
+
+        TextureThumbHeader header;
+        int level = ThumbnailLevel(texture);
+        int w = std::max(texture.Width >> level, 1), h = std::max(texture.Height >> level, 1);
+        tail.assign(1, std::vector<unsigned char>((size_t)w * h * 4));
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.Magic, TEXTURE_THUMB_MAGIC, sizeof(header.Magic)) == 0
+            && header.Width == (uint32_t)texture.Width && header.Height == (uint32_t)texture.Height && header.Level == (uint32_t)level
+            && fread(tail[0].data(), 1, tail[0].size(), file) == tail[0].size();
+        fclose(file);
+        if (!valid)
+            return -1;
+
+        // the rest of the tail is small enough to build right here
+        BuildMipTail(tail, w, h);
+        return level;
+    }
+
+    static void SaveThumbnail(const StreamedTexture& texture)
+    {
+        std::string path = texture.Path + ".thumb";
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file != nullptr)
+        {
+            fclose(file);
+            return;
+        }
+
+        file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+            return;
+        TextureThumbHeader header;
+        memcpy(header.Magic, TEXTURE_THUMB_MAGIC, sizeof(header.Magic));
+        header.Width = texture.Width;
+        header.Height = texture.Height;
+        header.Level = ThumbnailLevel(texture);
+        const std::vector<unsigned char>& pixels = texture.Levels[header.Level];
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(pixels.data(), 1, pixels.size(), file);
+        fclose(file);
+    }
+};
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "meshfile.h"
+
+// How vertices are laid out in the vertex buffer
+enum Vertex_Format {
+    VERTEX_FORMAT_AUTO,     // pick compact unless the data would lose precision
+    VERTEX_FORMAT_FLOAT,    // position 3 x float, normal 3 x float, uv 2 x float: 32 bytes
+    VERTEX_FORMAT_COMPACT   // position 4 x snorm16, normal octahedral 2 x snorm16, uv 2 x half: 16 bytes
+};
+
+// Largest texture coordinate a half float keeps to better than 1/1024 of a texel repeat
+const float VERTEX_HALF_UV_LIMIT = 2048.0f;
+
+// Geometry as the generators and importers produce it, before it is packed for the GPU
+struct MeshData
+{
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Normals;     // one per position
+    std::vector<glm::vec2> UVs;         // empty when the mesh has no texture coordinates
+    std::vector<uint32_t> Indices;      // triangle list
+    std::vector<MeshFileLod> Lods;      // detail levels as index ranges, finest first; empty means one level
+};
+
+// Vertex buffer contents and the attribute layout that reads them back
+struct PackedVertices
+{
+    Vertex_Format Format;
+    std::vector<unsigned char> Bytes;
+    uint32_t Stride;
+    uint32_t AttributeCount;
+    MeshFileAttribute Attributes[3];
+    glm::vec3 PositionScale;    // object position = stored position * scale + bias
+    glm::vec3 PositionBias;
+    bool OctNormals;            // normals are octahedral encoded in two components
+};
+
+// IEEE 754 half precision, round to nearest
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7c00u | (((bits & 0x7f800000u) == 0x7f800000u && mantissa) ? 0x200u : 0u));
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u)
+            half++;
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u)
+        half++;     // may carry into the exponent, which is the correct rounding
+    return (uint16_t)half;
+}
+
+// IEEE 754 half precision to float (exact)
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+
+    uint32_t bits;
+    if (exponent == 31)
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else if (exponent == 0)
+    {
+        // zero or subnormal: the value is mantissa * 2^-24
+        float value = mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    else
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Converts [-1, 1] to a signed normalized 16 bit value
+inline int16_t FloatToSnorm16(float value)
+{
+    float clamped = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return (int16_t)std::lround(clamped * 32767.0f);
+}
+
+// Maps a unit vector onto the octahedron and unfolds it into the [-1, 1] square
+inline glm::vec2 OctEncode(glm::vec3 n)
+{
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f, 0.0f);   // degenerate normal, decodes to +Z
+
+    glm::vec2 p(n.x / sum, n.y / sum);
+    if (n.z < 0.0f)
+    {
+        glm::vec2 folded((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+        p = folded;
+    }
+    return p;
+}
+
+// Inverse of OctEncode (the vertex shader does the same)
+inline glm::vec3 OctDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f)
+    {
+        float x = (1.0f - std::fabs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - std::fabs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = x;
+        n.y = y;
+    }
+    return glm::normalize(n);
+}
+
+// Picks the compact format unless texture coordinates are too large for half floats
+inline Vertex_Format ChooseVertexFormat(const MeshData& mesh)
+{
+    for (size_t i = 0; i < mesh.UVs.size(); i++)
+    {
+        if (std::fabs(mesh.UVs[i].x) > VERTEX_HALF_UV_LIMIT || std::fabs(mesh.UVs[i].y) > VERTEX_HALF_UV_LIMIT)
+            return VERTEX_FORMAT_FLOAT;
+    }
+    return VERTEX_FORMAT_COMPACT;
+}
+
+// Interleaves the mesh into the requested vertex format (attribute locations 0, 1, 2 = position, normal, uv)
+inline void PackVertices(const MeshData& mesh, Vertex_Format format, PackedVertices& packed)
+{
+    if (format == VERTEX_FORMAT_AUTO)
+        format = ChooseVertexFormat(mesh);
+
+    bool hasUVs = !mesh.UVs.empty();
+    size_t count = mesh.Positions.size();
+    packed.Format = format;
+    packed.AttributeCount = hasUVs ? 3 : 2;
+    packed.PositionScale = glm::vec3(1.0f);
+    packed.PositionBias = glm::vec3(0.0f);
+    packed.OctNormals = format == VERTEX_FORMAT_COMPACT;
+
+    if (format == VERTEX_FORMAT_FLOAT)
+    {
+        packed.Stride = sizeof(float) * (hasUVs ? 8 : 6);
+        packed.Attributes[0] = { 0, 3, GL_FLOAT, GL_FALSE, 0 };
+        packed.Attributes[1] = { 1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3 };
+        packed.Attributes[2] = { 2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 6 };
+
+        packed.Bytes.resize(count * packed.Stride);
+        for (size_t i = 0; i < count; i++)
+        {
+            float* vertex = (float*)&packed.Bytes[i * packed.Stride];
+            memcpy(vertex, &mesh.Positions[i].x, sizeof(float) * 3);
+            memcpy(vertex + 3, &mesh.Normals[i].x, sizeof(float) * 3);
+            if (hasUVs)
+                memcpy(vertex + 6, &mesh.UVs[i].x, sizeof(float) * 2);
+        }
+        return;
+    }
+
+    // positions are stored relative to the bounding box center, scaled by its half extent
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    if (count > 0)
+        boundsMin = boundsMax = mesh.Positions[0];
+    for (size_t i = 1; i < count; i++)
+    {
+        boundsMin = glm::min(boundsMin, mesh.Positions[i]);
+        boundsMax = glm::max(boundsMax, mesh.Positions[i]);
+    }
+    packed.PositionBias = (boundsMin + boundsMax) * 0.5f;
+    packed.PositionScale = (boundsMax - boundsMin) * 0.5f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (packed.PositionScale[axis] <= 0.0f)
+            packed.PositionScale[axis] = 1.0f;
+    }
+
+    packed.Stride = hasUVs ? 16 : 12;
+    packed.Attributes[0] = { 0, 4, GL_SHORT, GL_TRUE, 0 };
+    packed.Attributes[1] = { 1, 2, GL_SHORT, GL_TRUE, 8 };
+    packed.Attributes[2] = { 2, 2, GL_HALF_FLOAT, GL_FALSE, 12 };
+
+    packed.Bytes.resize(count * packed.Stride);
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned char* vertex = &packed.Bytes[i * packed.Stride];
+
+        glm::vec3 local = (mesh.Positions[i] - packed.PositionBias) / packed.PositionScale;
+        int16_t position[4] = { FloatToSnorm16(local.x), FloatToSnorm16(local.y), FloatToSnorm16(local.z), 0 };
+        memcpy(vertex, position, sizeof(position));
+
+        glm::vec2 octahedral = OctEncode(mesh.Normals[i]);
+        int16_t normal[2] = { FloatToSnorm16(octahedral.x), FloatToSnorm16(octahedral.y) };
+        memcpy(vertex + 8, normal, sizeof(normal));
+
+        if (hasUVs)
+        {
+            uint16_t uv[2] = { FloatToHalf(mesh.UVs[i].x), FloatToHalf(mesh.UVs[i].y) };
+            memcpy(vertex + 12, uv, sizeof(uv));
+        }
+    }
+}
+
+// Reads one attribute component the way the GPU does (normalized shorts are clamped to [-1, 1])
+inline float UnpackComponent(const unsigned char* data, uint32_t type, bool normalized)
+{
+    if (type == GL_FLOAT)
+    {
+        float value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    if (type == GL_HALF_FLOAT)
+    {
+        uint16_t half;
+        memcpy(&half, data, sizeof(half));
+        return HalfToFloat(half);
+    }
+    int16_t value;
+    memcpy(&value, data, sizeof(value));
+    if (!normalized)
+        return (float)value;
+    float scaled = value / 32767.0f;
+    return scaled < -1.0f ? -1.0f : scaled;
+}
+
+// Inverse of PackVertices for any layout it or a mesh file produced: decodes vertex buffer contents back
+// into object space positions, unit normals and texture coordinates, exactly as the vertex shader sees them
+inline void UnpackVertices(const unsigned char* bytes, uint32_t vertexCount, uint32_t stride, const MeshFileAttribute* attributes,
+    uint32_t attributeCount, glm::vec3 positionScale, glm::vec3 positionBias, bool octNormals, MeshData& mesh)
+{
+    mesh.Positions.assign(vertexCount, glm::vec3(0.0f));
+    mesh.Normals.assign(vertexCount, glm::vec3(0.0f, 0.0f, 1.0f));
+    mesh.UVs.clear();
+    for (uint32_t a = 0; a < attributeCount; a++)
+    {
+        if (attributes[a].Location == 2)
+            mesh.UVs.assign(vertexCount, glm::vec2(0.0f));
+    }
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const unsigned char* vertex = bytes + (size_t)i * stride;
+        for (uint32_t a = 0; a < attributeCount; a++)
+        {
+            const MeshFileAttribute& attribute = attributes[a];
+            size_t componentSize = attribute.Type == GL_FLOAT ? 4 : 2;
+            float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (uint32_t c = 0; c < attribute.Components && c < 4; c++)
+                values[c] = UnpackComponent(vertex + attribute.Offset + c * componentSize, attribute.Type, attribute.Normalized != 0);
+
+            if (attribute.Location == 0)
+                mesh.Positions[i] = glm::vec3(values[0], values[1], values[2]) * positionScale + positionBias;
+            else if (attribute.Location == 1)
+                mesh.Normals[i] = octNormals ? OctDecode(glm::vec2(values[0], values[1])) : glm::vec3(values[0], values[1], values[2]);
+            else if (attribute.Location == 2)
+                mesh.UVs[i] = glm::vec2(values[0], values[1]);
+        }
+    }
+}
+
+// Copies an imported interleaved float mesh (position, normal, uv) into MeshData
+inline void MeshDataFromSource(const MeshFileSource& source, MeshData& mesh)
+{
+    const int F = MeshFileSource::FLOATS_PER_VERTEX;
+    uint32_t count = source.VertexCount();
+    mesh.Positions.resize(count);
+    mesh.Normals.resize(count);
+    mesh.UVs.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const float* v = &source.Vertices[i * F];
+        mesh.Positions[i] = glm::vec3(v[0], v[1], v[2]);
+        mesh.Normals[i] = glm::vec3(v[3], v[4], v[5]);
+        mesh.UVs[i] = glm::vec2(v[6], v[7]);
+    }
+    mesh.Indices = source.Indices;
+}
+
+// Writes MeshData as a binary mesh file in the given vertex format
+inline bool MeshDataWrite(const char* path, const MeshData& mesh, Vertex_Format format)
+{
+    PackedVertices packed;
+    PackVertices(mesh, format, packed);
+
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    if (!mesh.Positions.empty())
+        boundsMin = boundsMax = mesh.Positions[0];
+    for (size_t i = 1; i < mesh.Positions.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, mesh.Positions[i]);
+        boundsMax = glm::max(boundsMax, mesh.Positions[i]);
+    }
+
+    return MeshFileWrite(path, packed.Bytes.data(), (uint32_t)mesh.Positions.size(), packed.Stride, packed.Attributes,
+        packed.AttributeCount, mesh.Indices.data(), (uint32_t)mesh.Indices.size(), &boundsMin.x, &boundsMax.x,
+        &packed.PositionScale.x, &packed.PositionBias.x, packed.OctNormals ? MESH_FILE_OCT_NORMALS : 0,
+        mesh.Lods.data(), (uint32_t)mesh.Lods.size());
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running queued jobs in submission order. Submit blocks while maxQueued jobs
+// are waiting, so a fast producer cannot pile up unbounded work (and memory).
+class WorkerPool
+{
+public:
+    ~WorkerPool() { Stop(); }
+
+    // threads <= 0 uses every hardware thread but one (that one keeps feeding the pool)
+    void Start(int threads, size_t maxQueued)
+    {
+        if (threads <= 0)
+            threads = (int)std::thread::hardware_concurrency() - 1;
+        if (threads < 1)
+            threads = 1;
+        limit = maxQueued > 0 ? maxQueued : 1;
+        stopping = false;
+        for (int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+    }
+
+    // waits for the queue to drain, then joins the threads
+    void Stop()
+    {
+        if (workers.empty())
+            return;
+        Wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    int ThreadCount() const { return (int)workers.size(); }
+
+    void Submit(std::function<void()> job)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return jobs.size() < limit; });
+        jobs.push_back(std::move(job));
+        lock.unlock();
+        wake.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return jobs.empty() && running == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;   // a job arrived, or stopping
+    std::condition_variable idle;   // a job was taken or finished
+    size_t limit = 1;
+    int running = 0;
+    bool stopping = false;
+
+    void WorkerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                running++;
+            }
+            idle.notify_all();
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+#endif